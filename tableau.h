@@ -5,10 +5,19 @@
 #include <pthread.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <new>
 #include <string>
+#include <utility>
+#include <vector>
+
+#include "tableau_allocator.h"
+#include "tableau_kernels.h"
 
 #define assert_msg(cond, fmt, ...) \
   assert(cond || !fprintf(stderr, fmt, ##__VA_ARGS__))
@@ -25,111 +34,387 @@ enum TableauStorageFormat {
 enum ListStorageFormat {
   DENSE,
   SPARSE,
+  // Stored SPARSE or DENSE depending on density, see ListDensityThresholds.
+  AUTO,
+  // A presence bit per index and the values of the set bits, packed.
+  BITMAP,
 };
 
-template <typename T>
+enum ListCopyPolicy {
+  // The copy gets buffers of its own.
+  DEEP_COPY,
+  // The copy shares the index of a SPARSE list until either of them changes
+  // it, only the values are copied.
+  SHARE_INDEX,
+};
+
+enum TableauAllocationPolicy {
+  // Every list owns heap buffers that are freed one by one.
+  HEAP_ALLOCATION,
+  // Lists live in an arena owned by the tableau and are released in bulk.
+  ARENA_ALLOCATION,
+  // Rows and columns are stored CSR / CSC in a CsrStorage, only the ones
+  // handed out by Row() and Col() get a List object.
+  CSR_ALLOCATION,
+};
+
+template <typename T, typename I = tableau_index_t>
 class SparseTableau;
 
-template <typename T>
+template <typename T, typename I = tableau_index_t>
 class Tableau;
 
+template <typename T, typename I = tableau_index_t>
+class OuterProduct;
+
+template <typename T, typename I = tableau_index_t>
+class CsrStorage;
+
+template <typename T, typename I = tableau_index_t>
+class ColumnPanels;
+
+template <typename T, typename I = tableau_index_t>
+class RatioTest;
+
+template <typename T>
+class CompressedList;
+
 template <typename T>
 inline bool _IsZeroT(const T& value);
 
 /**
- * A list is the abstraction of a row or column in a simplex tableau.
+ * An AUTO list is converted to DENSE once more than to_dense of its length
+ * is stored, and back to SPARSE once at most to_sparse of it is nonzero. The
+ * gap between the two keeps a list near one threshold from converting back
+ * and forth.
  */
-template <typename T>
+struct ListDensityThresholds {
+  double to_dense = 0.4;
+  double to_sparse = 0.2;
+};
+
+inline ListDensityThresholds& ActiveListDensityThresholds() {
+  static ListDensityThresholds thresholds;
+  return thresholds;
+}
+
+inline ListDensityThresholds GetListDensityThresholds() {
+  return ActiveListDensityThresholds();
+}
+
+/* Not thread safe; call it before starting any List operation. */
+inline void SetListDensityThresholds(double to_dense, double to_sparse) {
+  assert_msg(to_sparse < to_dense,
+             "to_sparse must be below to_dense to avoid thrashing");
+  ActiveListDensityThresholds() = {to_dense, to_sparse};
+}
+
+/* Number of format conversions done by AUTO lists, for tuning thresholds. */
+struct ListFormatConversions {
+  std::atomic<int64_t> to_dense{0};
+  std::atomic<int64_t> to_sparse{0};
+};
+
+inline ListFormatConversions& GetListFormatConversions() {
+  static ListFormatConversions conversions;
+  return conversions;
+}
+
+/**
+ * A list is the abstraction of a row or column in a simplex tableau. I is the
+ * type its sparse indices are stored as; lists shorter than 2^32 can use
+ * uint32_t to halve the index memory. Indices are passed as tableau_index_t
+ * either way.
+ */
+template <typename T, typename I = tableau_index_t>
 class List {
  public:
+  struct Element {
+    tableau_index_t index;
+    T value;
+  };
+
+  /**
+   * Iterates the stored elements in increasing index order, which for DENSE
+   * includes the zeros. It caches the buffers of the list, so it is
+   * invalidated by anything that changes the list.
+   */
   class Iterator {
    public:
-    Iterator(List<T>* list) : list_(list) { index_ = 0; }
+    Iterator(const List<T, I>* list, tableau_index_t position)
+        : data_(list->data_), position_(position) {
+      if (list->StorageFormat() == SPARSE) {
+        index_ = list->index_;
+      } else if (list->StorageFormat() == BITMAP) {
+        bitmap_ = list->bitmap_;
+        bitmap_words_ = list->bitmap_words_;
+        if (position_ < list->size_) {
+          bits_ = bitmap_[0];
+          SkipEmptyWords();
+        }
+      }
+    }
 
-    tableau_index_t Index() {
-      if (list_->StorageFormat() == SPARSE)
-        return list_->index_[index_];
-      else
-        return index_;
+    Element operator*() const {
+      if (index_ != nullptr) return {index_[position_], data_[position_]};
+      if (bitmap_ != nullptr)
+        return {(word_ << 6) + __builtin_ctzll(bits_), data_[position_]};
+      return {position_, data_[position_]};
     }
-    T Data() { return list_->data_[index_]; }
 
-    Iterator* Next() {
-      index_ += 1;
-      return this;
+    Iterator& operator++() {
+      position_ += 1;
+      if (bitmap_ != nullptr) {
+        bits_ &= bits_ - 1;
+        SkipEmptyWords();
+      }
+      return *this;
     }
 
-    bool IsEnd() { return index_ >= list_->size_; }
+    bool operator!=(const Iterator& other) const {
+      return position_ != other.position_;
+    }
 
    private:
-    List<T>* list_;
-    tableau_index_t index_;
+    const T* data_;
+    const I* index_ = nullptr;
+    tableau_index_t position_;
+    // BITMAP only: the bits of the current word that are not visited yet.
+    const uint64_t* bitmap_ = nullptr;
+    tableau_size_t bitmap_words_ = 0;
+    tableau_index_t word_ = 0;
+    uint64_t bits_ = 0;
+
+    void SkipEmptyWords() {
+      while (bits_ == 0 and ++word_ < bitmap_words_) bits_ = bitmap_[word_];
+    }
   };
 
-  Iterator* Begin() { return new Iterator(this); }
+  Iterator begin() const { return Iterator(this, 0); }
+  Iterator end() const { return Iterator(this, size_); }
 
-  List(tableau_size_t size = 0, ListStorageFormat format = SPARSE)
-      : storage_format_(format) {
-    if (format == SPARSE) {
+  /**
+   * Calls visit(index, value) for every stored element in increasing index
+   * order. Unlike the iterator the format is only checked once, so the loop
+   * for each format can be vectorized.
+   */
+  template <typename Visitor>
+  void ForEach(Visitor visit) const {
+    if (storage_format_ == SPARSE) {
+      for (tableau_index_t i = 0; i < size_; i++) visit(index_[i], data_[i]);
+    } else if (storage_format_ == BITMAP) {
+      ForEachBit([&](tableau_index_t index, tableau_index_t pos) {
+        visit(index, data_[pos]);
+      });
+    } else {
+      for (tableau_index_t i = 0; i < size_; i++) visit(i, data_[i]);
+    }
+  }
+
+  /**
+   * For SPARSE, size is the initial capacity, for DENSE the length. An AUTO
+   * list of length size starts out empty and SPARSE, a BITMAP list of length
+   * size starts out empty.
+   */
+  List(tableau_size_t size = 0, ListStorageFormat format = SPARSE,
+       ListAllocator* allocator = nullptr)
+      : allocator_(allocator != nullptr ? allocator
+                                        : HeapAllocator::Instance()),
+        storage_format_(format) {
+    if (format == AUTO) {
+      adaptive_ = true;
+      length_ = size;
+      storage_format_ = SPARSE;
+      size = 1;
+    }
+    if (storage_format_ == BITMAP) {
+      length_ = size;
+      AllocateBitmap(BitmapWords(size));
+      capacity_ = 1;
+      size_ = 0;
+      data_ = AllocateBuffer<T>(capacity_);
+    } else if (storage_format_ == SPARSE) {
       capacity_ = 1;
       while (capacity_ < size) {
         capacity_ <<= 1;
       }
       size_ = 0;
-      index_ = new tableau_index_t[capacity_];
-      data_ = new T[capacity_];
+      index_ = AllocateBuffer<I>(capacity_);
+      data_ = AllocateBuffer<T>(capacity_);
     } else {
       size_ = size;
       capacity_ = size;
       if (size > 0) {
-        data_ = new T[capacity_];
+        data_ = AllocateBuffer<T>(capacity_);
         for (auto i = 0; i < capacity_; i++) data_[i] = 0;
       }
     }
   }
   ~List() {
-    if (storage_format_ == SPARSE) {
-      if (capacity_ > 0) {
-        delete data_;
-        delete index_;
-      }
-    } else {
-      if (capacity_ > 0) {
-        delete data_;
-      }
-    }
+    FreeBuffer(data_, capacity_);
+    FreeIndex();
+    FreeBitmap();
+    ReleaseSpareBuffers();
     data_ = nullptr;
     index_ = nullptr;
     size_ = 0;
     capacity_ = 0;
   }
 
-  List(const List<T>* other) {
+  /**
+   * Copies other. SHARE_INDEX is only honored for a SPARSE other that uses
+   * the same allocator, as the last list holding the index frees it.
+   */
+  List(const List<T, I>* other, ListAllocator* allocator = nullptr,
+       ListCopyPolicy policy = DEEP_COPY)
+      : allocator_(allocator != nullptr ? allocator
+                                        : HeapAllocator::Instance()) {
     storage_format_ = other->storage_format_;
+    adaptive_ = other->adaptive_;
+    length_ = other->length_;
+    size_ = other->size_;
+    capacity_ = other->capacity_;
+    data_ = AllocateBuffer<T>(capacity_);
+    // An empty other may have null buffers, as in CopyToSpare.
+    if (size_ > 0) std::memcpy(data_, other->data_, sizeof(T) * size_);
     if (storage_format_ == SPARSE) {
-      size_ = other->size_;
-      capacity_ = other->capacity_;
-      index_ = new tableau_index_t[capacity_];
-      data_ = new T[capacity_];
-      std::memcpy(index_, other->index_, sizeof(tableau_index_t) * capacity_);
-      std::memcpy(data_, other->data_, sizeof(T) * capacity_);
-    } else {
-      size_ = other->size_;
-      capacity_ = other->capacity_;
-      data_ = new T[capacity_];
-      std::memcpy(data_, other->data_, sizeof(T) * capacity_);
+      if (policy == SHARE_INDEX and allocator_ == other->allocator_) {
+        RefCount* refs = other->IndexRefs();
+        refs->fetch_add(1, std::memory_order_relaxed);
+        index_refs_.store(refs, std::memory_order_relaxed);
+        index_ = other->index_;
+      } else {
+        index_ = AllocateBuffer<I>(capacity_);
+        if (size_ > 0)
+          std::memcpy(index_, other->index_, sizeof(I) * size_);
+      }
+    } else if (storage_format_ == BITMAP) {
+      AllocateBitmap(other->bitmap_words_);
+      std::memcpy(bitmap_, other->bitmap_, sizeof(uint64_t) * bitmap_words_);
+      std::memcpy(rank_, other->rank_,
+                  sizeof(tableau_index_t) * bitmap_words_);
+      bitmap_end_ = other->bitmap_end_;
     }
   }
 
+  List(const List<T, I>& other) : List(&other) {}
+  List(List<T, I>&& other) noexcept : allocator_(other.allocator_) {
+    Swap(other);
+  }
+  List<T, I>& operator=(const List<T, I>& other) {
+    if (this != &other) {
+      List<T, I> copy(&other, allocator_);
+      Swap(copy);
+    }
+    return *this;
+  }
+  List<T, I>& operator=(List<T, I>&& other) noexcept {
+    if (this != &other) {
+      List<T, I> moved(std::move(other));
+      Swap(moved);
+    }
+    return *this;
+  }
+
+  /* Exchanges the contents, including the allocators, of the two lists. */
+  void Swap(List<T, I>& other) noexcept {
+    std::swap(size_, other.size_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(index_, other.index_);
+    std::swap(data_, other.data_);
+    std::swap(spare_index_, other.spare_index_);
+    std::swap(spare_data_, other.spare_data_);
+    std::swap(spare_capacity_, other.spare_capacity_);
+    std::swap(allocator_, other.allocator_);
+    std::swap(storage_format_, other.storage_format_);
+    std::swap(adaptive_, other.adaptive_);
+    std::swap(length_, other.length_);
+    std::swap(bitmap_, other.bitmap_);
+    std::swap(rank_, other.rank_);
+    std::swap(bitmap_words_, other.bitmap_words_);
+    std::swap(bitmap_end_, other.bitmap_end_);
+    RefCount* refs = index_refs_.load(std::memory_order_relaxed);
+    index_refs_.store(other.index_refs_.load(std::memory_order_relaxed),
+                      std::memory_order_relaxed);
+    other.index_refs_.store(refs, std::memory_order_relaxed);
+  }
+
+  /* True if the index is shared with a SHARE_INDEX copy. */
+  bool SharesIndex() const {
+    RefCount* refs = index_refs_.load(std::memory_order_relaxed);
+    return refs != nullptr and refs->load(std::memory_order_acquire) > 1;
+  }
+
+  ListAllocator* Allocator() const { return allocator_; }
+
+  /**
+   * Frees the buffers that sparse merges ping-pong into. They are allocated
+   * again by the next merge that needs them.
+   */
+  void ReleaseSpareBuffers() {
+    FreeBuffer(spare_data_, spare_capacity_);
+    FreeBuffer(spare_index_, spare_capacity_);
+    spare_data_ = nullptr;
+    spare_index_ = nullptr;
+    spare_capacity_ = 0;
+  }
+
+  /* The current format, an AUTO list is either SPARSE or DENSE. */
   ListStorageFormat StorageFormat() const { return storage_format_; }
 
-  void Clear() { size_ = 0; }
+  /* True if the list was created AUTO. */
+  bool IsAdaptive() const { return adaptive_; }
+
+  /**
+   * Converts an AUTO list to the format its density calls for. Done
+   * automatically after operations that change the density; converting
+   * back to SPARSE needs a pass over the list and is only done after
+   * operations that make one anyway.
+   */
+  void AdaptStorageFormat() {
+    MaybeConvertToDense();
+    MaybeConvertToSparse();
+  }
+
+  /**
+   * Converts the list to format, which must not be AUTO. An AUTO list that is
+   * converted explicitly keeps the format it is given from then on.
+   */
+  void ConvertTo(ListStorageFormat format) {
+    assert_msg(format != AUTO, "Cannot convert a list to AUTO");
+    adaptive_ = false;
+    if (format == storage_format_) return;
+    if (storage_format_ == BITMAP) {
+      ConvertBitmapToSparse();
+    } else if (storage_format_ == DENSE) {
+      tableau_size_t nonzeros = 0;
+      for (tableau_index_t i = 0; i < size_; i++)
+        nonzeros += _IsZeroT(data_[i]) ? 0 : 1;
+      ConvertToSparse(nonzeros);
+    }
+    if (format == DENSE)
+      ConvertToDense();
+    else if (format == BITMAP)
+      ConvertSparseToBitmap();
+  }
+
+  void Clear() {
+    size_ = 0;
+    if (storage_format_ == BITMAP) {
+      std::memset(bitmap_, 0, sizeof(uint64_t) * bitmap_words_);
+      bitmap_end_ = 0;
+    }
+  }
 
-  T At(tableau_index_t index) {
+  T At(tableau_index_t index) const {
     if (storage_format_ == SPARSE) {
       tableau_index_t pos = BinarySearch(index);
       if (pos >= 0) return data_[pos];
       return 0;
+    } else if (storage_format_ == BITMAP) {
+      tableau_index_t pos = BitmapPosition(index);
+      if (pos >= 0) return data_[pos];
+      return 0;
     } else {
       return data_[index];
     }
@@ -140,6 +425,9 @@ class List {
     if (storage_format_ == SPARSE) {
       tableau_index_t pos = BinarySearch(index);
       if (pos >= 0) data_[pos] = value;
+    } else if (storage_format_ == BITMAP) {
+      tableau_index_t pos = BitmapPosition(index);
+      if (pos >= 0) data_[pos] = value;
     } else {
       data_[index] = value;
     }
@@ -149,6 +437,7 @@ class List {
     assert(StorageFormat() == SPARSE);
     tableau_index_t pos = BinarySearch(index);
     if (pos >= 0) {
+      UnshareIndex();
       for (auto i = pos + 1; i < size_; i++) {
         data_[i - 1] = data_[i];
         index_[i - 1] = index_[i] - 1;
@@ -157,21 +446,22 @@ class List {
     }
   }
 
-  void Add(const List<T>* other) { AddScaled(other, 1, false); }
-  void AddScaled(const List<T>* other, T scale, bool enable_scale) {
-    if (StorageFormat() == SPARSE and other->StorageFormat() == SPARSE) {
+  void Add(const List<T, I>* other) { AddScaled(other, 1, false); }
+  void AddScaled(const List<T, I>* other, T scale, bool enable_scale) {
+    if (StorageFormat() == BITMAP or other->StorageFormat() == BITMAP) {
+      BitmapAddScaled(other, enable_scale ? scale : T(1));
+    } else if (StorageFormat() == SPARSE and
+               other->StorageFormat() == SPARSE) {
       SparseAdd(other, scale, enable_scale);
     } else if (StorageFormat() == DENSE and other->StorageFormat() == DENSE) {
       assert_msg(Size() == other->Size(),
                  "Cannot add two lists with different size");
-      if (enable_scale)
-        for (auto i = 0; i < Size(); i++) data_[i] += scale * other->data_[i];
-      else
-        for (auto i = 0; i < Size(); i++) data_[i] += other->data_[i];
+      DenseAxpy(data_, other->data_, enable_scale ? scale : T(1), Size());
+      MaybeConvertToSparse();
     } else {
       // case 1: StorageFormat() == SPARSE and other->StorageFormat() == DENSE
       // case 2: StorageFormat() == DENSE and other->StorageFormat() == SPARSE
-      tableau_index_t* sparse_index =
+      I* sparse_index =
           StorageFormat() == SPARSE ? index_ : other->index_;
       tableau_size_t dense_size =
           StorageFormat() == DENSE ? Size() : other->Size();
@@ -181,47 +471,41 @@ class List {
       T* dense_data = StorageFormat() == DENSE ? data_ : other->data_;
       T* sparse_data = StorageFormat() == SPARSE ? data_ : other->data_;
       if (StorageFormat() == DENSE) {
-        if (enable_scale)
-          for (auto i = 0; i < sparse_size; i++)
-            dense_data[sparse_index[i]] += scale * sparse_data[i];
-        else
-          for (auto i = 0; i < sparse_size; i++)
-            dense_data[sparse_index[i]] += sparse_data[i];
+        ScatterAxpy(dense_data, sparse_index, sparse_data,
+                    enable_scale ? scale : T(1), sparse_size);
       } else {
-        T* new_data = new T[dense_size];
+        T* new_data = AllocateBuffer<T>(dense_size);
         std::memcpy(new_data, dense_data, sizeof(T) * dense_size);
-        if (enable_scale)
-          for (auto i = 0; i < dense_size; i++) new_data[i] *= scale;
-        if (enable_scale)
-          for (auto i = 0; i < sparse_size; i++)
-            new_data[sparse_index[i]] += sparse_data[i];
-        else
-          for (auto i = 0; i < sparse_size; i++)
-            new_data[sparse_index[i]] += sparse_data[i];
-        delete data_;
-        delete index_;
+        if (enable_scale) DenseScale(new_data, scale, dense_size);
+        ScatterAxpy(new_data, sparse_index, sparse_data, T(1), sparse_size);
+        FreeBuffer(data_, capacity_);
+        FreeIndex();
+        ReleaseSpareBuffers();
         data_ = new_data;
         index_ = nullptr;
         size_ = dense_size;
         capacity_ = dense_size;
         storage_format_ = DENSE;
+        MaybeConvertToSparse();
       }
     }
   }
 
-  void Mul(const List<T>* other) {
-    if (StorageFormat() == SPARSE and other->StorageFormat() == SPARSE) {
+  void Mul(const List<T, I>* other) {
+    if (StorageFormat() == BITMAP or other->StorageFormat() == BITMAP) {
+      BitmapMul(other);
+    } else if (StorageFormat() == SPARSE and
+               other->StorageFormat() == SPARSE) {
       SparseMul(other);
     } else if (StorageFormat() == DENSE and other->StorageFormat() == DENSE) {
       assert_msg(Size() == other->Size(),
                  "Cannot add two lists with different size");
-      for (auto i = 0; i < Size(); i++) {
-        data_[i] *= other->data_[i];
-      }
+      DenseMul(data_, other->data_, Size());
+      MaybeConvertToSparse();
     } else {
       // case 1: StorageFormat() == SPARSE and other->StorageFormat() == DENSE
       // case 2: StorageFormat() == DENSE and other->StorageFormat() == SPARSE
-      tableau_index_t* sparse_index =
+      I* sparse_index =
           StorageFormat() == SPARSE ? index_ : other->index_;
       tableau_size_t dense_size =
           StorageFormat() == DENSE ? Size() : other->Size();
@@ -235,15 +519,14 @@ class List {
           sparse_data[i] *= dense_data[sparse_index[i]];
         }
       } else {
-        T* new_data = new T[sparse_size];
-        tableau_index_t* new_index = new tableau_index_t[sparse_size];
+        T* new_data = AllocateBuffer<T>(sparse_size);
+        I* new_index = AllocateBuffer<I>(sparse_size);
         std::memcpy(new_data, sparse_data, sizeof(T) * sparse_size);
-        std::memcpy(new_index, sparse_index,
-                    sizeof(tableau_index_t) * sparse_size);
+        std::memcpy(new_index, sparse_index, sizeof(I) * sparse_size);
         for (auto i = 0; i < sparse_size; i++) {
-          new_data[i] += dense_data[sparse_index[i]];
+          new_data[i] *= dense_data[sparse_index[i]];
         }
-        delete data_;
+        FreeBuffer(data_, capacity_);
         data_ = new_data;
         index_ = new_index;
         size_ = sparse_size;
@@ -253,14 +536,19 @@ class List {
     }
   }
 
-  void Scale(const T scale) {
-    for (tableau_index_t i = 0; i < size_; i++) data_[i] *= scale;
-  }
+  void Scale(const T scale) { DenseScale(data_, scale, size_); }
 
   template <typename R>
-  List<R>* Map(
+  List<R, I>* Map(
       std::function<R(const tableau_index_t&, const T&)> transform) const {
-    List<R>* list = new List<R>(Size(), StorageFormat());
+    if (StorageFormat() == BITMAP) {
+      List<R, I>* list = new List<R, I>(length_, BITMAP);
+      ForEachBit([&](tableau_index_t index, tableau_index_t pos) {
+        list->Append(index, transform(index, data_[pos]));
+      });
+      return list;
+    }
+    List<R, I>* list = new List<R, I>(Size(), StorageFormat());
     if (StorageFormat() == SPARSE) {
       for (tableau_index_t i = 0; i < Size(); i++) list->Append(index_[i], 0);
 #pragma omp parallel for
@@ -276,8 +564,15 @@ class List {
   }
 
   template <typename R>
-  List<R>* Map(R (*transform)(const T&)) const {
-    List<R>* list = new List<R>(Size(), StorageFormat());
+  List<R, I>* Map(R (*transform)(const T&)) const {
+    if (StorageFormat() == BITMAP) {
+      List<R, I>* list = new List<R, I>(length_, BITMAP);
+      ForEachBit([&](tableau_index_t index, tableau_index_t pos) {
+        list->Append(index, transform(data_[pos]));
+      });
+      return list;
+    }
+    List<R, I>* list = new List<R, I>(Size(), StorageFormat());
     if (StorageFormat() == SPARSE) {
 #pragma omp parallel for
       for (tableau_index_t i = 0; i < Size(); i++) {
@@ -312,6 +607,11 @@ class List {
         initial_value = reduce({index_[i], data_[i]}, initial_value);
       }
       return initial_value;
+    } else if (StorageFormat() == BITMAP) {
+      ForEachBit([&](tableau_index_t index, tableau_index_t pos) {
+        initial_value = reduce({index, data_[pos]}, initial_value);
+      });
+      return initial_value;
     } else {
       for (tableau_index_t i = 0; i < Size(); i++) {
         initial_value = reduce({i, data_[i]}, initial_value);
@@ -320,54 +620,61 @@ class List {
     }
   }
 
-  Tableau<T>* Cross(const List<T>* other, tableau_size_t rows,
+  Tableau<T, I>* Cross(const List<T, I>* other, tableau_size_t rows,
                     tableau_size_t cols,
                     TableauStorageFormat format = ROW_AND_COLUMN) const;
 
-  SparseTableau<T>* SparseCross(
-      const List<T>* other, TableauStorageFormat format = ROW_AND_COLUMN) const;
+  SparseTableau<T, I>* SparseCross(
+      const List<T, I>* other, TableauStorageFormat format = ROW_AND_COLUMN,
+      TableauAllocationPolicy allocation = HEAP_ALLOCATION) const;
+
+  /* scale * this * other^T, evaluated only when added to a Tableau. */
+  OuterProduct<T, I> Outer(const List<T, I>* other, T scale = 1) const;
 
   tableau_size_t Size() const { return size_; }
 
+  /* AUTO and BITMAP lists grow to fit index if it lies beyond the end. */
   void Append(tableau_index_t index, T value) {
-    if (StorageFormat() == SPARSE) {
+    if ((adaptive_ or StorageFormat() == BITMAP) and index >= length_)
+      Resize(index + 1);
+    if (StorageFormat() == BITMAP) {
+      BitmapAppend(index, value);
+    } else if (StorageFormat() == SPARSE) {
+      assert_msg(index <= tableau_index_t(std::numeric_limits<I>::max()),
+                 "Index does not fit the index type of the list");
+      UnshareIndex();
       if (size_ >= capacity_) {
-        capacity_ *= 2;
-        T* new_data = new T[capacity_];
-        tableau_index_t* new_index = new tableau_index_t[capacity_];
-
-        std::memcpy(new_index, index_, sizeof(tableau_index_t) * size_);
-        std::memcpy(new_data, data_, sizeof(T) * size_);
-
-        delete index_;
-        delete data_;
-        index_ = new_index;
-        data_ = new_data;
+        ReserveSpare(std::max<tableau_size_t>(1, capacity_ * 2));
+        CopyToSpare(0, size_, 0);
+        SwapSpare();
+        ReleaseSpareBuffers();
       }
       index_[size_] = index;
       data_[size_] = value;
       size_ += 1;
+      MaybeConvertToDense();
     } else {
       assert(index < size_);
       data_[index] = value;
     }
   }
 
-  T Dot(const List<T>* other) const {
-    if (StorageFormat() == SPARSE and other->StorageFormat() == SPARSE) {
+  T Dot(const List<T, I>* other) const {
+    if (StorageFormat() == BITMAP) {
+      return BitmapDot(other);
+    } else if (other->StorageFormat() == BITMAP) {
+      return other->BitmapDot(this);
+    } else if (StorageFormat() == SPARSE and
+               other->StorageFormat() == SPARSE) {
       return SparseDot(other);
     } else if (StorageFormat() == DENSE and other->StorageFormat() == DENSE) {
       assert_msg(Size() == other->Size(),
                  "Cannot Dot two Dense Lists with different size");
-      T product = 0;
-      for (tableau_index_t i = 0; i < size_; i++) {
-        product += data_[i] * other->data_[i];
-      }
-      return product;
+      return DenseDot(data_, other->data_, size_);
     } else {
       // case 1: StorageFormat() == SPARSE and other->StorageFormat() == DENSE
       // case 2: StorageFormat() == DENSE and other->StorageFormat() == SPARSE
-      tableau_index_t* sparse_index =
+      I* sparse_index =
           StorageFormat() == SPARSE ? index_ : other->index_;
       tableau_size_t dense_size =
           StorageFormat() == DENSE ? Size() : other->Size();
@@ -376,14 +683,20 @@ class List {
       if (sparse_size > 0) assert(sparse_index[sparse_size - 1] < dense_size);
       T* dense_data = StorageFormat() == DENSE ? data_ : other->data_;
       T* sparse_data = StorageFormat() == SPARSE ? data_ : other->data_;
-      T product = 0;
-      for (tableau_index_t i = 0; i < sparse_size; i++) {
-        product += sparse_data[i] * dense_data[sparse_index[i]];
-      }
-      return product;
+      return GatherDot(sparse_data, sparse_index, sparse_size, dense_data);
     }
   }
+  /* An AUTO list is shortened to end before last_index, if given. */
   void Pop(tableau_index_t last_index = -1) {
+    if (adaptive_ and last_index >= 0) {
+      Resize(std::min(last_index, length_));
+      return;
+    }
+    if (adaptive_ and StorageFormat() == DENSE) {
+      if (size_ > 0) Resize(size_ - 1);
+      return;
+    }
+    if (StorageFormat() == BITMAP) return BitmapPop(last_index);
     assert_msg(StorageFormat() == SPARSE, "Dense List does not support Pop");
     if (size_ > 0) {
       if (last_index > 0) {
@@ -393,26 +706,126 @@ class List {
     }
   }
 
-  friend class Iterator;
-
-  template <typename U>
+  template <typename U, typename J>
   friend class SparseTableau;
 
-  template <typename U>
+  template <typename U, typename J>
+  friend class Tableau;
+
+  template <typename U, typename J>
   friend class List;
 
+  template <typename U>
+  friend class CompressedList;
+
+  template <typename U, typename J>
+  friend class CsrStorage;
+
+  template <typename U, typename J>
+  friend class ColumnPanels;
+
+  template <typename U, typename J>
+  friend class RatioTest;
+
  private:
+  /* A list over buffers handed to it by a CsrStorage, see there. */
+  List(ListAllocator* allocator, I* index, T* data, tableau_size_t size,
+       tableau_size_t capacity)
+      : size_(size),
+        capacity_(capacity),
+        index_(index),
+        data_(data),
+        allocator_(allocator) {}
+
   tableau_size_t size_ = 0;
   tableau_size_t capacity_ = 0;
-  tableau_index_t* index_ = nullptr;
+  I* index_ = nullptr;
   T* data_ = nullptr;
+  // Sparse merges write into these and swap them with index_ and data_.
+  I* spare_index_ = nullptr;
+  T* spare_data_ = nullptr;
+  tableau_size_t spare_capacity_ = 0;
+  ListAllocator* allocator_ = nullptr;
   ListStorageFormat storage_format_ = SPARSE;
+  // Set for AUTO lists, which also track the length they cover when SPARSE.
+  bool adaptive_ = false;
+  tableau_size_t length_ = 0;
+  // A BITMAP list has a bit per index below length_, and rank_ holds the
+  // number of elements before each word. Appends only keep rank_ up to date
+  // for words that have a bit set, which are the only ones it is read for.
+  // bitmap_end_ is at or past the last element, exactly so after an append.
+  uint64_t* bitmap_ = nullptr;
+  tableau_index_t* rank_ = nullptr;
+  tableau_size_t bitmap_words_ = 0;
+  tableau_index_t bitmap_end_ = 0;
+  // Number of lists sharing index_, created on the first SHARE_INDEX copy.
+  // Whoever changes a shared index first copies it, and the last list to
+  // let go of it frees it.
+  typedef std::atomic<int64_t> RefCount;
+  mutable std::atomic<RefCount*> index_refs_{nullptr};
 
-  void SparseAdd(const List<T>* other, T scale, bool enable_scale) {
+  template <typename U>
+  U* AllocateBuffer(tableau_size_t count) {
+    return allocator_->AllocateArray<U>(count);
+  }
+  template <typename U>
+  void FreeBuffer(U* buffer, tableau_size_t count) {
+    if (buffer != nullptr) allocator_->DeallocateArray(buffer, count);
+  }
+
+  /* The reference count of index_, created if it is not shared yet. */
+  RefCount* IndexRefs() const {
+    RefCount* refs = index_refs_.load(std::memory_order_acquire);
+    if (refs != nullptr) return refs;
+    // Copies of one list may be made in parallel, so only one count wins.
+    RefCount* fresh =
+        new (allocator_->Allocate(sizeof(RefCount))) RefCount(1);
+    if (index_refs_.compare_exchange_strong(refs, fresh,
+                                            std::memory_order_acq_rel))
+      return fresh;
+    allocator_->Deallocate(fresh, sizeof(RefCount));
+    return refs;
+  }
+  void FreeIndex() {
+    RefCount* refs = index_refs_.exchange(nullptr, std::memory_order_relaxed);
+    if (refs == nullptr) {
+      FreeBuffer(index_, capacity_);
+    } else if (refs->fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      FreeBuffer(index_, capacity_);
+      refs->~RefCount();
+      allocator_->Deallocate(refs, sizeof(RefCount));
+    }
+    index_ = nullptr;
+  }
+  /**
+   * True if no other list holds index_. Once the lists it was shared with are
+   * gone, the reference count is dropped and the index is plain again.
+   */
+  bool OwnsIndex() {
+    RefCount* refs = index_refs_.load(std::memory_order_relaxed);
+    if (refs == nullptr) return true;
+    if (refs->load(std::memory_order_acquire) > 1) return false;
+    index_refs_.store(nullptr, std::memory_order_relaxed);
+    refs->~RefCount();
+    allocator_->Deallocate(refs, sizeof(RefCount));
+    return true;
+  }
+  /* Gives the list an index of its own before it is written to. */
+  void UnshareIndex() {
+    if (OwnsIndex()) return;
+    I* index = AllocateBuffer<I>(capacity_);
+    std::memcpy(index, index_, sizeof(I) * size_);
+    FreeIndex();
+    index_ = index;
+  }
+
+  void SparseAdd(const List<T, I>* other, T scale, bool enable_scale) {
     if (other->Size() == 0) return;
-    capacity_ = Size() + other->Size();
-    tableau_index_t* merged_index = new tableau_index_t[capacity_];
-    T* merged_data = new T[capacity_];
+    if (ShouldGallop(Size(), other->Size()))
+      return GallopingSparseAdd(other, scale, enable_scale);
+    ReserveSpare(Size() + other->Size());
+    I* merged_index = spare_index_;
+    T* merged_data = spare_data_;
     tableau_index_t left_index = 0, right_index = 0, next_index = 0;
 
     while (left_index < Size() && right_index < other->Size()) {
@@ -464,57 +877,592 @@ class List {
       right_index++;
     }
     size_ = next_index;
-    delete index_;
-    delete data_;
-    index_ = merged_index;
-    data_ = merged_data;
-  }
-  void SparseMul(const List<T>* other) {
-    capacity_ = std::min(Size(), other->Size());
-    tableau_index_t* merged_index = new tableau_index_t[capacity_];
-    T* merged_data = new T[capacity_];
-    tableau_index_t left_index = 0, right_index = 0, next_index = 0;
-
-    while (left_index < Size() && right_index < other->Size()) {
-      if (index_[left_index] == other->index_[right_index]) {
-        T prod = data_[left_index] * other->data_[right_index];
-        if (!_IsZeroT(prod)) {
-          merged_data[next_index] = prod;
-          merged_index[next_index] = index_[left_index];
-          next_index++;
-        }
-        left_index++;
-        right_index++;
-      } else if (index_[left_index] < other->index_[right_index]) {
+    SwapSpare();
+    MaybeConvertToDense();
+  }
+  /**
+   * SparseAdd for a list much shorter than this one. The position of each
+   * element of other is found by galloping, and the runs of this list in
+   * between are block copied, unlike the linear merge they are not checked
+   * for zeros.
+   */
+  void GallopingSparseAdd(const List<T, I>* other, T scale, bool enable_scale) {
+    ReserveSpare(Size() + other->Size());
+    tableau_index_t left_index = 0, next_index = 0;
+    for (tableau_index_t right_index = 0; right_index < other->Size();
+         right_index++) {
+      tableau_index_t index = other->index_[right_index];
+      tableau_index_t run_end =
+          GallopLowerBound(index_, left_index, Size(), index);
+      CopyToSpare(left_index, run_end, next_index);
+      next_index += run_end - left_index;
+      left_index = run_end;
+      T value = enable_scale ? scale * other->data_[right_index]
+                             : other->data_[right_index];
+      if (left_index < Size() and index_[left_index] == index) {
+        value = data_[left_index] + value;
         left_index++;
+      }
+      if (!_IsZeroT(value)) {
+        spare_data_[next_index] = value;
+        spare_index_[next_index] = index;
+        next_index++;
+      }
+    }
+    CopyToSpare(left_index, Size(), next_index);
+    size_ = next_index + Size() - left_index;
+    SwapSpare();
+    MaybeConvertToDense();
+  }
+  /* Copies the elements [begin, end) to the spare buffers at position to. */
+  void CopyToSpare(tableau_index_t begin, tableau_index_t end,
+                   tableau_index_t to) {
+    // The buffers of an empty list may be null, which memcpy must not see
+    // even for no bytes.
+    if (end == begin) return;
+    std::memcpy(spare_index_ + to, index_ + begin,
+                sizeof(I) * (end - begin));
+    std::memcpy(spare_data_ + to, data_ + begin, sizeof(T) * (end - begin));
+  }
+  /**
+   * this += scale * other without the spare buffers. The elements of other
+   * already in this list are added where they are, then the others are
+   * merged in back to front, where the write position never passes the read
+   * position. A list that gains no elements is updated in a single pass, and
+   * only a list without room for the new ones allocates. Falls back to
+   * AddScaled unless both lists are SPARSE.
+   */
+  void AddScaledInPlace(const List<T, I>* other, T scale) {
+    if (StorageFormat() != SPARSE or other->StorageFormat() != SPARSE)
+      return AddScaled(other, scale, true);
+    if (other->Size() == 0) return;
+    UnshareIndex();
+    bool cancelled = false;
+    tableau_size_t shared = AddShared(other, scale, &cancelled);
+    if (shared < other->Size()) InsertScaled(other, scale, shared);
+    if (cancelled) {
+      tableau_index_t next = 0;
+      for (tableau_index_t i = 0; i < Size(); i++) {
+        if (_IsZeroT(data_[i])) continue;
+        index_[next] = index_[i];
+        data_[next] = data_[i];
+        next++;
+      }
+      size_ = next;
+    }
+    MaybeConvertToDense();
+  }
+  /**
+   * Adds the elements of other whose index is also in this list and returns
+   * their number. Unless one list is galloped over, the lists are walked by
+   * a loop of its own, since through the SparseIntersect visitor the count
+   * is kept in memory and the walk is a third slower.
+   */
+  tableau_size_t AddShared(const List<T, I>* other, T scale, bool* cancelled) {
+    tableau_size_t shared = 0;
+    bool zero = false;
+    if (ShouldGallop(Size(), other->Size()) or
+        ShouldGallop(other->Size(), Size())) {
+      SparseIntersect(index_, Size(), other->index_, other->Size(),
+                      [&](tableau_index_t left, tableau_index_t right) {
+                        data_[left] += scale * other->data_[right];
+                        zero |= _IsZeroT(data_[left]);
+                        shared++;
+                      });
+    } else {
+      const I* left_index = index_;
+      const I* right_index = other->index_;
+      T* left_data = data_;
+      const T* right_data = other->data_;
+      tableau_index_t left = 0, right = 0;
+      tableau_size_t left_size = Size(), right_size = other->Size();
+      while (left < left_size and right < right_size) {
+        if (left_index[left] < right_index[right]) {
+          left++;
+        } else if (right_index[right] < left_index[left]) {
+          right++;
+        } else {
+          T sum = left_data[left] + scale * right_data[right];
+          left_data[left] = sum;
+          zero |= _IsZeroT(sum);
+          shared++;
+          left++;
+          right++;
+        }
+      }
+    }
+    *cancelled = zero;
+    return shared;
+  }
+  /* Merges in the elements of other not among the shared ones of this list. */
+  void InsertScaled(const List<T, I>* other, T scale, tableau_size_t shared) {
+    tableau_size_t merged_size = Size() + other->Size() - shared;
+    if (capacity_ < merged_size) {
+      ReserveSpare(std::max<tableau_size_t>(merged_size, capacity_ * 2));
+      CopyToSpare(0, size_, 0);
+      SwapSpare();
+      ReleaseSpareBuffers();
+    }
+    bool gallop = ShouldGallop(Size(), other->Size());
+    tableau_index_t left = Size() - 1, next = merged_size - 1;
+    // Once next meets left every new element is in and the rest stays put.
+    for (tableau_index_t right = other->Size() - 1; right >= 0 and next > left;
+         right--) {
+      tableau_index_t index = other->index_[right];
+      if (gallop) {
+        tableau_index_t run_begin =
+            std::upper_bound(index_, index_ + left + 1, index) - index_;
+        tableau_size_t run = left + 1 - run_begin;
+        std::memmove(index_ + next - run + 1, index_ + run_begin,
+                     sizeof(I) * run);
+        std::memmove(data_ + next - run + 1, data_ + run_begin,
+                     sizeof(T) * run);
+        next -= run;
+        left = run_begin - 1;
       } else {
-        right_index++;
+        for (; left >= 0 and index_[left] > index; left--, next--) {
+          index_[next] = index_[left];
+          data_[next] = data_[left];
+        }
       }
+      if (left >= 0 and index_[left] == index) continue;
+      T value = scale * other->data_[right];
+      if (_IsZeroT(value)) continue;
+      index_[next] = index;
+      data_[next] = value;
+      next--;
+    }
+    // Values that scaled to zero leave a gap after the elements [0, left].
+    tableau_size_t gap = next - left;
+    if (gap > 0) {
+      std::memmove(index_ + left + 1, index_ + next + 1,
+                   sizeof(I) * (merged_size - next - 1));
+      std::memmove(data_ + left + 1, data_ + next + 1,
+                   sizeof(T) * (merged_size - next - 1));
     }
+    size_ = merged_size - gap;
+  }
+  /* The product is never longer than this list, so it is built in place. */
+  void SparseMul(const List<T, I>* other) {
+    UnshareIndex();
+    tableau_index_t next_index = 0;
+    SparseIntersect(index_, Size(), other->index_, other->Size(),
+                    [&](tableau_index_t left, tableau_index_t right) {
+                      T prod = data_[left] * other->data_[right];
+                      if (!_IsZeroT(prod)) {
+                        data_[next_index] = prod;
+                        index_[next_index] = index_[left];
+                        next_index++;
+                      }
+                    });
     size_ = next_index;
-    delete index_;
-    delete data_;
-    index_ = merged_index;
-    data_ = merged_data;
   }
 
-  T SparseDot(const List<T>* other) const {
-    tableau_index_t left = 0, right = 0;
+  static tableau_size_t BitmapWords(tableau_size_t length) {
+    return (length + 63) >> 6;
+  }
+  /* Allocates a zeroed bitmap of at least one word, so it is never null. */
+  void AllocateBitmap(tableau_size_t words) {
+    bitmap_words_ = std::max<tableau_size_t>(1, words);
+    bitmap_ = AllocateBuffer<uint64_t>(bitmap_words_);
+    rank_ = AllocateBuffer<tableau_index_t>(bitmap_words_);
+    std::memset(bitmap_, 0, sizeof(uint64_t) * bitmap_words_);
+    std::memset(rank_, 0, sizeof(tableau_index_t) * bitmap_words_);
+  }
+  void FreeBitmap() {
+    FreeBuffer(bitmap_, bitmap_words_);
+    FreeBuffer(rank_, bitmap_words_);
+    bitmap_ = nullptr;
+    rank_ = nullptr;
+    bitmap_words_ = 0;
+  }
+  void RebuildRank() {
+    tableau_index_t rank = 0;
+    for (tableau_index_t w = 0; w < bitmap_words_; w++) {
+      rank_[w] = rank;
+      rank += PopCount(bitmap_[w]);
+    }
+  }
+  /* Position of index in data_, or -1 if its bit is not set. */
+  tableau_index_t BitmapPosition(tableau_index_t index) const {
+    if (index < 0 or index >= length_) return -1;
+    tableau_index_t w = index >> 6;
+    uint64_t bit = uint64_t(1) << (index & 63);
+    if ((bitmap_[w] & bit) == 0) return -1;
+    return rank_[w] + PopCount(bitmap_[w] & (bit - 1));
+  }
+  /* Calls visit(index, position) for every element in increasing order. */
+  template <typename Visitor>
+  void ForEachBit(Visitor visit) const {
+    tableau_index_t pos = 0;
+    for (tableau_index_t w = 0; w < bitmap_words_; w++)
+      for (uint64_t word = bitmap_[w]; word != 0; word &= word - 1)
+        visit((w << 6) + __builtin_ctzll(word), pos++);
+  }
+
+  /**
+   * The number of elements below index, from the rank of the nearest
+   * nonempty word at or below its own, which is exact where the ranks of
+   * empty words need not be. It scans the empty words in between.
+   */
+  tableau_index_t BitmapCountBelow(tableau_index_t index) const {
+    tableau_index_t w = index >> 6;
+    uint64_t below = (uint64_t(1) << (index & 63)) - 1;
+    for (tableau_index_t v = w; v >= 0; v--) {
+      uint64_t word = v == w ? bitmap_[v] & below : bitmap_[v];
+      if (bitmap_[v] != 0) return rank_[v] + PopCount(word);
+    }
+    return 0;
+  }
+  /**
+   * Like SPARSE, a BITMAP list is appended to in increasing index order.
+   * Appends past bitmap_end_ are checked at once; only an append after the
+   * last element was dropped counts the elements below it.
+   */
+  void BitmapAppend(tableau_index_t index, T value) {
+    tableau_index_t pos = BitmapPosition(index);
+    if (pos >= 0) {
+      data_[pos] = value;
+      return;
+    }
+    assert_msg(index >= bitmap_end_ or BitmapCountBelow(index) == size_,
+               "BITMAP lists must be appended to in increasing index order");
+    if (size_ >= capacity_) {
+      ReserveSpare(std::max<tableau_size_t>(1, capacity_ * 2));
+      std::memcpy(spare_data_, data_, sizeof(T) * size_);
+      SwapSpare();
+      ReleaseSpareBuffers();
+    }
+    tableau_index_t w = index >> 6;
+    if (bitmap_[w] == 0) rank_[w] = size_;
+    bitmap_[w] |= uint64_t(1) << (index & 63);
+    data_[size_] = value;
+    size_ += 1;
+    bitmap_end_ = index + 1;
+  }
+  void BitmapPop(tableau_index_t last_index) {
+    if (size_ == 0) return;
+    tableau_index_t w = bitmap_words_ - 1;
+    while (bitmap_[w] == 0) w--;
+    tableau_index_t index = (w << 6) + 63 - __builtin_clzll(bitmap_[w]);
+    if (last_index > 0 and index != last_index) return;
+    bitmap_[w] &= ~(uint64_t(1) << (index & 63));
+    size_ -= 1;
+  }
+
+  /**
+   * Words that are set in both lists are found with an AND, the positions of
+   * their elements with a popcount.
+   */
+  T BitmapDot(const List<T, I>* other) const {
     T product = 0;
-    while (left < Size() and right < other->Size()) {
-      if (index_[left] == other->index_[right]) {
-        product += data_[left] * other->data_[right];
-        left += 1;
-        right += 1;
-      } else if (index_[left] < other->index_[right])
-        left += 1;
-      else
-        right += 1;
+    if (other->StorageFormat() == BITMAP) {
+      tableau_size_t words = std::min(bitmap_words_, other->bitmap_words_);
+      for (tableau_index_t w = 0; w < words; w++) {
+        uint64_t left = bitmap_[w], right = other->bitmap_[w];
+        for (uint64_t word = left & right; word != 0; word &= word - 1) {
+          uint64_t below = (word & -word) - 1;
+          product += data_[rank_[w] + PopCount(left & below)] *
+                     other->data_[other->rank_[w] + PopCount(right & below)];
+        }
+      }
+    } else if (other->StorageFormat() == DENSE) {
+      ForEachBit([&](tableau_index_t index, tableau_index_t pos) {
+        assert(index < other->Size());
+        product += data_[pos] * other->data_[index];
+      });
+    } else {
+      for (tableau_index_t i = 0; i < other->Size(); i++) {
+        tableau_index_t pos = BitmapPosition(other->index_[i]);
+        if (pos >= 0) product += data_[pos] * other->data_[i];
+      }
     }
     return product;
   }
 
-  tableau_index_t BinarySearch(tableau_index_t index) {
+  /**
+   * BITMAP + BITMAP is a word by word OR merge and DENSE + BITMAP scatters
+   * the set bits. The other cases go through SPARSE.
+   */
+  void BitmapAddScaled(const List<T, I>* other, T scale) {
+    if (StorageFormat() == BITMAP and other->StorageFormat() == BITMAP) {
+      BitmapMerge(other, scale);
+    } else if (StorageFormat() == DENSE) {
+      other->ForEachBit([&](tableau_index_t index, tableau_index_t pos) {
+        assert(index < Size());
+        data_[index] += scale * other->data_[pos];
+      });
+      MaybeConvertToSparse();
+    } else if (StorageFormat() == BITMAP) {
+      ConvertBitmapToSparse();
+      AddScaled(other, scale, true);
+      ConvertTo(BITMAP);
+    } else {
+      List<T, I> sparse(other);
+      sparse.ConvertTo(SPARSE);
+      AddScaled(&sparse, scale, true);
+    }
+  }
+  void BitmapMerge(const List<T, I>* other, T scale) {
+    if (other->length_ > length_) Resize(other->length_);
+    ReserveSpare(Size() + other->Size());
+    // other has no bits beyond its length, which is no more than ours now.
+    tableau_size_t words = std::min(bitmap_words_, other->bitmap_words_);
+    tableau_index_t left_index = 0, right_index = 0, next_index = 0;
+    for (tableau_index_t w = 0; w < words; w++) {
+      uint64_t left = bitmap_[w], right = other->bitmap_[w];
+      uint64_t merged = left | right;
+      rank_[w] = next_index;
+      for (uint64_t word = merged; word != 0; word &= word - 1) {
+        uint64_t bit = word & -word;
+        T sum = 0;
+        if (left & bit) sum = data_[left_index++];
+        if (right & bit) sum += scale * other->data_[right_index++];
+        if (_IsZeroT(sum))
+          merged &= ~bit;
+        else
+          spare_data_[next_index++] = sum;
+      }
+      bitmap_[w] = merged;
+    }
+    // Words beyond other are unchanged, their elements only move.
+    std::memcpy(spare_data_ + next_index, data_ + left_index,
+                sizeof(T) * (Size() - left_index));
+    for (tableau_index_t w = words; w < bitmap_words_; w++)
+      rank_[w] += next_index - left_index;
+    size_ = next_index + Size() - left_index;
+    bitmap_end_ = std::max(bitmap_end_, other->bitmap_end_);
+    SwapSpare();
+  }
+
+  /* BITMAP * BITMAP and BITMAP * DENSE are done in place. */
+  void BitmapMul(const List<T, I>* other) {
+    if (StorageFormat() != BITMAP) {
+      List<T, I> sparse(other);
+      sparse.ConvertTo(SPARSE);
+      Mul(&sparse);
+    } else if (other->StorageFormat() == BITMAP) {
+      BitmapIntersectMul(other);
+    } else if (other->StorageFormat() == DENSE) {
+      BitmapMulBy([&](tableau_index_t w, uint64_t bit) {
+        tableau_index_t index = (w << 6) + __builtin_ctzll(bit);
+        assert(index < other->Size());
+        return other->data_[index];
+      });
+    } else {
+      ConvertBitmapToSparse();
+      SparseMul(other);
+      ConvertTo(BITMAP);
+    }
+  }
+  /* Only the AND of the two bitmaps is visited, the rest is dropped. */
+  void BitmapIntersectMul(const List<T, I>* other) {
+    tableau_size_t words = std::min(bitmap_words_, other->bitmap_words_);
+    tableau_index_t next_index = 0;
+    for (tableau_index_t w = 0; w < words; w++) {
+      uint64_t left = bitmap_[w], right = other->bitmap_[w];
+      uint64_t kept = left & right;
+      tableau_index_t rank = rank_[w];
+      rank_[w] = next_index;
+      for (uint64_t word = kept; word != 0; word &= word - 1) {
+        uint64_t bit = word & -word;
+        T prod = data_[rank + PopCount(left & (bit - 1))] *
+                 other->data_[other->rank_[w] + PopCount(right & (bit - 1))];
+        if (_IsZeroT(prod))
+          kept &= ~bit;
+        else
+          data_[next_index++] = prod;
+      }
+      bitmap_[w] = kept;
+    }
+    for (tableau_index_t w = words; w < bitmap_words_; w++) bitmap_[w] = 0;
+    size_ = next_index;
+  }
+  /* Multiplies each element by factor(word, bit), dropping zero products. */
+  template <typename Factor>
+  void BitmapMulBy(Factor factor) {
+    tableau_index_t pos = 0, next_index = 0;
+    for (tableau_index_t w = 0; w < bitmap_words_; w++) {
+      uint64_t kept = 0;
+      rank_[w] = next_index;
+      for (uint64_t word = bitmap_[w]; word != 0; word &= word - 1) {
+        uint64_t bit = word & -word;
+        T prod = data_[pos++] * factor(w, bit);
+        if (_IsZeroT(prod)) continue;
+        data_[next_index++] = prod;
+        kept |= bit;
+      }
+      bitmap_[w] = kept;
+    }
+    size_ = next_index;
+  }
+
+  /* The values are in the same order in both formats and are kept. */
+  void ConvertSparseToBitmap() {
+    length_ = std::max<tableau_size_t>(
+        length_, size_ > 0 ? index_[size_ - 1] + 1 : 0);
+    AllocateBitmap(BitmapWords(length_));
+    for (tableau_index_t i = 0; i < size_; i++)
+      bitmap_[index_[i] >> 6] |= uint64_t(1) << (index_[i] & 63);
+    bitmap_end_ = size_ > 0 ? index_[size_ - 1] + 1 : 0;
+    RebuildRank();
+    FreeIndex();
+    ReleaseSpareBuffers();
+    index_ = nullptr;
+    storage_format_ = BITMAP;
+  }
+  void ConvertBitmapToSparse() {
+    index_ = AllocateBuffer<I>(capacity_);
+    ForEachBit([&](tableau_index_t index, tableau_index_t pos) {
+      index_[pos] = index;
+    });
+    FreeBitmap();
+    ReleaseSpareBuffers();
+    storage_format_ = SPARSE;
+  }
+
+  /**
+   * Makes sure the spare buffers can hold size elements. Capacity only ever
+   * grows, so a list that is merged into repeatedly stops allocating once both
+   * buffers are large enough.
+   */
+  void ReserveSpare(tableau_size_t size) {
+    if (spare_capacity_ >= size) return;
+    tableau_size_t new_capacity = std::max<tableau_size_t>(1, capacity_);
+    while (new_capacity < size) new_capacity <<= 1;
+    FreeBuffer(spare_index_, spare_capacity_);
+    FreeBuffer(spare_data_, spare_capacity_);
+    // BITMAP lists have no index to ping-pong.
+    spare_index_ = storage_format_ == SPARSE
+                       ? AllocateBuffer<I>(new_capacity)
+                       : nullptr;
+    spare_data_ = AllocateBuffer<T>(new_capacity);
+    spare_capacity_ = new_capacity;
+  }
+  void MaybeConvertToDense() {
+    if (adaptive_ and storage_format_ == SPARSE and
+        size_ > GetListDensityThresholds().to_dense * length_) {
+      ConvertToDense();
+      GetListFormatConversions().to_dense.fetch_add(1,
+                                                    std::memory_order_relaxed);
+    }
+  }
+  /* Counts the nonzeros, so only call it after a pass over a DENSE list. */
+  void MaybeConvertToSparse() {
+    if (not adaptive_ or storage_format_ != DENSE) return;
+    tableau_size_t nonzeros = 0;
+    for (tableau_index_t i = 0; i < size_; i++)
+      nonzeros += _IsZeroT(data_[i]) ? 0 : 1;
+    if (nonzeros <= GetListDensityThresholds().to_sparse * size_) {
+      ConvertToSparse(nonzeros);
+      GetListFormatConversions().to_sparse.fetch_add(
+          1, std::memory_order_relaxed);
+    }
+  }
+  void ConvertToDense() {
+    length_ = std::max<tableau_size_t>(
+        length_, size_ > 0 ? index_[size_ - 1] + 1 : 0);
+    T* dense_data = AllocateBuffer<T>(length_);
+    for (tableau_index_t i = 0; i < length_; i++) dense_data[i] = 0;
+    ScatterAxpy(dense_data, index_, data_, T(1), size_);
+    FreeBuffer(data_, capacity_);
+    FreeIndex();
+    ReleaseSpareBuffers();
+    data_ = dense_data;
+    index_ = nullptr;
+    size_ = capacity_ = length_;
+    storage_format_ = DENSE;
+  }
+  void ConvertToSparse(tableau_size_t nonzeros) {
+    tableau_size_t capacity = 1;
+    while (capacity < nonzeros) capacity <<= 1;
+    I* sparse_index = AllocateBuffer<I>(capacity);
+    T* sparse_data = AllocateBuffer<T>(capacity);
+    tableau_size_t next_index = 0;
+    for (tableau_index_t i = 0; i < size_; i++) {
+      if (_IsZeroT(data_[i])) continue;
+      sparse_index[next_index] = i;
+      sparse_data[next_index] = data_[i];
+      next_index++;
+    }
+    FreeBuffer(data_, capacity_);
+    length_ = size_;
+    index_ = sparse_index;
+    data_ = sparse_data;
+    size_ = next_index;
+    capacity_ = capacity;
+    storage_format_ = SPARSE;
+  }
+  /* Changes the length of an AUTO or BITMAP list, dropping what is beyond. */
+  void Resize(tableau_size_t length) {
+    if (storage_format_ == BITMAP) return ResizeBitmap(length);
+    if (storage_format_ == SPARSE) {
+      while (size_ > 0 and index_[size_ - 1] >= length) size_--;
+      length_ = length;
+      return;
+    }
+    if (length > capacity_) {
+      tableau_size_t capacity = std::max(length, 2 * capacity_);
+      T* dense_data = AllocateBuffer<T>(capacity);
+      std::memcpy(dense_data, data_, sizeof(T) * size_);
+      FreeBuffer(data_, capacity_);
+      data_ = dense_data;
+      capacity_ = capacity;
+    }
+    for (tableau_index_t i = size_; i < length; i++) data_[i] = 0;
+    size_ = length_ = length;
+  }
+
+  void ResizeBitmap(tableau_size_t length) {
+    tableau_size_t words = BitmapWords(length);
+    if (words > bitmap_words_) {
+      uint64_t* bitmap = bitmap_;
+      tableau_index_t* rank = rank_;
+      tableau_size_t old_words = bitmap_words_;
+      AllocateBitmap(std::max(words, 2 * old_words));
+      std::memcpy(bitmap_, bitmap, sizeof(uint64_t) * old_words);
+      std::memcpy(rank_, rank, sizeof(tableau_index_t) * old_words);
+      FreeBuffer(bitmap, old_words);
+      FreeBuffer(rank, old_words);
+    } else if (length < length_) {
+      tableau_index_t w = length >> 6;
+      if (length & 63) bitmap_[w++] &= (uint64_t(1) << (length & 63)) - 1;
+      for (; w < bitmap_words_; w++) bitmap_[w] = 0;
+      size_ = 0;
+      for (w = 0; w < bitmap_words_; w++)
+        size_ += PopCount(bitmap_[w]);
+    }
+    length_ = length;
+  }
+
+  /**
+   * Makes the spare buffers current and keeps the old ones as spare. A
+   * shared index is let go of instead, along with the old values.
+   */
+  void SwapSpare() {
+    if (not OwnsIndex()) {
+      FreeIndex();
+      std::swap(index_, spare_index_);
+      std::swap(data_, spare_data_);
+      std::swap(capacity_, spare_capacity_);
+      ReleaseSpareBuffers();
+      return;
+    }
+    std::swap(index_, spare_index_);
+    std::swap(data_, spare_data_);
+    std::swap(capacity_, spare_capacity_);
+  }
+
+  T SparseDot(const List<T, I>* other) const {
+    T product = 0;
+    SparseIntersect(index_, Size(), other->index_, other->Size(),
+                    [&](tableau_index_t left, tableau_index_t right) {
+                      product += data_[left] * other->data_[right];
+                    });
+    return product;
+  }
+
+  tableau_index_t BinarySearch(tableau_index_t index) const {
     tableau_index_t lower = 0, upper = size_ - 1;
     while (lower <= upper) {
       tableau_index_t middle = (lower + upper) / 2;
@@ -531,242 +1479,1479 @@ class List {
   }
 };
 
-/* A Simplex Tableau. */
-template <typename T>
+/**
+ * The rows (or columns) of a CSR_ALLOCATION tableau. The elements of list i
+ * are kept in a slot of the two shared arrays of indices and values, with
+ * some slack after them for growth, PCSR style. Lists only get a List object
+ * when they are handed out by View(); Visit() lends a temporary one on the
+ * stack instead, so a tableau of n lists costs a few words per list rather
+ * than a List and two buffers each.
+ *
+ * The storage is the allocator of its lists. A list that outgrows its slot
+ * moves to heap buffers, and once those add up to half the shared arrays
+ * Repack() gathers every SPARSE list back into fresh arrays with new slack.
+ * Slots are not aligned to kListBufferAlignment.
+ */
+template <typename T, typename I>
+class CsrStorage : public ListAllocator {
+ public:
+  explicit CsrStorage(tableau_size_t count)
+      : count_(count), capacity_(count), slab_capacity_(count) {
+    index_ = new I*[count];
+    data_ = new T*[count];
+    size_ = new tableau_size_t[count];
+    slot_ = new tableau_size_t[count];
+    views_ = new List<T, I>*[count];
+    slab_index_ = static_cast<I*>(malloc(sizeof(I) * slab_capacity_));
+    slab_data_ = static_cast<T*>(malloc(sizeof(T) * slab_capacity_));
+#pragma omp parallel for
+    for (tableau_index_t i = 0; i < count; i++) {
+      index_[i] = slab_index_ + i;
+      data_[i] = slab_data_ + i;
+      size_[i] = 0;
+      slot_[i] = 1;
+      views_[i] = nullptr;
+    }
+  }
+  ~CsrStorage() {
+    for (tableau_index_t i = 0; i < count_; i++) {
+      if (views_[i] != nullptr) {
+        delete views_[i];
+      } else {
+        Deallocate(index_[i], sizeof(I) * slot_[i]);
+        Deallocate(data_[i], sizeof(T) * slot_[i]);
+      }
+    }
+    delete[] index_;
+    delete[] data_;
+    delete[] size_;
+    delete[] slot_;
+    delete[] views_;
+    free(slab_index_);
+    free(slab_data_);
+  }
+
+  CsrStorage(const CsrStorage<T, I>&) = delete;
+  CsrStorage<T, I>& operator=(const CsrStorage<T, I>&) = delete;
+
+  tableau_size_t Count() const { return count_; }
+
+  /**
+   * A List for list i that stays valid until the storage is destroyed or
+   * grown by Append. From then on the List holds the elements of the list.
+   */
+  List<T, I>* View(tableau_index_t i) {
+    if (views_[i] == nullptr) {
+      views_[i] = new List<T, I>(this, index_[i], data_[i], size_[i], slot_[i]);
+      index_[i] = nullptr;
+      data_[i] = nullptr;
+    }
+    return views_[i];
+  }
+
+  /**
+   * Calls visit(List<T, I>*) with list i, which is written back afterwards.
+   * A list that visit leaves other than SPARSE or with a shared index can
+   * not live in a slot, and becomes a view. Different lists may be visited
+   * in parallel.
+   */
+  template <typename Visitor>
+  void Visit(tableau_index_t i, Visitor visit) {
+    if (views_[i] != nullptr) {
+      visit(views_[i]);
+      return;
+    }
+    List<T, I> list(this, index_[i], data_[i], size_[i], slot_[i]);
+    visit(&list);
+    list.ReleaseSpareBuffers();
+    if (list.storage_format_ != SPARSE or list.adaptive_ or
+        list.index_refs_.load(std::memory_order_relaxed) != nullptr) {
+      views_[i] = new List<T, I>(std::move(list));
+      index_[i] = nullptr;
+      data_[i] = nullptr;
+      return;
+    }
+    index_[i] = list.index_;
+    data_[i] = list.data_;
+    size_[i] = list.size_;
+    slot_[i] = list.capacity_;
+    list.index_ = nullptr;
+    list.data_ = nullptr;
+  }
+
+  /* Calls visit(const List<T, I>*) with list i, which it must not change. */
+  template <typename Visitor>
+  void Read(tableau_index_t i, Visitor visit) const {
+    if (views_[i] != nullptr) {
+      visit(static_cast<const List<T, I>*>(views_[i]));
+      return;
+    }
+    List<T, I> list(const_cast<CsrStorage<T, I>*>(this), index_[i], data_[i],
+                    size_[i], slot_[i]);
+    visit(static_cast<const List<T, I>*>(&list));
+    list.index_ = nullptr;
+    list.data_ = nullptr;
+  }
+
+  /* list i . x for a DENSE x, straight from the shared arrays. */
+  T DenseDot(tableau_index_t i, const List<T, I>* x) const {
+    if (views_[i] != nullptr) return views_[i]->Dot(x);
+    if (size_[i] > 0) assert(index_[i][size_[i] - 1] < x->Size());
+    return GatherDot(data_[i], index_[i], size_[i], x->data_);
+  }
+  /* dense += scale * list i for a DENSE dense. */
+  void AddScaledToDense(tableau_index_t i, T scale, List<T, I>* dense) const {
+    if (views_[i] != nullptr) return dense->AddScaled(views_[i], scale, true);
+    if (size_[i] > 0) assert(index_[i][size_[i] - 1] < dense->Size());
+    ScatterAxpy(dense->data_, index_[i], data_[i], scale, size_[i]);
+  }
+
+  /* Replaces the elements of list i by those of list. */
+  void Assign(tableau_index_t i, const List<T, I>* list) {
+    Visit(i, [&](List<T, I>* target) {
+      if (target->StorageFormat() != SPARSE) {
+        *target = *list;
+        return;
+      }
+      target->Clear();
+      target->AddScaledInPlace(list, 1);
+    });
+  }
+
+  /* Adds a list with the elements of list at the end. */
+  void Append(const List<T, I>* list) {
+    if (count_ == capacity_) {
+      capacity_ = std::max<tableau_size_t>(1, capacity_ * 2);
+      Grow(&index_);
+      Grow(&data_);
+      Grow(&size_);
+      Grow(&slot_);
+      Grow(&views_);
+    }
+    // An empty list starts out on the heap; Repack brings it in.
+    index_[count_] = AllocateArray<I>(1);
+    data_[count_] = AllocateArray<T>(1);
+    size_[count_] = 0;
+    slot_[count_] = 1;
+    views_[count_] = nullptr;
+    count_ += 1;
+    Assign(count_ - 1, list);
+  }
+
+  /* Repacks once the lists that moved out take half the shared arrays. */
+  void MaybeRepack() {
+    int64_t heap_bytes = heap_bytes_.load(std::memory_order_relaxed);
+    if (2 * (heap_bytes - repacked_heap_bytes_) >
+        int64_t((sizeof(I) + sizeof(T)) * slab_capacity_))
+      Repack();
+  }
+
+  /**
+   * Moves every SPARSE list into new shared arrays, each with a slot of half
+   * its size again. Lists in other formats stay where they are.
+   */
+  void Repack() {
+    std::vector<tableau_index_t> offset(count_ + 1, 0);
+    for (tableau_index_t i = 0; i < count_; i++) {
+      tableau_size_t slot = 0;
+      if (Repackable(i)) slot = std::max<tableau_size_t>(1, Size(i) * 3 / 2);
+      offset[i + 1] = offset[i] + slot;
+    }
+    I* slab_index = static_cast<I*>(malloc(sizeof(I) * offset[count_]));
+    T* slab_data = static_cast<T*>(malloc(sizeof(T) * offset[count_]));
+#pragma omp parallel for
+    for (tableau_index_t i = 0; i < count_; i++) {
+      if (not Repackable(i)) continue;
+      List<T, I>* view = views_[i];
+      I*& index = view != nullptr ? view->index_ : index_[i];
+      T*& data = view != nullptr ? view->data_ : data_[i];
+      tableau_size_t& slot = view != nullptr ? view->capacity_ : slot_[i];
+      std::memcpy(slab_index + offset[i], index, sizeof(I) * Size(i));
+      std::memcpy(slab_data + offset[i], data, sizeof(T) * Size(i));
+      Deallocate(index, sizeof(I) * slot);
+      Deallocate(data, sizeof(T) * slot);
+      if (view != nullptr) view->ReleaseSpareBuffers();
+      index = slab_index + offset[i];
+      data = slab_data + offset[i];
+      slot = offset[i + 1] - offset[i];
+    }
+    free(slab_index_);
+    free(slab_data_);
+    slab_index_ = slab_index;
+    slab_data_ = slab_data;
+    slab_capacity_ = offset[count_];
+    repacked_heap_bytes_ = heap_bytes_.load(std::memory_order_relaxed);
+  }
+
+  tableau_size_t Size(tableau_index_t i) const {
+    return views_[i] != nullptr ? views_[i]->size_ : size_[i];
+  }
+
+  void* Allocate(size_t bytes) override {
+    if (bytes == 0) return nullptr;
+    allocations_.fetch_add(1, std::memory_order_relaxed);
+    heap_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    return HeapAllocator::Instance()->Allocate(bytes);
+  }
+  /* Slots in the shared arrays are only given back by Repack. */
+  void Deallocate(void* ptr, size_t bytes) override {
+    if (ptr == nullptr or InSlab(ptr)) return;
+    heap_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+    HeapAllocator::Instance()->Deallocate(ptr, bytes);
+  }
+
+  int64_t Allocations() const override {
+    return allocations_.load(std::memory_order_relaxed);
+  }
+  int64_t SystemAllocations() const override { return Allocations(); }
+
+ private:
+  tableau_size_t count_ = 0;
+  tableau_size_t capacity_ = 0;
+  // Where the elements of the lists without a view are, and how many fit.
+  I** index_ = nullptr;
+  T** data_ = nullptr;
+  tableau_size_t* size_ = nullptr;
+  tableau_size_t* slot_ = nullptr;
+  List<T, I>** views_ = nullptr;
+  I* slab_index_ = nullptr;
+  T* slab_data_ = nullptr;
+  tableau_size_t slab_capacity_ = 0;
+  std::atomic<int64_t> allocations_{0};
+  // Bytes of lists that moved out of their slot, and that figure right after
+  // the last Repack, which lists in other formats keep above zero.
+  std::atomic<int64_t> heap_bytes_{0};
+  int64_t repacked_heap_bytes_ = 0;
+
+  bool InSlab(const void* ptr) const {
+    auto in = [&](const void* begin, const void* end) {
+      return std::less_equal<const void*>()(begin, ptr) and
+             std::less<const void*>()(ptr, end);
+    };
+    return in(slab_index_, slab_index_ + slab_capacity_) or
+           in(slab_data_, slab_data_ + slab_capacity_);
+  }
+  bool Repackable(tableau_index_t i) const {
+    List<T, I>* view = views_[i];
+    return view == nullptr or
+           (view->storage_format_ == SPARSE and not view->adaptive_ and
+            view->index_refs_.load(std::memory_order_relaxed) == nullptr);
+  }
+  template <typename U>
+  void Grow(U** array) {
+    U* grown = new U[capacity_];
+    std::copy(*array, *array + count_, grown);
+    delete[] *array;
+    *array = grown;
+  }
+};
+
+/**
+ * The rank one update scale * left * right^T, as done by a pivot. It only
+ * refers to the two lists, which must outlive it; Tableau::Add streams them
+ * into the affected rows and columns without building the product.
+ */
+template <typename T, typename I>
+class OuterProduct {
+ public:
+  OuterProduct(const List<T, I>* left, const List<T, I>* right, T scale = 1)
+      : left_(left), right_(right), scale_(scale) {}
+
+  const List<T, I>* Left() const { return left_; }
+  const List<T, I>* Right() const { return right_; }
+  T Scale() const { return scale_; }
+
+ private:
+  const List<T, I>* left_;
+  const List<T, I>* right_;
+  T scale_;
+};
+
+template <typename T, typename I>
+OuterProduct<T, I> List<T, I>::Outer(const List<T, I>* other, T scale) const {
+  return OuterProduct<T, I>(this, other, scale);
+}
+
+/**
+ * The items [first, second) of work_end, the running work totals of a list
+ * of items, whose work ends in share thread of threads equal shares.
+ */
+inline std::pair<tableau_index_t, tableau_index_t> WorkShare(
+    const std::vector<tableau_size_t>& work_end, tableau_size_t thread,
+    tableau_size_t threads) {
+  tableau_size_t work = work_end.empty() ? 0 : work_end.back();
+  auto begin = std::upper_bound(work_end.begin(), work_end.end(),
+                                work * thread / threads);
+  auto end = std::upper_bound(work_end.begin(), work_end.end(),
+                              work * (thread + 1) / threads);
+  return {begin - work_end.begin(), end - work_end.begin()};
+}
+
+/**
+ * A copy of the rows of a tableau split into panels of panel_columns
+ * columns each, so that a product with a vector wider than the last level
+ * cache only gathers from one cache sized piece of it at a time. Panel p
+ * holds, in increasing row order, an entry for every row with elements in
+ * its columns, and the elements of each entry are kept together in shared
+ * arrays of indices and values.
+ */
+template <typename T, typename I>
+class ColumnPanels {
+ public:
+  /* read_row(row, visit) calls visit(const List<T, I>*) with the row. */
+  template <typename RowReader>
+  ColumnPanels(tableau_size_t rows, tableau_size_t columns,
+               tableau_size_t panel_columns, RowReader read_row)
+      : rows_(rows),
+        panel_columns_(std::max<tableau_size_t>(panel_columns, 1)) {
+    tableau_size_t panels = (columns + panel_columns_ - 1) / panel_columns_;
+    // First count the entries and elements of every panel, then fill them in
+    // using the running counts as cursors.
+    std::vector<tableau_size_t> entries(panels + 1), elements(panels + 1);
+    for (tableau_index_t row = 0; row < rows; row++) {
+      ForEachPiece(
+          row, read_row, [&](tableau_index_t panel) { entries[panel + 1]++; },
+          [&](tableau_index_t panel, I, T) { elements[panel + 1]++; });
+    }
+    for (tableau_index_t panel = 0; panel < panels; panel++) {
+      entries[panel + 1] += entries[panel];
+      elements[panel + 1] += elements[panel];
+    }
+    panel_begin_ = entries;
+    row_.resize(entries[panels]);
+    start_.resize(entries[panels] + 1);
+    start_[entries[panels]] = elements[panels];
+    index_.resize(elements[panels]);
+    data_.resize(elements[panels]);
+    row_work_end_.resize(rows);
+    tableau_size_t work = 0;
+    for (tableau_index_t row = 0; row < rows; row++) {
+      auto new_piece = [&](tableau_index_t panel) {
+        row_[entries[panel]] = row;
+        start_[entries[panel]++] = elements[panel];
+      };
+      auto add = [&](tableau_index_t panel, I index, T value) {
+        index_[elements[panel]] = index;
+        data_[elements[panel]++] = value;
+        work++;
+      };
+      ForEachPiece(row, read_row, new_piece, add);
+      row_work_end_[row] = work += 1;
+    }
+  }
+
+  tableau_size_t PanelColumns() const { return panel_columns_; }
+
+  /**
+   * y = A * x for dense x and y. Every thread owns the rows of its share of
+   * the elements and runs through all panels for them, so the threads never
+   * write the same element of y.
+   */
+  void Times(const T* x, T* y) const {
+    std::fill(y, y + rows_, T(0));
+#pragma omp parallel
+    {
+      auto rows = WorkShare(row_work_end_, omp_get_thread_num(),
+                            omp_get_num_threads());
+      tableau_size_t panels = panel_begin_.size() - 1;
+      for (tableau_index_t panel = 0; panel < panels; panel++) {
+        auto first = row_.begin() + panel_begin_[panel];
+        auto last = row_.begin() + panel_begin_[panel + 1];
+        for (auto entry = std::lower_bound(first, last, rows.first);
+             entry != last and *entry < rows.second; entry++) {
+          tableau_size_t e = entry - row_.begin();
+          y[*entry] += GatherDot(data_.data() + start_[e],
+                                 index_.data() + start_[e],
+                                 start_[e + 1] - start_[e], x);
+        }
+      }
+    }
+  }
+
+ private:
+  tableau_size_t rows_;
+  tableau_size_t panel_columns_;
+  // Entries [panel_begin_[p], panel_begin_[p + 1]) belong to panel p. Entry e
+  // is the part of row row_[e] in its panel, elements [start_[e],
+  // start_[e + 1]).
+  std::vector<tableau_size_t> panel_begin_;
+  std::vector<I> row_;
+  std::vector<tableau_size_t> start_;
+  std::vector<I> index_;
+  std::vector<T> data_;
+  // Running element counts plus one of the rows, to split them by.
+  std::vector<tableau_size_t> row_work_end_;
+
+  /*
+   * Calls visit(panel, index, value) for the nonzeros of row, and
+   * new_piece(panel) before the first one of every panel.
+   */
+  template <typename RowReader, typename PieceVisitor, typename Visitor>
+  void ForEachPiece(tableau_index_t row, RowReader read_row,
+                    PieceVisitor new_piece, Visitor visit) const {
+    read_row(row, [&](const List<T, I>* list) {
+      tableau_index_t last_panel = -1;
+      list->ForEach([&](tableau_index_t index, T value) {
+        if (_IsZeroT(value)) return;
+        tableau_index_t panel = index / panel_columns_;
+        if (panel != last_panel) new_piece(last_panel = panel);
+        visit(panel, index, value);
+      });
+    });
+  }
+};
+
+/* A Simplex Tableau, whose lists store their indices as I. */
+template <typename T, typename I>
 class Tableau {
  public:
+  /**
+   * list_format is the format of the initial rows and columns, SPARSE, AUTO
+   * or BITMAP. AUTO rows switch to DENSE as they fill in. A CSR_ALLOCATION
+   * tableau starts out SPARSE.
+   */
   Tableau(tableau_size_t rows, tableau_size_t columns,
-          TableauStorageFormat format = ROW_AND_COLUMN)
-      : rows_(rows), columns_(columns), storage_format_(format) {
+          TableauStorageFormat format = ROW_AND_COLUMN,
+          TableauAllocationPolicy allocation = HEAP_ALLOCATION,
+          ListStorageFormat list_format = SPARSE)
+      : rows_(rows),
+        columns_(columns),
+        storage_format_(format),
+        list_format_(list_format) {
+    assert_msg(list_format != DENSE, "Tableau lists cannot start out DENSE");
+    assert_msg(allocation != CSR_ALLOCATION or list_format == SPARSE,
+               "CSR tableau lists start out SPARSE");
+    if (allocation == ARENA_ALLOCATION) arena_ = new ArenaAllocator();
     if (storage_format_ == ROW_ONLY or storage_format_ == ROW_AND_COLUMN) {
-      row_heads_ = new List<T>*[rows];
-#pragma omp parallel for
-      for (tableau_size_t i = 0; i < rows; i++) row_heads_[i] = new List<T>();
+      if (allocation == CSR_ALLOCATION) {
+        row_csr_ = new CsrStorage<T, I>(rows);
+      } else {
+        // Rows are only created when first written to.
+        row_heads_ = new List<T, I>*[rows]();
+      }
     }
     if (storage_format_ == COLUMN_ONLY or storage_format_ == ROW_AND_COLUMN) {
-      col_heads_ = new List<T>*[columns];
-#pragma omp parallel for
-      for (tableau_size_t i = 0; i < columns; i++)
-        col_heads_[i] = new List<T>();
+      if (allocation == CSR_ALLOCATION) {
+        col_csr_ = new CsrStorage<T, I>(columns);
+      } else {
+        col_heads_ = new List<T, I>*[columns]();
+      }
     }
   }
   ~Tableau() {
-    if (storage_format_ == ROW_ONLY or storage_format_ == ROW_AND_COLUMN) {
-      for (auto i = 0; i < rows_; i++) {
-        delete row_heads_[i];
+    delete row_csr_;
+    delete col_csr_;
+    delete panels_;
+    if (row_heads_ != nullptr) {
+      if (arena_ == nullptr) {
+        for (auto i = 0; i < rows_; i++) {
+          delete row_heads_[i];
+        }
       }
-      delete row_heads_;
+      delete[] row_heads_;
     }
-    if (storage_format_ == COLUMN_ONLY or storage_format_ == ROW_AND_COLUMN) {
-      for (auto i = 0; i < columns_; i++) {
-        delete col_heads_[i];
+    if (col_heads_ != nullptr) {
+      if (arena_ == nullptr) {
+        for (auto i = 0; i < columns_; i++) {
+          delete col_heads_[i];
+        }
       }
-      delete col_heads_;
+      delete[] col_heads_;
     }
+    // Every list of an arena backed tableau lives in the arena.
+    delete arena_;
+  }
+
+  // Copying a tableau copies every list, so it is spelled out with Add.
+  Tableau(const Tableau<T, I>&) = delete;
+  Tableau<T, I>& operator=(const Tableau<T, I>&) = delete;
+  Tableau(Tableau<T, I>&& other) noexcept { Swap(other); }
+  Tableau<T, I>& operator=(Tableau<T, I>&& other) noexcept {
+    if (this != &other) {
+      Tableau<T, I> moved(std::move(other));
+      Swap(moved);
+    }
+    return *this;
+  }
+
+  void Swap(Tableau<T, I>& other) noexcept {
+    std::swap(rows_, other.rows_);
+    std::swap(columns_, other.columns_);
+    std::swap(row_heads_, other.row_heads_);
+    std::swap(col_heads_, other.col_heads_);
+    std::swap(row_csr_, other.row_csr_);
+    std::swap(col_csr_, other.col_csr_);
+    std::swap(panels_, other.panels_);
+    std::swap(arena_, other.arena_);
+    std::swap(storage_format_, other.storage_format_);
+    std::swap(list_format_, other.list_format_);
+    spa_.swap(other.spa_);
+    spa_touched_.swap(other.spa_touched_);
+  }
+
+  /**
+   * Creates an empty list owned by the allocator of this tableau. Lists passed
+   * to AppendRow and friends of an arena backed tableau must either come from
+   * here or use the default heap allocator, in which case they are copied.
+   */
+  List<T, I>* NewList(tableau_size_t size = 0,
+                   ListStorageFormat format = SPARSE) const {
+    if (arena_ == nullptr) return new List<T, I>(size, format);
+    return new (arena_->Allocate(sizeof(List<T, I>)))
+        List<T, I>(size, format, arena_);
+  }
+
+  /* The allocator backing the rows and columns of this tableau. */
+  ListAllocator* Allocator() const {
+    if (arena_ != nullptr) return arena_;
+    return HeapAllocator::Instance();
   }
 
   T At(tableau_index_t row, tableau_index_t col) {
+    T value;
     if (storage_format_ == ROW_ONLY or storage_format_ == ROW_AND_COLUMN)
-      return Row(row)->At(col);
+      ReadRow(row, [&](const List<T, I>* list) { value = list->At(col); });
     else
-      return Col(col)->At(row);
+      ReadCol(col, [&](const List<T, I>* list) { value = list->At(row); });
+    return value;
   }
 
-  List<T>* Row(tableau_index_t row) const {
-    if (storage_format_ == COLUMN_ONLY) {
+  /**
+   * A row or column that may be changed through the returned List. It gets
+   * a List on first use and drops the column panels, so read with the const
+   * overloads, ReadRow or ReadCol where possible.
+   */
+  List<T, I>* Row(tableau_index_t row) {
+    DropColumnPanels();
+    return RowHead(row);
+  }
+  List<T, I>* Col(tableau_index_t col) {
+    DropColumnPanels();
+    return ColHead(col);
+  }
+  /**
+   * Rows and columns never written to are the shared EmptyList(), so
+   * readers do not write the tableau. A CSR_ALLOCATION line has no List to
+   * hand out without writing the tableau, so read those with ReadRow or
+   * ReadCol.
+   */
+  const List<T, I>* Row(tableau_index_t row) const {
+    CheckRows();
+    if (row_csr_ != nullptr)
       throw std::runtime_error(
-          "Cannot get row of tableau in column only storage format");
-    }
-    return row_heads_[row];
+          "Read the rows of a const CSR_ALLOCATION tableau with ReadRow");
+    return row_heads_[row] == nullptr ? EmptyList() : row_heads_[row];
   }
-  List<T>* Col(tableau_index_t col) const {
-    if (storage_format_ == ROW_ONLY) {
+  const List<T, I>* Col(tableau_index_t col) const {
+    CheckCols();
+    if (col_csr_ != nullptr)
       throw std::runtime_error(
-          "Cannot get column of tableau in row only storage format");
-    }
-    return col_heads_[col];
+          "Read the columns of a const CSR_ALLOCATION tableau with ReadCol");
+    return col_heads_[col] == nullptr ? EmptyList() : col_heads_[col];
+  }
+  /**
+   * Calls visit(const List<T, I>*) with the row. A row of a CSR_ALLOCATION
+   * tableau is lent on the stack, so this reads any tableau.
+   */
+  template <typename Visitor>
+  void ReadRow(tableau_index_t row, Visitor visit) const {
+    if (row_csr_ != nullptr)
+      row_csr_->Read(row, visit);
+    else
+      visit(Row(row));
+  }
+  template <typename Visitor>
+  void ReadCol(tableau_index_t col, Visitor visit) const {
+    if (col_csr_ != nullptr)
+      col_csr_->Read(col, visit);
+    else
+      visit(Col(col));
   }
 
-  void Add(const Tableau<T>* other) {
+  void Add(const Tableau<T, I>* other) {
+    DropColumnPanels();
     assert(rows_ == other->rows_);
     assert(columns_ == other->columns_);
     assert(storage_format_ == other->storage_format_);
 
     if (storage_format_ == ROW_ONLY or storage_format_ == ROW_AND_COLUMN) {
+      // Lines that other leaves empty are not visited, which would create
+      // them.
 #pragma omp parallel for
-      for (tableau_index_t row = 0; row < rows_; row++)
-        Row(row)->Add(other->Row(row));
+      for (tableau_index_t row = 0; row < rows_; row++) {
+        other->ReadRow(row, [&](const List<T, I>* other_row) {
+          if (other_row->Size() == 0) return;
+          VisitRow(row, [&](List<T, I>* list) {
+            list->AddScaledInPlace(other_row, 1);
+          });
+        });
+      }
     }
     if (storage_format_ == COLUMN_ONLY or storage_format_ == ROW_AND_COLUMN) {
 #pragma omp parallel for
-      for (tableau_index_t col = 0; col < columns_; col++)
-        Col(col)->Add(other->Col(col));
+      for (tableau_index_t col = 0; col < columns_; col++) {
+        other->ReadCol(col, [&](const List<T, I>* other_col) {
+          if (other_col->Size() == 0) return;
+          VisitCol(col, [&](List<T, I>* list) {
+            list->AddScaledInPlace(other_col, 1);
+          });
+        });
+      }
     }
+    MaybeRepack();
   }
 
-  void Add(const SparseTableau<T>* other) {
+  void Add(const SparseTableau<T, I>* other) {
+    DropColumnPanels();
     assert(storage_format_ == other->StorageFormat());
 
     if (storage_format_ == ROW_ONLY or storage_format_ == ROW_AND_COLUMN) {
 #pragma omp parallel for
-      for (tableau_index_t row = 0; row < other->Rows(); row++)
-        Row(other->SparseRowIndexOf(row))->Add(other->Row(row));
+      for (tableau_index_t row = 0; row < other->Rows(); row++) {
+        VisitRow(other->SparseRowIndexOf(row), [&](List<T, I>* list) {
+          list->AddScaledInPlace(other->Row(row), 1);
+        });
+      }
     }
     if (storage_format_ == COLUMN_ONLY or storage_format_ == ROW_AND_COLUMN) {
 #pragma omp parallel for
-      for (tableau_index_t col = 0; col < other->Cols(); col++)
-        Col(other->SparseColIndexOf(col))->Add(other->Col(col));
+      for (tableau_index_t col = 0; col < other->Cols(); col++) {
+        VisitCol(other->SparseColIndexOf(col), [&](List<T, I>* list) {
+          list->AddScaledInPlace(other->Col(col), 1);
+        });
+      }
     }
+    MaybeRepack();
   }
 
-  template <typename U>
-  friend class List;
+  /* Same as RankOneUpdate with the lists and scale of the product. */
+  void Add(const OuterProduct<T, I>& product) {
+    RankOneUpdate(product.Left(), product.Right(), product.Scale());
+  }
+
+  /**
+   * this += alpha * u * v^T, the pivot update. Row i gets v scaled by
+   * alpha * u[i] and column j gets u scaled by alpha * v[j], in one parallel
+   * pass over both whose work is split between the threads by nonzero count
+   * rather than by list. SPARSE lists are merged in their own buffers. u and
+   * v must not be rows or columns of this tableau, since those are written.
+   */
+  void RankOneUpdate(const List<T, I>* u, const List<T, I>* v, T alpha) {
+    DropColumnPanels();
+    if (u->StorageFormat() == BITMAP or v->StorageFormat() == BITMAP) {
+      List<T, I> sparse_u(u), sparse_v(v);
+      if (sparse_u.StorageFormat() == BITMAP) sparse_u.ConvertTo(SPARSE);
+      if (sparse_v.StorageFormat() == BITMAP) sparse_v.ConvertTo(SPARSE);
+      RankOneUpdate(&sparse_u, &sparse_v, alpha);
+      return;
+    }
+    std::vector<RankOneTarget> targets;
+    if (storage_format_ == ROW_ONLY or storage_format_ == ROW_AND_COLUMN)
+      AddRankOneTargets(true, u, v, alpha, &targets);
+    if (storage_format_ == COLUMN_ONLY or storage_format_ == ROW_AND_COLUMN)
+      AddRankOneTargets(false, v, u, alpha, &targets);
+    // work_end[k] is the work of the targets up to and including k.
+    std::vector<tableau_size_t> work_end(targets.size());
+    tableau_size_t work = 0;
+    for (size_t k = 0; k < targets.size(); k++)
+      work_end[k] = work += targets[k].work;
+#pragma omp parallel if (work >= kParallelWork)
+    ForEachInWorkShare(work_end, [&](tableau_index_t k) {
+      const RankOneTarget& target = targets[k];
+      auto update = [&](List<T, I>* list) {
+        list->AddScaledInPlace(target.other, target.scale);
+      };
+      if (target.is_row)
+        VisitRow(target.index, update);
+      else
+        VisitCol(target.index, update);
+    });
+    MaybeRepack();
+  }
 
-  void AppendRow(tableau_index_t row, List<T>* list) {
-    // TODO: delete row_heads_[row]
+  /**
+   * Gauss-Jordan pivot on the element at row and col: row is divided by the
+   * pivot element and col is eliminated from every other row, keeping both
+   * orientations. This is RankOneUpdate with the pivot column, without the
+   * pivot row, and the scaled pivot row, whose entry at col is exactly 1 so
+   * col cancels exactly. Only the rows with an element in col are touched;
+   * in ROW_ONLY storage finding them takes a pass over every row.
+   */
+  void Pivot(tableau_index_t row, tableau_index_t col) {
+    assert(row < rows_ and col < columns_);
+    T pivot = At(row, col);
+    assert_msg(not _IsZeroT(pivot), "Cannot pivot on a zero element");
+    T inverse = T(1) / pivot;
+    List<T, I> pivot_row, pivot_col;
+    ReadSparseLine(true, row, [&](tableau_index_t j, T value) {
+      pivot_row.Append(j, j == col ? T(1) : value * inverse);
+    });
+    ReadSparseLine(false, col, [&](tableau_index_t i, T value) {
+      if (i != row) pivot_col.Append(i, value);
+    });
+    RankOneUpdate(&pivot_col, &pivot_row, -1);
     if (storage_format_ == ROW_ONLY or storage_format_ == ROW_AND_COLUMN) {
-      row_heads_[row] = list;
+      VisitRow(row, [&](List<T, I>* list) {
+        list->Scale(inverse);
+        list->Set(col, 1);
+      });
     }
     if (storage_format_ == COLUMN_ONLY or storage_format_ == ROW_AND_COLUMN) {
-      for (auto iter = list->Begin(); iter->IsEnd() == false;
-           iter = iter->Next()) {
-        Col(iter->Index())->Append(row, iter->Data());
+#pragma omp parallel for if (pivot_row.Size() >= kParallelWork)
+      for (tableau_index_t k = 0; k < pivot_row.Size(); k++) {
+        VisitCol(pivot_row.index_[k], [&](List<T, I>* list) {
+          list->Set(row, pivot_row.data_[k]);
+        });
       }
     }
   }
-  void AppendCol(tableau_index_t col, List<T>* list) {
-    // TODO: delete col_heads_[col]
+
+  template <typename U, typename J>
+  friend class List;
+
+  /* Takes ownership of list. */
+  void AppendRow(tableau_index_t row, List<T, I>* list) {
+    DropColumnPanels();
+    if (row_csr_ != nullptr) {
+      row_csr_->Assign(row, list);
+    } else if (storage_format_ == ROW_ONLY or
+               storage_format_ == ROW_AND_COLUMN) {
+      list = Adopt(list);
+      if (row_heads_[row] != list) DeleteList(row_heads_[row]);
+      row_heads_[row] = list;
+    }
     if (storage_format_ == COLUMN_ONLY or storage_format_ == ROW_AND_COLUMN) {
+      for (auto element : *list) {
+        VisitCol(element.index, [&](List<T, I>* col) {
+          col->Append(row, element.value);
+        });
+      }
+    }
+    if (row_csr_ != nullptr) delete list;
+    MaybeRepack();
+  }
+  /* Takes ownership of list. */
+  void AppendCol(tableau_index_t col, List<T, I>* list) {
+    DropColumnPanels();
+    if (col_csr_ != nullptr) {
+      col_csr_->Assign(col, list);
+    } else if (storage_format_ == COLUMN_ONLY or
+               storage_format_ == ROW_AND_COLUMN) {
+      list = Adopt(list);
+      if (col_heads_[col] != list) DeleteList(col_heads_[col]);
       col_heads_[col] = list;
     }
     if (storage_format_ == ROW_ONLY or storage_format_ == ROW_AND_COLUMN) {
-      for (auto iter = list->Begin(); iter->IsEnd() == false;
-           iter = iter->Next()) {
-        Row(iter->Index())->Append(col, iter->Data());
+      for (auto element : *list) {
+        VisitRow(element.index, [&](List<T, I>* row) {
+          row->Append(col, element.value);
+        });
       }
     }
+    if (col_csr_ != nullptr) delete list;
+    MaybeRepack();
   }
 
-  void AppendExtraCol(List<T>* list) {
+  /* Takes ownership of list. */
+  void AppendExtraCol(List<T, I>* list) {
+    DropColumnPanels();
     columns_ += 1;
-    if (storage_format_ == COLUMN_ONLY or storage_format_ == ROW_AND_COLUMN) {
-      List<T>** new_col_heads = new List<T>*[columns_];
+    if (col_csr_ != nullptr) {
+      // The column RemoveExtraCol left behind is reused.
+      if (col_csr_->Count() < columns_)
+        col_csr_->Append(list);
+      else
+        col_csr_->Assign(columns_ - 1, list);
+    } else if (storage_format_ == COLUMN_ONLY or
+               storage_format_ == ROW_AND_COLUMN) {
+      list = Adopt(list);
+      List<T, I>** new_col_heads = new List<T, I>*[columns_];
       for (auto i = 0; i < columns_ - 1; i++) new_col_heads[i] = col_heads_[i];
       new_col_heads[columns_ - 1] = list;
-      delete col_heads_;
+      delete[] col_heads_;
       col_heads_ = new_col_heads;
     }
     if (storage_format_ == ROW_ONLY or storage_format_ == ROW_AND_COLUMN) {
-      for (auto iter = list->Begin(); iter->IsEnd() == false;
-           iter = iter->Next()) {
-        Row(iter->Index())->Append(columns_ - 1, iter->Data());
+      for (auto element : *list) {
+        VisitRow(element.index, [&](List<T, I>* row) {
+          row->Append(columns_ - 1, element.value);
+        });
       }
     }
+    if (col_csr_ != nullptr) delete list;
+    MaybeRepack();
   }
   void RemoveExtraCol() {
+    DropColumnPanels();
     columns_ -= 1;
     if (storage_format_ == ROW_ONLY or storage_format_ == ROW_AND_COLUMN) {
-      auto last_col = col_heads_[columns_];
-      for (auto iter = last_col->Begin(); iter->IsEnd() == false;
-           iter = iter->Next()) {
-        Row(iter->Index())->Pop(columns_);
+      ReadCol(columns_, [&](const List<T, I>* last_col) {
+        for (auto element : *last_col) {
+          VisitRow(element.index,
+                   [&](List<T, I>* row) { row->Pop(columns_); });
+        }
+      });
+    }
+  }
+  /**
+   * scale^T * this as a DENSE list. With rows the scaled rows are summed,
+   * split between threads by their nonzeros into per thread partial sums;
+   * with columns each column is dotted with scale. A ROW_AND_COLUMN tableau
+   * takes whichever is cheaper, counting a scattered element of a row as
+   * kScatterCost gathered ones.
+   *
+   * If the rows have fewer than columns_ / kSpaCost nonzeros in all, they
+   * are summed in a sparse accumulator instead and the result is SPARSE, so
+   * a handful of rows costs nothing per column.
+   */
+  List<T, I>* SumScaledRows(const List<T, I>* scale) const {
+    static constexpr tableau_size_t kScatterCost = 3;
+    static constexpr tableau_size_t kSpaCost = 16;
+    if (StorageFormat() == COLUMN_ONLY) return SumScaledCols(scale);
+    // Visiting every column costs at least columns_, which a few short rows
+    // stay under.
+    tableau_size_t row_work = 0, rows_read = 0, rows_in_scale = 0;
+    for (auto element : *scale) {
+      if (_IsZeroT(element.value)) continue;
+      rows_in_scale++;
+      if (row_work * kScatterCost > columns_) {
+        if (StorageFormat() == ROW_ONLY) break;
+        continue;
       }
+      row_work += RowSize(element.index) + 1;
+      rows_read++;
     }
+    if (row_work * kSpaCost <= columns_) return SumScaledRowsSparse(scale);
+    if (StorageFormat() == ROW_AND_COLUMN and
+        row_work * kScatterCost > columns_) {
+      // Reading the size of every row costs about as much as adding it, so
+      // the other rows, and those not in scale, are taken to be like the
+      // ones read. Scattering scale into a dense copy costs rows_.
+      double row_size = double(row_work) / rows_read;
+      double col_work = (row_size - 1) * rows_ + columns_ +
+                        (scale->StorageFormat() == DENSE ? 0 : rows_);
+      if (row_size * rows_in_scale * kScatterCost > col_work)
+        return SumScaledCols(scale);
+    }
+    return SumScaledRowsOf(scale);
   }
-  List<T>* SumScaledRows(List<T>* scale) {
-    List<T>* ret = new List<T>(columns_, DENSE);
-    if (StorageFormat() == ROW_ONLY or StorageFormat() == ROW_AND_COLUMN) {
-      for (auto iter = scale->Begin(); !iter->IsEnd(); iter = iter->Next())
-        ret->AddScaled(Row(iter->Index()), iter->Data(), true);
+  /**
+   * Rows are split between threads by their nonzeros plus one, as a merge
+   * path would, so a few long rows do not leave the other threads idle.
+   */
+  List<T, I>* Times(List<T, I>* x) {
+    assert_msg(StorageFormat() == ROW_ONLY or StorageFormat() == ROW_AND_COLUMN,
+               "Scale List must be in Dense format");
+    if (x->StorageFormat() != DENSE) {
+      // Every row gathers from x, which is cheapest from a dense copy.
+      List<T, I> dense_x(columns_, DENSE);
+      dense_x.AddScaled(x, 1, false);
+      return Times(&dense_x);
+    }
+    assert(Cols() == x->Size());
+    List<T, I>* ret = new List<T, I>(rows_, DENSE);
+    if (panels_ != nullptr) {
+      panels_->Times(x->data_, ret->data_);
       return ret;
-    } else {
-#pragma omp parallel
-      for (tableau_index_t col = 0; col < columns_; col++)
-        ret->Set(col, scale->Dot(Col(col)));
+    }
+    auto times_row = [&](tableau_index_t row) {
+      if (row_csr_ != nullptr) {
+        ret->data_[row] = row_csr_->DenseDot(row, x);
+        return;
+      }
+      ReadRow(row, [&](const List<T, I>* list) {
+        ret->data_[row] = list->Dot(x);
+      });
+    };
+    if (omp_get_max_threads() == 1) {
+      for (tableau_index_t row = 0; row < rows_; row++) times_row(row);
       return ret;
     }
+    std::vector<tableau_size_t> work_end = WorkEnd(true);
+#pragma omp parallel
+    ForEachInWorkShare(work_end, times_row);
+    return ret;
   }
-  List<T>* Times(List<T>* x) {
+
+  /**
+   * Times for k vectors in one pass over the tableau. x holds them row-major,
+   * Cols() rows of k values, and y receives the k products the same way in
+   * Rows() rows of k.
+   */
+  void Times(const T* x, tableau_size_t k, T* y) const {
     assert_msg(StorageFormat() == ROW_ONLY or StorageFormat() == ROW_AND_COLUMN,
-               "Scale List must be in Dense format");
-    if (x->StorageFormat() == DENSE) assert(Cols() == x->Size());
-    List<T>* ret = new List<T>(rows_, DENSE);
+               "Times needs the rows of the tableau");
+    auto times_row = [&](tableau_index_t row) {
+      ReadRow(row, [&](const List<T, I>* list) {
+        BlockDot(list, x, k, y + row * k);
+      });
+    };
+    if (omp_get_max_threads() == 1) {
+      for (tableau_index_t row = 0; row < rows_; row++) times_row(row);
+      return;
+    }
+    std::vector<tableau_size_t> work_end = WorkEnd(true);
 #pragma omp parallel
-    for (tableau_index_t row = 0; row < rows_; row++)
-      ret->Set(row, Row(row)->Dot(x));
-    return ret;
+    ForEachInWorkShare(work_end, times_row);
+  }
+  /* Times of every list of xs, as DENSE lists. */
+  std::vector<List<T, I>*> Times(const std::vector<List<T, I>*>& xs) const {
+    std::vector<T> x = ToBlock(xs, columns_);
+    std::vector<T> y(rows_ * xs.size());
+    Times(x.data(), xs.size(), y.data());
+    return FromBlock(y, rows_, xs.size());
   }
 
+  /**
+   * SumScaledRows for k scales in one pass over the tableau. scale holds them
+   * row-major, Rows() rows of k values, and y receives the k sums the same
+   * way in Cols() rows of k. Columns are dotted with the block if there are
+   * any, otherwise the rows are added into per thread blocks.
+   */
+  void SumScaledRows(const T* scale, tableau_size_t k, T* y) const {
+    if (StorageFormat() != ROW_ONLY) {
+      auto dot_col = [&](tableau_index_t col) {
+        ReadCol(col, [&](const List<T, I>* list) {
+          BlockDot(list, scale, k, y + col * k);
+        });
+      };
+      if (omp_get_max_threads() == 1) {
+        for (tableau_index_t col = 0; col < columns_; col++) dot_col(col);
+        return;
+      }
+      std::vector<tableau_size_t> work_end = WorkEnd(false);
+#pragma omp parallel
+      ForEachInWorkShare(work_end, dot_col);
+      return;
+    }
+    std::fill(y, y + columns_ * k, T(0));
+    auto add_row = [&](T* sum, tableau_index_t row) {
+      const T* row_scale = scale + row * k;
+      if (std::all_of(row_scale, row_scale + k,
+                      [](T value) { return _IsZeroT(value); }))
+        return;
+      ReadRow(row, [&](const List<T, I>* list) {
+        BlockAddScaled(list, row_scale, k, sum);
+      });
+    };
+    tableau_size_t threads = 1;
+    std::vector<tableau_size_t> work_end;
+    if (omp_get_max_threads() > 1) {
+      work_end = WorkEnd(true);
+      threads = std::min<tableau_size_t>(
+          omp_get_max_threads(),
+          work_end.back() / std::max<tableau_size_t>(columns_, 1));
+    }
+    if (threads <= 1) {
+      for (tableau_index_t row = 0; row < rows_; row++) add_row(y, row);
+      return;
+    }
+    std::vector<std::vector<T>> partial(threads);
+    std::vector<T*> sums(threads, y);
+#pragma omp parallel num_threads(threads)
+    {
+      tableau_size_t thread = omp_get_thread_num();
+      if (thread > 0) {
+        partial[thread].assign(columns_ * k, T(0));
+        sums[thread] = partial[thread].data();
+      }
+      ForEachInWorkShare(work_end, [&](tableau_index_t row) {
+        add_row(sums[thread], row);
+      });
+      AddPartialSums(sums, columns_ * k);
+    }
+  }
+  /* SumScaledRows of every list of scales, as DENSE lists. */
+  std::vector<List<T, I>*> SumScaledRows(
+      const std::vector<List<T, I>*>& scales) const {
+    std::vector<T> scale = ToBlock(scales, rows_);
+    std::vector<T> y(columns_ * scales.size());
+    SumScaledRows(scale.data(), scales.size(), y.data());
+    return FromBlock(y, columns_, scales.size());
+  }
+
+  /**
+   * Keeps a copy of the rows split into column panels for Times with a DENSE
+   * x, which then gathers from one panel of x at a time. By default a panel
+   * of x takes half the last level cache. The copy is dropped by every change
+   * made through the tableau and by the non-const Row() and Col(), so a List
+   * they handed out before must not be changed after the panels are built.
+   */
+  void BuildColumnPanels(tableau_size_t panel_columns = 0) {
+    assert_msg(StorageFormat() == ROW_ONLY or StorageFormat() == ROW_AND_COLUMN,
+               "Column panels are built from the rows of the tableau");
+    if (panel_columns <= 0)
+      panel_columns = LastLevelCacheBytes() / 2 / sizeof(T);
+    DropColumnPanels();
+    panels_ = new ColumnPanels<T, I>(
+        rows_, columns_, panel_columns,
+        [&](tableau_index_t row, auto visit) { ReadRow(row, visit); });
+  }
+  void DropColumnPanels() {
+    if (panels_ == nullptr) return;
+    delete panels_;
+    panels_ = nullptr;
+  }
+  bool HasColumnPanels() const { return panels_ != nullptr; }
+
   tableau_size_t Rows() const { return rows_; }
   tableau_size_t Cols() const { return columns_; }
   TableauStorageFormat StorageFormat() const { return storage_format_; }
 
  private:
-  void SetRow(tableau_index_t row, List<T>* list) {
+  void SetRow(tableau_index_t row, List<T, I>* list) {
+    DropColumnPanels();
     if (storage_format_ == COLUMN_ONLY) {
       throw std::runtime_error(
           "Cannot call SetRow for tableau in column only storage format");
     }
-    delete row_heads_[row];
-    row_heads_[row] = list;
+    if (row_csr_ != nullptr) {
+      row_csr_->Assign(row, list);
+      delete list;
+      return;
+    }
+    DeleteList(row_heads_[row]);
+    row_heads_[row] = Adopt(list);
   }
-  void SetCol(tableau_index_t col, List<T>* list) {
+  void SetCol(tableau_index_t col, List<T, I>* list) {
+    DropColumnPanels();
     if (storage_format_ == ROW_ONLY) {
       throw std::runtime_error(
           "Cannot call SetCol for tableau in row only storage format");
     }
-    delete col_heads_[col];
-    col_heads_[col] = list;
+    if (col_csr_ != nullptr) {
+      col_csr_->Assign(col, list);
+      delete list;
+      return;
+    }
+    DeleteList(col_heads_[col]);
+    col_heads_[col] = Adopt(list);
   }
-  tableau_size_t rows_, columns_;
-  List<T>** row_heads_;
-  List<T>** col_heads_;
+
+  /**
+   * Calls visit(List<T, I>*) with the row. Unlike Row(), a row of a
+   * CSR_ALLOCATION tableau is lent on the stack, without creating a List.
+   */
+  template <typename Visitor>
+  void VisitRow(tableau_index_t row, Visitor visit) {
+    if (row_csr_ != nullptr)
+      row_csr_->Visit(row, visit);
+    else
+      visit(RowHead(row));
+  }
+  template <typename Visitor>
+  void VisitCol(tableau_index_t col, Visitor visit) {
+    if (col_csr_ != nullptr)
+      col_csr_->Visit(col, visit);
+    else
+      visit(ColHead(col));
+  }
+  /* The List of a row or column, created on first use, for the writers. */
+  List<T, I>* RowHead(tableau_index_t row) {
+    CheckRows();
+    if (row_csr_ != nullptr) return row_csr_->View(row);
+    if (row_heads_[row] == nullptr) row_heads_[row] = NewHead(columns_);
+    return row_heads_[row];
+  }
+  List<T, I>* ColHead(tableau_index_t col) {
+    CheckCols();
+    if (col_csr_ != nullptr) return col_csr_->View(col);
+    if (col_heads_[col] == nullptr) col_heads_[col] = NewHead(rows_);
+    return col_heads_[col];
+  }
+  void CheckRows() const {
+    if (storage_format_ == COLUMN_ONLY) {
+      throw std::runtime_error(
+          "Cannot get row of tableau in column only storage format");
+    }
+  }
+  void CheckCols() const {
+    if (storage_format_ == ROW_ONLY) {
+      throw std::runtime_error(
+          "Cannot get column of tableau in row only storage format");
+    }
+  }
+  /**
+   * Calls visit(index, value) for the nonzeros of a row or column in
+   * increasing index order. One that is not stored is gathered from the other
+   * orientation, a lookup in every column or row.
+   */
+  template <typename Visitor>
+  void ReadSparseLine(bool is_row, tableau_index_t index, Visitor visit) const {
+    auto visit_nonzeros = [&](const List<T, I>* list) {
+      list->ForEach([&](tableau_index_t i, T value) {
+        if (not _IsZeroT(value)) visit(i, value);
+      });
+    };
+    if (is_row and storage_format_ != COLUMN_ONLY) {
+      ReadRow(index, visit_nonzeros);
+    } else if (not is_row and storage_format_ != ROW_ONLY) {
+      ReadCol(index, visit_nonzeros);
+    } else {
+      tableau_size_t length = is_row ? columns_ : rows_;
+      std::vector<T> line(length);
+#pragma omp parallel for
+      for (tableau_index_t i = 0; i < length; i++) {
+        auto lookup = [&](const List<T, I>* list) {
+          line[i] = list->At(index);
+        };
+        if (is_row)
+          ReadCol(i, lookup);
+        else
+          ReadRow(i, lookup);
+      }
+      for (tableau_index_t i = 0; i < length; i++)
+        if (not _IsZeroT(line[i])) visit(i, line[i]);
+    }
+  }
+  /**
+   * Called by every thread of a parallel region, calls visit(k) for the items
+   * k whose running work total work_end[k] ends in the calling thread's equal
+   * share of work_end.back().
+   */
+  template <typename Visitor>
+  static void ForEachInWorkShare(const std::vector<tableau_size_t>& work_end,
+                                 Visitor visit) {
+    auto share =
+        WorkShare(work_end, omp_get_thread_num(), omp_get_num_threads());
+    for (tableau_index_t k = share.first; k < share.second; k++) visit(k);
+  }
+  tableau_size_t RowSize(tableau_index_t row) const {
+    if (row_csr_ != nullptr) return row_csr_->Size(row);
+    tableau_size_t size = 0;
+    ReadRow(row, [&](const List<T, I>* list) { size = list->Size(); });
+    return size;
+  }
+  tableau_size_t ColSize(tableau_index_t col) const {
+    if (col_csr_ != nullptr) return col_csr_->Size(col);
+    tableau_size_t size = 0;
+    ReadCol(col, [&](const List<T, I>* list) { size = list->Size(); });
+    return size;
+  }
+  /**
+   * Sums the rows scaled by scale. Each thread sums its share of the
+   * nonzeros into its own dense list, with only as many threads as there are
+   * columns' worth of nonzeros, and the partial sums are added up pairwise in
+   * a tree.
+   */
+  List<T, I>* SumScaledRowsOf(const List<T, I>* scale) const {
+    List<T, I>* ret = new List<T, I>(columns_, DENSE);
+    auto add_row = [&](List<T, I>* sum,
+                       const typename List<T, I>::Element& element) {
+      if (row_csr_ != nullptr) {
+        row_csr_->AddScaledToDense(element.index, element.value, sum);
+        return;
+      }
+      ReadRow(element.index, [&](const List<T, I>* row) {
+        sum->AddScaled(row, element.value, true);
+      });
+    };
+    if (omp_get_max_threads() == 1) {
+      for (auto element : *scale)
+        if (not _IsZeroT(element.value)) add_row(ret, element);
+      return ret;
+    }
+    std::vector<typename List<T, I>::Element> elements;
+    std::vector<tableau_size_t> work_end;
+    tableau_size_t work = 0;
+    for (auto element : *scale) {
+      if (_IsZeroT(element.value)) continue;
+      elements.push_back(element);
+      work_end.push_back(work += RowSize(element.index) + 1);
+    }
+    tableau_size_t threads = std::min<tableau_size_t>(
+        omp_get_max_threads(), work / std::max<tableau_size_t>(columns_, 1));
+    if (threads <= 1) {
+      for (auto& element : elements) add_row(ret, element);
+      return ret;
+    }
+    std::vector<List<T, I>*> partial(threads, ret);
+    std::vector<T*> sums(threads);
+#pragma omp parallel num_threads(threads)
+    {
+      tableau_size_t thread = omp_get_thread_num();
+      if (thread > 0) partial[thread] = new List<T, I>(columns_, DENSE);
+      sums[thread] = partial[thread]->data_;
+      ForEachInWorkShare(work_end, [&](tableau_index_t k) {
+        add_row(partial[thread], elements[k]);
+      });
+      AddPartialSums(sums, columns_);
+    }
+    for (size_t thread = 1; thread < partial.size(); thread++)
+      if (partial[thread] != ret) delete partial[thread];
+    return ret;
+  }
+  /**
+   * Sums the rows scaled by scale into spa_, which is kept zero between
+   * calls, and hands out the columns they touched as a SPARSE list. Readers
+   * may run concurrently, so a call that finds spa_ in use sums into a
+   * workspace of its own.
+   */
+  List<T, I>* SumScaledRowsSparse(const List<T, I>* scale) const {
+    if (spa_busy_.exchange(true, std::memory_order_acquire)) {
+      std::vector<T> spa;
+      std::vector<I> touched;
+      return SumScaledRowsSparse(scale, &spa, &touched);
+    }
+    List<T, I>* ret = SumScaledRowsSparse(scale, &spa_, &spa_touched_);
+    spa_busy_.store(false, std::memory_order_release);
+    return ret;
+  }
+  List<T, I>* SumScaledRowsSparse(const List<T, I>* scale, std::vector<T>* spa,
+                                  std::vector<I>* touched) const {
+    if (spa->size() < size_t(columns_)) spa->resize(columns_);
+    touched->clear();
+    for (auto element : *scale) {
+      if (_IsZeroT(element.value)) continue;
+      auto add = [&](tableau_index_t col, T value) {
+        // A sum that cancelled to zero is touched again, unique drops it.
+        if ((*spa)[col] == T(0)) touched->push_back(col);
+        (*spa)[col] += element.value * value;
+      };
+      ReadRow(element.index,
+              [&](const List<T, I>* row) { row->ForEach(add); });
+    }
+    std::sort(touched->begin(), touched->end());
+    touched->erase(std::unique(touched->begin(), touched->end()),
+                   touched->end());
+    List<T, I>* ret = new List<T, I>(touched->size());
+    for (I col : *touched) {
+      if (not _IsZeroT((*spa)[col])) ret->Append(col, (*spa)[col]);
+      (*spa)[col] = 0;
+    }
+    return ret;
+  }
+  /* scale^T * this from the columns, split between threads by nonzeros. */
+  List<T, I>* SumScaledCols(const List<T, I>* scale) const {
+    if (scale->StorageFormat() != DENSE) {
+      // Every column gathers from scale, which is cheapest from a dense copy.
+      List<T, I> dense_scale(rows_, DENSE);
+      dense_scale.AddScaled(scale, 1, false);
+      return SumScaledCols(&dense_scale);
+    }
+    assert(scale->Size() == rows_);
+    List<T, I>* ret = new List<T, I>(columns_, DENSE);
+    auto dot_col = [&](tableau_index_t col) {
+      if (col_csr_ != nullptr) {
+        ret->data_[col] = col_csr_->DenseDot(col, scale);
+        return;
+      }
+      ReadCol(col, [&](const List<T, I>* list) {
+        ret->data_[col] = list->Dot(scale);
+      });
+    };
+    if (omp_get_max_threads() == 1) {
+      for (tableau_index_t col = 0; col < columns_; col++) dot_col(col);
+      return ret;
+    }
+    std::vector<tableau_size_t> work_end = WorkEnd(false);
+#pragma omp parallel
+    ForEachInWorkShare(work_end, dot_col);
+    return ret;
+  }
+  /**
+   * Called by every thread of a parallel region of at most sums.size()
+   * threads, adds the team's partial sums of length values pairwise in a
+   * tree into sums[0].
+   */
+  static void AddPartialSums(const std::vector<T*>& sums,
+                             tableau_size_t length) {
+    tableau_size_t thread = omp_get_thread_num();
+    tableau_size_t team = omp_get_num_threads();
+    for (tableau_size_t stride = 1; stride < team; stride *= 2) {
+#pragma omp barrier
+      if (thread % (2 * stride) == 0 and thread + stride < team)
+        DenseAxpy(sums[thread], sums[thread + stride], T(1), length);
+    }
+  }
+  /* Running sizes plus one of the rows, or the columns. */
+  std::vector<tableau_size_t> WorkEnd(bool is_row) const {
+    tableau_size_t count = is_row ? rows_ : columns_;
+    std::vector<tableau_size_t> work_end(count);
+    tableau_size_t work = 0;
+    for (tableau_index_t i = 0; i < count; i++)
+      work_end[i] = work += (is_row ? RowSize(i) : ColSize(i)) + 1;
+    return work_end;
+  }
+  /* out[j] = list . x_j for the k vectors of the row-major block x. */
+  static void BlockDot(const List<T, I>* list, const T* x, tableau_size_t k,
+                       T* out) {
+    if (list->StorageFormat() == SPARSE) {
+      BlockGatherDot(list->data_, list->index_, list->Size(), x, k, out);
+      return;
+    }
+    std::fill(out, out + k, T(0));
+    list->ForEach([&](tableau_index_t index, T value) {
+      for (tableau_index_t j = 0; j < k; j++)
+        out[j] += value * x[index * k + j];
+    });
+  }
+  /* block_j += scale[j] * list for the k vectors of the row-major block. */
+  static void BlockAddScaled(const List<T, I>* list, const T* scale,
+                             tableau_size_t k, T* block) {
+    if (list->StorageFormat() == SPARSE) {
+      BlockScatterAxpy(block, list->index_, list->data_, scale, list->Size(),
+                       k);
+      return;
+    }
+    list->ForEach([&](tableau_index_t index, T value) {
+      for (tableau_index_t j = 0; j < k; j++)
+        block[index * k + j] += value * scale[j];
+    });
+  }
+  /* The lists as the k vectors of a row-major block of length rows. */
+  static std::vector<T> ToBlock(const std::vector<List<T, I>*>& lists,
+                                tableau_size_t length) {
+    tableau_size_t k = lists.size();
+    std::vector<T> block(length * k);
+    for (tableau_index_t j = 0; j < k; j++) {
+      lists[j]->ForEach([&](tableau_index_t index, T value) {
+        assert(index < length);
+        block[index * k + j] = value;
+      });
+    }
+    return block;
+  }
+  /* The k vectors of a row-major block of length rows as DENSE lists. */
+  static std::vector<List<T, I>*> FromBlock(const std::vector<T>& block,
+                                            tableau_size_t length,
+                                            tableau_size_t k) {
+    std::vector<List<T, I>*> lists(k);
+    for (tableau_index_t j = 0; j < k; j++) {
+      lists[j] = new List<T, I>(length, DENSE);
+      for (tableau_index_t i = 0; i < length; i++)
+        lists[j]->data_[i] = block[i * k + j];
+    }
+    return lists;
+  }
+  /* Stands in for the rows and columns that were never written. */
+  static const List<T, I>* EmptyList() {
+    // Never destroyed, like HeapAllocator::Instance().
+    static const List<T, I>* empty = new List<T, I>();
+    return empty;
+  }
+  /* A row or column of length length in the initial format. */
+  List<T, I>* NewHead(tableau_size_t length) const {
+    return list_format_ == SPARSE ? NewList() : NewList(length, list_format_);
+  }
+  void MaybeRepack() {
+    if (row_csr_ != nullptr) row_csr_->MaybeRepack();
+    if (col_csr_ != nullptr) col_csr_->MaybeRepack();
+  }
+
+  void DeleteList(List<T, I>* list) {
+    if (arena_ == nullptr) {
+      delete list;
+      return;
+    }
+    if (list == nullptr) return;
+    list->~List();
+    arena_->Deallocate(list, sizeof(List<T, I>));
+  }
+  /* Row or column index += scale * other, work counted in elements. */
+  struct RankOneTarget {
+    bool is_row;
+    tableau_index_t index;
+    const List<T, I>* other;
+    T scale;
+    tableau_size_t work;
+  };
+  void AddRankOneTargets(bool is_row, const List<T, I>* coefficients,
+                         const List<T, I>* list, T scale,
+                         std::vector<RankOneTarget>* targets) const {
+    bool is_sparse = coefficients->StorageFormat() == SPARSE;
+    for (tableau_index_t i = 0; i < coefficients->Size(); i++) {
+      T coefficient = coefficients->data_[i];
+      if (_IsZeroT(coefficient)) continue;
+      tableau_index_t index = is_sparse ? coefficients->index_[i] : i;
+      assert(index < (is_row ? rows_ : columns_));
+      tableau_size_t size = is_row ? RowSize(index) : ColSize(index);
+      targets->push_back(
+          {is_row, index, list, scale * coefficient, size + list->Size()});
+    }
+  }
+  /* Heap lists handed over by the caller are copied into the arena, if any. */
+  List<T, I>* Adopt(List<T, I>* list) {
+    if (arena_ == nullptr or list->Allocator() == arena_) return list;
+    List<T, I>* adopted =
+        new (arena_->Allocate(sizeof(List<T, I>))) List<T, I>(list, arena_);
+    delete list;
+    return adopted;
+  }
+
+  // Updates of fewer elements run on the calling thread, since starting a
+  // parallel region costs more than they do.
+  static constexpr tableau_size_t kParallelWork = 4096;
+
+  tableau_size_t rows_ = 0, columns_ = 0;
+  List<T, I>** row_heads_ = nullptr;
+  List<T, I>** col_heads_ = nullptr;
+  CsrStorage<T, I>* row_csr_ = nullptr;
+  CsrStorage<T, I>* col_csr_ = nullptr;
+  ArenaAllocator* arena_ = nullptr;
   TableauStorageFormat storage_format_ = ROW_AND_COLUMN;
+  ListStorageFormat list_format_ = SPARSE;
+  ColumnPanels<T, I>* panels_ = nullptr;
+  // The workspace of SumScaledRowsSparse, claimed through spa_busy_.
+  mutable std::vector<T> spa_;
+  mutable std::vector<I> spa_touched_;
+  mutable std::atomic<bool> spa_busy_{false};
 };
 
-template <typename T>
-Tableau<T>* List<T>::Cross(const List<T>* other, tableau_size_t rows,
+template <typename T, typename I>
+Tableau<T, I>* List<T, I>::Cross(const List<T, I>* other, tableau_size_t rows,
                            tableau_size_t cols,
                            TableauStorageFormat format) const {
-  Tableau<T>* tableau = new Tableau<T>(rows, cols, format);
+  if (StorageFormat() == BITMAP or other->StorageFormat() == BITMAP) {
+    List<T, I> left(this), right(other);
+    if (left.StorageFormat() == BITMAP) left.ConvertTo(SPARSE);
+    if (right.StorageFormat() == BITMAP) right.ConvertTo(SPARSE);
+    return left.Cross(&right, rows, cols, format);
+  }
+  Tableau<T, I>* tableau = new Tableau<T, I>(rows, cols, format);
+  // As in SparseCross, the rows share the index of a private copy of other
+  // and the columns that of a copy of this, so the index of neither is
+  // handed out. The heap tableau is fresh and every index distinct, so the
+  // lists go straight into their heads, where SetRow and SetCol would write
+  // the tableau from every thread.
   if (format == ROW_ONLY or format == ROW_AND_COLUMN) {
+    List<T, I> shared(other);
 #pragma omp parallel for
     for (tableau_index_t i = 0; i < Size(); i++) {
-      List<T>* row = new List<T>(other);
-      tableau_index_t index = index_[i];
-      T scale = data_[i];
-      row->Scale(scale);
-      tableau->SetRow(index, row);
+      List<T, I>* row = new List<T, I>(&shared, nullptr, SHARE_INDEX);
+      row->Scale(data_[i]);
+      tableau->row_heads_[index_[i]] = row;
     }
   }
   if (format == COLUMN_ONLY or format == ROW_AND_COLUMN) {
+    List<T, I> shared(this);
 #pragma omp parallel for
     for (tableau_index_t i = 0; i < other->Size(); i++) {
-      List<T>* col = new List<T>(this);
-      tableau_index_t index = other->index_[i];
-      T scale = other->data_[i];
-      col->Scale(scale);
-      tableau->SetCol(index, col);
+      List<T, I>* col = new List<T, I>(&shared, nullptr, SHARE_INDEX);
+      col->Scale(other->data_[i]);
+      tableau->col_heads_[other->index_[i]] = col;
     }
   }
   return tableau;
 }
 
-template <typename T>
+template <typename T, typename I>
 class SparseTableau {
  public:
   SparseTableau(tableau_size_t rows, tableau_size_t cols,
-                TableauStorageFormat format)
+                TableauStorageFormat format,
+                TableauAllocationPolicy allocation = HEAP_ALLOCATION)
       : storage_format_(format) {
+    if (allocation == ARENA_ALLOCATION) arena_ = new ArenaAllocator();
     if (storage_format_ == ROW_ONLY or storage_format_ == ROW_AND_COLUMN) {
       if (rows > 0) {
-        sparse_row_heads_ = new List<List<T>*>(rows);
+        sparse_row_heads_ = new List<List<T, I>*, I>(rows);
         sparse_row_heads_->size_ = rows;
       }
     }
     if (storage_format_ == COLUMN_ONLY or storage_format_ == ROW_AND_COLUMN) {
       if (cols > 0) {
-        sparse_col_heads_ = new List<List<T>*>(cols);
+        sparse_col_heads_ = new List<List<T, I>*, I>(cols);
         sparse_col_heads_->size_ = cols;
       }
     }
@@ -774,27 +2959,51 @@ class SparseTableau {
   ~SparseTableau() {
     if (storage_format_ == ROW_ONLY or storage_format_ == ROW_AND_COLUMN) {
       if (sparse_row_heads_ != nullptr) {
-        for (auto i = 0; i < sparse_row_heads_->Size(); i++) {
-          delete sparse_row_heads_->data_[i];
+        if (arena_ == nullptr) {
+          for (auto i = 0; i < sparse_row_heads_->Size(); i++) {
+            delete sparse_row_heads_->data_[i];
+          }
         }
         delete sparse_row_heads_;
       }
     }
     if (storage_format_ == COLUMN_ONLY or storage_format_ == ROW_AND_COLUMN) {
       if (sparse_col_heads_ != nullptr) {
-        for (auto i = 0; i < sparse_col_heads_->Size(); i++) {
-          delete sparse_col_heads_->data_[i];
+        if (arena_ == nullptr) {
+          for (auto i = 0; i < sparse_col_heads_->Size(); i++) {
+            delete sparse_col_heads_->data_[i];
+          }
         }
         delete sparse_col_heads_;
       }
     }
+    // Every list of an arena backed sparse tableau lives in the arena.
+    delete arena_;
   }
 
-  List<T>* Row(tableau_index_t row) const {
+  SparseTableau(const SparseTableau<T, I>&) = delete;
+  SparseTableau<T, I>& operator=(const SparseTableau<T, I>&) = delete;
+  SparseTableau(SparseTableau<T, I>&& other) noexcept { Swap(other); }
+  SparseTableau<T, I>& operator=(SparseTableau<T, I>&& other) noexcept {
+    if (this != &other) {
+      SparseTableau<T, I> moved(std::move(other));
+      Swap(moved);
+    }
+    return *this;
+  }
+
+  void Swap(SparseTableau<T, I>& other) noexcept {
+    std::swap(sparse_row_heads_, other.sparse_row_heads_);
+    std::swap(sparse_col_heads_, other.sparse_col_heads_);
+    std::swap(arena_, other.arena_);
+    std::swap(storage_format_, other.storage_format_);
+  }
+
+  List<T, I>* Row(tableau_index_t row) const {
     CheckFormat(COLUMN_ONLY, "Row");
     return sparse_row_heads_->data_[row];
   }
-  List<T>* Col(tableau_index_t col) const {
+  List<T, I>* Col(tableau_index_t col) const {
     CheckFormat(ROW_ONLY, "Col");
     return sparse_col_heads_->data_[col];
   }
@@ -818,18 +3027,33 @@ class SparseTableau {
 
   TableauStorageFormat StorageFormat() const { return storage_format_; }
 
-  template <typename U>
+  template <typename U, typename J>
   friend class List;
 
  private:
+  /* Copies other into a list owned by the allocator of this tableau. */
+  List<T, I>* CopyList(const List<T, I>* other,
+                       ListCopyPolicy policy = DEEP_COPY) {
+    if (arena_ == nullptr) return new List<T, I>(other, nullptr, policy);
+    return new (arena_->Allocate(sizeof(List<T, I>)))
+        List<T, I>(other, arena_, policy);
+  }
+  void DeleteList(List<T, I>* list) {
+    if (arena_ == nullptr) {
+      delete list;
+      return;
+    }
+    list->~List();
+    arena_->Deallocate(list, sizeof(List<T, I>));
+  }
   void SetRow(tableau_index_t row, tableau_index_t sparse_row_index,
-              List<T>* list) {
+              List<T, I>* list) {
     CheckFormat(COLUMN_ONLY, "SetRow");
     sparse_row_heads_->index_[row] = sparse_row_index;
     sparse_row_heads_->data_[row] = list;
   }
   void SetCol(tableau_index_t col, tableau_index_t sparse_col_index,
-              List<T>* list) {
+              List<T, I>* list) {
     CheckFormat(ROW_ONLY, "SetCol");
     sparse_col_heads_->index_[col] = sparse_col_index;
     sparse_col_heads_->data_[col] = list;
@@ -841,36 +3065,51 @@ class SparseTableau {
                method_name, storage_format_);
   }
 
-  List<List<T>*>* sparse_row_heads_ = nullptr;
-  List<List<T>*>* sparse_col_heads_ = nullptr;
+  List<List<T, I>*, I>* sparse_row_heads_ = nullptr;
+  List<List<T, I>*, I>* sparse_col_heads_ = nullptr;
+  ArenaAllocator* arena_ = nullptr;
   TableauStorageFormat storage_format_ = ROW_AND_COLUMN;
 };
 
-template <typename T>
-SparseTableau<T>* List<T>::SparseCross(const List<T>* other,
-                                       TableauStorageFormat format) const {
-  SparseTableau<T>* sparse_tableau =
-      new SparseTableau<T>(Size(), other->Size(), format);
+template <typename T, typename I>
+SparseTableau<T, I>* List<T, I>::SparseCross(
+    const List<T, I>* other, TableauStorageFormat format,
+    TableauAllocationPolicy allocation) const {
+  if (StorageFormat() == BITMAP or other->StorageFormat() == BITMAP) {
+    List<T, I> left(this), right(other);
+    if (left.StorageFormat() == BITMAP) left.ConvertTo(SPARSE);
+    if (right.StorageFormat() == BITMAP) right.ConvertTo(SPARSE);
+    return left.SparseCross(&right, format, allocation);
+  }
+  SparseTableau<T, I>* sparse_tableau =
+      new SparseTableau<T, I>(Size(), other->Size(), format, allocation);
+  // The rows are copies of other scaled by this and the columns the other
+  // way around, so all rows share the index of one copy of other, and all
+  // columns that of one copy of this.
   if (format == ROW_ONLY or format == ROW_AND_COLUMN) {
+    List<T, I>* shared = sparse_tableau->CopyList(other);
 #pragma omp parallel for
     for (tableau_index_t i = 0; i < Size(); i++) {
-      List<T>* row = new List<T>(other);
+      List<T, I>* row = sparse_tableau->CopyList(shared, SHARE_INDEX);
       tableau_index_t index = (StorageFormat() == SPARSE) ? index_[i] : i;
       T scale = data_[i];
       row->Scale(scale);
       sparse_tableau->SetRow(i, index, row);
     }
+    sparse_tableau->DeleteList(shared);
   }
   if (format == COLUMN_ONLY or format == ROW_AND_COLUMN) {
+    List<T, I>* shared = sparse_tableau->CopyList(this);
 #pragma omp parallel for
     for (tableau_index_t i = 0; i < other->Size(); i++) {
-      List<T>* col = new List<T>(this);
+      List<T, I>* col = sparse_tableau->CopyList(shared, SHARE_INDEX);
       tableau_index_t index =
-          (StorageFormat() == SPARSE) ? other->index_[i] : i;
+          (other->StorageFormat() == SPARSE) ? other->index_[i] : i;
       T scale = other->data_[i];
       col->Scale(scale);
       sparse_tableau->SetCol(i, index, col);
     }
+    sparse_tableau->DeleteList(shared);
   }
   return sparse_tableau;
 }
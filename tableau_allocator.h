@@ -0,0 +1,200 @@
+#pragma once
+
+#include <omp.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/**
+ * Source of the index and data buffers of a List. Buffers of
+ * kListBufferAlignment bytes or more, enough for the SIMD kernels to use,
+ * are aligned to it; smaller ones only as the system allocator aligns them.
+ * Deallocate must be called with the same byte count that was passed to
+ * Allocate.
+ */
+class ListAllocator {
+ public:
+  static constexpr size_t kListBufferAlignment = 64;
+
+  virtual ~ListAllocator() {}
+
+  virtual void* Allocate(size_t bytes) = 0;
+  virtual void Deallocate(void* ptr, size_t bytes) = 0;
+
+  /* Number of Allocate calls served. */
+  virtual int64_t Allocations() const = 0;
+  /* Number of calls this allocator made into the system allocator. */
+  virtual int64_t SystemAllocations() const = 0;
+
+  template <typename U>
+  U* AllocateArray(int64_t count) {
+    return static_cast<U*>(Allocate(sizeof(U) * count));
+  }
+  template <typename U>
+  void DeallocateArray(U* ptr, int64_t count) {
+    Deallocate(ptr, sizeof(U) * count);
+  }
+};
+
+/* Forwards every request to the system allocator. */
+class HeapAllocator : public ListAllocator {
+ public:
+  static HeapAllocator* Instance() {
+    // Never destroyed, so Lists with static storage duration stay valid.
+    static HeapAllocator* instance = new HeapAllocator();
+    return instance;
+  }
+
+  void* Allocate(size_t bytes) override {
+    if (bytes == 0) return nullptr;
+    allocations_.fetch_add(1, std::memory_order_relaxed);
+    // Rounding the many tiny buffers of short lists up to a cache line would
+    // cost several times their size.
+    if (bytes < kListBufferAlignment) return malloc(bytes);
+    bytes = (bytes + kListBufferAlignment - 1) & ~(kListBufferAlignment - 1);
+    return aligned_alloc(kListBufferAlignment, bytes);
+  }
+  void Deallocate(void* ptr, size_t) override { free(ptr); }
+
+  int64_t Allocations() const override {
+    return allocations_.load(std::memory_order_relaxed);
+  }
+  int64_t SystemAllocations() const override { return Allocations(); }
+
+ private:
+  std::atomic<int64_t> allocations_{0};
+};
+
+/**
+ * A region allocator with power-of-two size-class pools. Freed blocks go back
+ * to the pool of their size class and memory is only returned to the system
+ * when the arena is released or destroyed, all at once.
+ *
+ * Each thread of the outermost OpenMP team works on its own pool, so lists
+ * owned by one arena can be grown from inside `omp parallel for` loops.
+ * Callers outside of OpenMP that use one arena concurrently must synchronize
+ * externally.
+ */
+class ArenaAllocator : public ListAllocator {
+ public:
+  static constexpr size_t kDefaultChunkBytes = 1 << 20;
+
+  explicit ArenaAllocator(size_t chunk_bytes = kDefaultChunkBytes)
+      : chunk_bytes_(chunk_bytes), pools_(omp_get_max_threads()) {}
+  ~ArenaAllocator() { Release(); }
+
+  ArenaAllocator(const ArenaAllocator&) = delete;
+  ArenaAllocator& operator=(const ArenaAllocator&) = delete;
+
+  void* Allocate(size_t bytes) override {
+    if (bytes == 0) return nullptr;
+    int size_class = SizeClass(bytes);
+    if (Pool* pool = LocalPool()) return Allocate(pool, size_class);
+    std::lock_guard<std::mutex> lock(shared_mutex_);
+    return Allocate(&shared_pool_, size_class);
+  }
+  void Deallocate(void* ptr, size_t bytes) override {
+    if (ptr == nullptr) return;
+    int size_class = SizeClass(bytes);
+    if (Pool* pool = LocalPool()) return Deallocate(pool, ptr, size_class);
+    std::lock_guard<std::mutex> lock(shared_mutex_);
+    Deallocate(&shared_pool_, ptr, size_class);
+  }
+
+  /* Returns every chunk to the system. Outstanding buffers become invalid. */
+  void Release() {
+    for (auto& pool : pools_) Release(&pool);
+    Release(&shared_pool_);
+  }
+
+  int64_t Allocations() const override {
+    int64_t allocations = shared_pool_.allocations;
+    for (auto& pool : pools_) allocations += pool.allocations;
+    return allocations;
+  }
+  int64_t SystemAllocations() const override {
+    int64_t allocations = shared_pool_.system_allocations;
+    for (auto& pool : pools_) allocations += pool.system_allocations;
+    return allocations;
+  }
+
+ private:
+  static constexpr int kMinSizeClass = 4;
+  static constexpr int kNumSizeClasses = 64;
+
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+  struct alignas(64) Pool {
+    FreeBlock* free_lists[kNumSizeClasses] = {};
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    std::vector<void*> chunks;
+    int64_t allocations = 0;
+    int64_t system_allocations = 0;
+  };
+
+  static int SizeClass(size_t bytes) {
+    int size_class = kMinSizeClass;
+    while ((size_t(1) << size_class) < bytes) size_class++;
+    return size_class;
+  }
+
+  Pool* LocalPool() {
+    if (omp_get_level() > 1) return nullptr;
+    int thread = omp_get_thread_num();
+    if (thread >= static_cast<int>(pools_.size())) return nullptr;
+    return &pools_[thread];
+  }
+
+  void* Allocate(Pool* pool, int size_class) {
+    pool->allocations += 1;
+    if (FreeBlock* block = pool->free_lists[size_class]) {
+      pool->free_lists[size_class] = block->next;
+      return block;
+    }
+    size_t block_bytes = size_t(1) << size_class;
+    size_t alignment = std::min(block_bytes, kListBufferAlignment);
+    char* start = reinterpret_cast<char*>(
+        (reinterpret_cast<uintptr_t>(pool->cursor) + alignment - 1) &
+        ~(alignment - 1));
+    if (pool->cursor == nullptr or start + block_bytes > pool->limit) {
+      if (block_bytes * 4 > chunk_bytes_) {
+        // Large blocks get a chunk of their own instead of wasting the tail
+        // of the current one.
+        return NewChunk(pool, block_bytes);
+      }
+      start = static_cast<char*>(NewChunk(pool, chunk_bytes_));
+      pool->limit = start + chunk_bytes_;
+    }
+    pool->cursor = start + block_bytes;
+    return start;
+  }
+  void Deallocate(Pool* pool, void* ptr, int size_class) {
+    FreeBlock* block = static_cast<FreeBlock*>(ptr);
+    block->next = pool->free_lists[size_class];
+    pool->free_lists[size_class] = block;
+  }
+
+  void* NewChunk(Pool* pool, size_t bytes) {
+    void* chunk = aligned_alloc(kListBufferAlignment, bytes);
+    pool->chunks.push_back(chunk);
+    pool->system_allocations += 1;
+    return chunk;
+  }
+  void Release(Pool* pool) {
+    for (void* chunk : pool->chunks) free(chunk);
+    pool->chunks.clear();
+    std::fill(pool->free_lists, pool->free_lists + kNumSizeClasses, nullptr);
+    pool->cursor = pool->limit = nullptr;
+  }
+
+  size_t chunk_bytes_;
+  std::vector<Pool> pools_;
+  Pool shared_pool_;
+  std::mutex shared_mutex_;
+};
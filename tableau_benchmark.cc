@@ -1,6 +1,16 @@
 #include <benchmark/benchmark.h>
 
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
 #include "tableau.h"
+#include "tableau_compressed_list.h"
+#include "tableau_pricing.h"
+#include "tableau_ratio_test.h"
+#include "tableau_simplex.h"
+#include "tableau_triangular.h"
 
 typedef float T;
 
@@ -9,6 +19,38 @@ inline bool _IsZeroT(const T &x) {
   return x == 0;
 }
 
+template <>
+inline bool _IsZeroT(const double &x) {
+  return x == 0;
+}
+
+/* Reports the per-iteration allocation counts of allocator since the marks. */
+static void ReportAllocations(benchmark::State& state,
+                              const ListAllocator* allocator,
+                              int64_t allocations_mark,
+                              int64_t system_allocations_mark) {
+  state.counters["allocations"] =
+      benchmark::Counter(allocator->Allocations() - allocations_mark,
+                         benchmark::Counter::kAvgIterations);
+  state.counters["system_allocations"] = benchmark::Counter(
+      allocator->SystemAllocations() - system_allocations_mark,
+      benchmark::Counter::kAvgIterations);
+}
+
+/*
+ * Reports the flops of a matrix vector product with nonzeros nonzeros and
+ * the bytes it has to move at least: the matrix, x and the result once.
+ */
+static void ReportSpmv(benchmark::State& state, tableau_size_t rows,
+                       tableau_size_t cols, tableau_size_t nonzeros) {
+  state.counters["flops"] = benchmark::Counter(
+      2 * nonzeros, benchmark::Counter::kIsIterationInvariantRate);
+  state.SetBytesProcessed(
+      state.iterations() *
+      (nonzeros * (sizeof(T) + sizeof(tableau_index_t)) +
+       (rows + cols) * sizeof(T)));
+}
+
 static void CustomArguments(benchmark::internal::Benchmark* b) {
   for (tableau_size_t sparse_element_size = 1; sparse_element_size <= 1000;
        sparse_element_size = sparse_element_size * 10)
@@ -56,29 +98,86 @@ static void List_Add(benchmark::State& state) {
     list1->Append(i * 2, i);
     list2->Append(i * 2 + 1, i);
   }
+  ListAllocator* heap = HeapAllocator::Instance();
+  int64_t allocations = heap->Allocations();
+  int64_t system_allocations = heap->SystemAllocations();
   for (auto _ : state) {
     list1->Add(list2);
   }
+  ReportAllocations(state, heap, allocations, system_allocations);
   delete list1;
   delete list2;
 }
 BENCHMARK(List_Add);
 
-static void List_Mul(benchmark::State& state) {
+static void List_Add_Arena(benchmark::State& state) {
   tableau_size_t sparse_element_size = 2048;
-  List<T>* list1 = new List<T>(sparse_element_size);
-  List<T>* list2 = new List<T>(sparse_element_size);
+  ArenaAllocator arena;
+  List<T>* list1 = new List<T>(sparse_element_size, SPARSE, &arena);
+  List<T>* list2 = new List<T>(sparse_element_size, SPARSE, &arena);
   for (auto i = 0; i < sparse_element_size; i++) {
-    list1->Append(i, i);
-    list2->Append(sparse_element_size / 2 + i, i);
+    list1->Append(i * 2, i);
+    list2->Append(i * 2 + 1, i);
   }
+  int64_t allocations = arena.Allocations();
+  int64_t system_allocations = arena.SystemAllocations();
   for (auto _ : state) {
-    list1->Mul(list2);
+    list1->Add(list2);
+  }
+  ReportAllocations(state, &arena, allocations, system_allocations);
+  delete list1;
+  delete list2;
+}
+BENCHMARK(List_Add_Arena);
+
+/*
+ * Two lists of range(0) elements each, where about range(1) percent of the
+ * indices of list2 are also in list1 at random positions, and the
+ * intersection kernels are restricted to SimdLevel range(2).
+ */
+static void IntersectArguments(benchmark::internal::Benchmark* b) {
+  for (tableau_size_t length = 64; length <= 65536; length *= 16)
+    for (tableau_size_t overlap : {1, 10, 50, 90})
+      for (tableau_size_t level : {SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512})
+        b->Args({length, overlap, level});
+}
+
+static void FillIntersectLists(benchmark::State& state, List<T>* list1,
+                               List<T>* list2) {
+  std::mt19937 rng(0);
+  for (auto i = 0; i < state.range(0); i++) {
+    list1->Append(2 * i, i);
+    bool hit = static_cast<tableau_size_t>(rng() % 100) < state.range(1);
+    list2->Append(hit ? 2 * i : 2 * i + 1, i);
   }
+}
+
+static void List_Mul(benchmark::State& state) {
+  List<T>* list1 = new List<T>(state.range(0));
+  List<T>* list2 = new List<T>(state.range(0));
+  FillIntersectLists(state, list1, list2);
+  SimdLevel level = GetSimdLevel();
+  SetSimdLevel(static_cast<SimdLevel>(state.range(2)));
+  state.counters["simd_level"] = GetSimdLevel();
+  ListAllocator* heap = HeapAllocator::Instance();
+  int64_t allocations = heap->Allocations();
+  int64_t system_allocations = heap->SystemAllocations();
+  List<T>* product = new List<T>(list1);
+  for (auto _ : state) {
+    // Mul shrinks product to the intersection, restore it off the clock.
+    state.PauseTiming();
+    delete product;
+    product = new List<T>(list1);
+    state.ResumeTiming();
+    product->Mul(list2);
+  }
+  SetSimdLevel(level);
+  delete product;
+  ReportAllocations(state, heap, allocations, system_allocations);
   delete list1;
   delete list2;
 }
-BENCHMARK(List_Mul);
+BENCHMARK(List_Mul)->Apply(IntersectArguments);
 
 static void List_Scale(benchmark::State& state) {
   tableau_size_t sparse_element_size = 2048;
@@ -94,20 +193,309 @@ static void List_Scale(benchmark::State& state) {
 BENCHMARK(List_Scale);
 
 static void List_Dot(benchmark::State& state) {
-  tableau_size_t sparse_element_size = 2048;
-  List<T>* list1 = new List<T>(sparse_element_size);
-  List<T>* list2 = new List<T>(sparse_element_size);
-  for (auto i = 0; i < sparse_element_size; i++) {
-    list1->Append(i, i);
-    list2->Append(sparse_element_size / 2 + i, i);
+  List<T>* list1 = new List<T>(state.range(0));
+  List<T>* list2 = new List<T>(state.range(0));
+  FillIntersectLists(state, list1, list2);
+  SimdLevel level = GetSimdLevel();
+  SetSimdLevel(static_cast<SimdLevel>(state.range(2)));
+  state.counters["simd_level"] = GetSimdLevel();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(list1->Dot(list2));
   }
+  SetSimdLevel(level);
+  delete list1;
+  delete list2;
+}
+BENCHMARK(List_Dot)->Apply(IntersectArguments);
+
+/*
+ * A list of 65536 elements and one range(0) times shorter, merged with
+ * galloping enabled if range(1) is non-zero.
+ */
+static void SkewArguments(benchmark::internal::Benchmark* b) {
+  for (tableau_size_t ratio = 1; ratio <= 4096; ratio *= 4)
+    for (tableau_size_t gallop : {0, 1}) b->Args({ratio, gallop});
+}
+
+static void FillSkewedLists(benchmark::State& state, List<T>* long_list,
+                            List<T>* short_list) {
+  tableau_size_t long_size = 65536;
+  std::mt19937 rng(0);
+  for (auto i = 0; i < long_size; i++) long_list->Append(2 * i, i);
+  for (auto i = 0; i < long_size; i += state.range(0))
+    short_list->Append(2 * i + rng() % 2, i);
+}
+
+static void List_Dot_Skewed(benchmark::State& state) {
+  List<T>* long_list = new List<T>();
+  List<T>* short_list = new List<T>();
+  FillSkewedLists(state, long_list, short_list);
+  int64_t ratio = GetGallopRatio();
+  SetGallopRatio(state.range(1) ? ratio : 0);
   for (auto _ : state) {
-    list1->Dot(list2);
+    benchmark::DoNotOptimize(long_list->Dot(short_list));
   }
+  SetGallopRatio(ratio);
+  delete long_list;
+  delete short_list;
+}
+BENCHMARK(List_Dot_Skewed)->Apply(SkewArguments);
+
+static void List_Add_Skewed(benchmark::State& state) {
+  List<T>* long_list = new List<T>();
+  List<T>* short_list = new List<T>();
+  FillSkewedLists(state, long_list, short_list);
+  int64_t ratio = GetGallopRatio();
+  SetGallopRatio(state.range(1) ? ratio : 0);
+  for (auto _ : state) {
+    // Adding and subtracting keeps the long list at the same length.
+    long_list->AddScaled(short_list, 1, true);
+    long_list->AddScaled(short_list, -1, true);
+  }
+  SetGallopRatio(ratio);
+  delete long_list;
+  delete short_list;
+}
+BENCHMARK(List_Add_Skewed)->Apply(SkewArguments);
+
+/* Dense lists of range(0) elements with kernels restricted to range(1). */
+static void DenseArguments(benchmark::internal::Benchmark* b) {
+  for (tableau_size_t length = 1024; length <= 16777216; length *= 16)
+    for (tableau_size_t level : {SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512})
+      b->Args({length, level});
+}
+
+static void List_Dot_Dense(benchmark::State& state) {
+  tableau_size_t length = state.range(0);
+  List<T>* list1 = new List<T>(length, DENSE);
+  List<T>* list2 = new List<T>(length, DENSE);
+  for (auto i = 0; i < length; i++) {
+    list1->Append(i, i % 7);
+    list2->Append(i, i % 5);
+  }
+  SimdLevel level = GetSimdLevel();
+  SetSimdLevel(static_cast<SimdLevel>(state.range(1)));
+  state.counters["simd_level"] = GetSimdLevel();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(list1->Dot(list2));
+  }
+  SetSimdLevel(level);
+  state.SetBytesProcessed(state.iterations() * 2 * length * sizeof(T));
   delete list1;
   delete list2;
 }
-BENCHMARK(List_Dot);
+BENCHMARK(List_Dot_Dense)->Apply(DenseArguments);
+
+static void List_AddScaled_Dense(benchmark::State& state) {
+  tableau_size_t length = state.range(0);
+  List<T>* list1 = new List<T>(length, DENSE);
+  List<T>* list2 = new List<T>(length, DENSE);
+  for (auto i = 0; i < length; i++) list2->Append(i, i % 5);
+  SimdLevel level = GetSimdLevel();
+  SetSimdLevel(static_cast<SimdLevel>(state.range(1)));
+  state.counters["simd_level"] = GetSimdLevel();
+  for (auto _ : state) {
+    list1->AddScaled(list2, 0.5, true);
+  }
+  SetSimdLevel(level);
+  state.SetBytesProcessed(state.iterations() * 3 * length * sizeof(T));
+  delete list1;
+  delete list2;
+}
+BENCHMARK(List_AddScaled_Dense)->Apply(DenseArguments);
+
+/*
+ * A sparse list of about 16384 elements spaced range(0) apart on average
+ * against a dense list covering them, with kernels restricted to SimdLevel
+ * range(1) and a prefetch distance of range(2). Large strides put every
+ * gather in a different cache line, far beyond the last level cache.
+ */
+static void GatherArguments(benchmark::internal::Benchmark* b) {
+  for (tableau_size_t stride = 1; stride <= 1024; stride *= 4)
+    for (tableau_size_t level : {SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512})
+      for (tableau_size_t distance : {0, 16, 64})
+        b->Args({stride, level, distance});
+}
+
+static void FillGatherLists(benchmark::State& state, List<T>* sparse,
+                            List<T>* dense) {
+  std::mt19937 rng(0);
+  for (auto i = 0; i < dense->Size(); i++) dense->Append(i, i % 7);
+  // Random gaps of mean range(0), so the hardware prefetcher cannot follow.
+  tableau_index_t index = 0;
+  for (auto i = 0; i < 16384; i++) {
+    sparse->Append(index, i % 5);
+    index += 1 + rng() % (2 * state.range(0) - 1);
+    if (index >= dense->Size()) break;
+  }
+}
+
+static void List_Dot_Gather(benchmark::State& state) {
+  List<T>* sparse = new List<T>(16384);
+  List<T>* dense = new List<T>(16384 * state.range(0) + 1, DENSE);
+  FillGatherLists(state, sparse, dense);
+  SimdLevel level = GetSimdLevel();
+  int64_t distance = GetPrefetchDistance();
+  SetSimdLevel(static_cast<SimdLevel>(state.range(1)));
+  SetPrefetchDistance(state.range(2));
+  state.counters["simd_level"] = GetSimdLevel();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(sparse->Dot(dense));
+  }
+  SetSimdLevel(level);
+  SetPrefetchDistance(distance);
+  state.SetItemsProcessed(state.iterations() * sparse->Size());
+  delete sparse;
+  delete dense;
+}
+BENCHMARK(List_Dot_Gather)->Apply(GatherArguments);
+
+static void List_AddScaled_Scatter(benchmark::State& state) {
+  List<T>* sparse = new List<T>(16384);
+  List<T>* dense = new List<T>(16384 * state.range(0) + 1, DENSE);
+  FillGatherLists(state, sparse, dense);
+  SimdLevel level = GetSimdLevel();
+  int64_t distance = GetPrefetchDistance();
+  SetSimdLevel(static_cast<SimdLevel>(state.range(1)));
+  SetPrefetchDistance(state.range(2));
+  state.counters["simd_level"] = GetSimdLevel();
+  for (auto _ : state) {
+    dense->AddScaled(sparse, 0.5, true);
+  }
+  SetSimdLevel(level);
+  SetPrefetchDistance(distance);
+  state.SetItemsProcessed(state.iterations() * sparse->Size());
+  delete sparse;
+  delete dense;
+}
+BENCHMARK(List_AddScaled_Scatter)->Apply(GatherArguments);
+
+/*
+ * Fills a row of 65536 columns by adding 64 random lists of 2% density to it,
+ * like a row that fills in during pivoting. range(0) is the to_dense
+ * threshold in percent of an AUTO row, or 0 for a SPARSE row.
+ */
+static void List_Add_FillIn(benchmark::State& state) {
+  tableau_size_t length = 65536;
+  std::mt19937 rng(0);
+  std::vector<List<T>*> updates;
+  for (auto k = 0; k < 64; k++) {
+    List<T>* update = new List<T>();
+    for (auto i = 0; i < length; i++)
+      if (rng() % 50 == 0) update->Append(i, 1);
+    updates.push_back(update);
+  }
+  ListDensityThresholds thresholds = GetListDensityThresholds();
+  if (state.range(0) > 0)
+    SetListDensityThresholds(state.range(0) / 100.0, state.range(0) / 200.0);
+  ListFormatConversions& conversions = GetListFormatConversions();
+  int64_t to_dense = conversions.to_dense;
+  for (auto _ : state) {
+    List<T> row(length, state.range(0) > 0 ? AUTO : SPARSE);
+    for (auto update : updates) row.Add(update);
+  }
+  state.counters["to_dense"] = benchmark::Counter(
+      conversions.to_dense - to_dense, benchmark::Counter::kAvgIterations);
+  SetListDensityThresholds(thresholds.to_dense, thresholds.to_sparse);
+  for (auto update : updates) delete update;
+}
+BENCHMARK(List_Add_FillIn)->Arg(0)->Arg(10)->Arg(20)->Arg(40)->Arg(60);
+
+/* Density in percent of two lists of 65536 elements, and their format. */
+static void FormatArguments(benchmark::internal::Benchmark* b) {
+  for (int64_t density : {1, 5, 20, 50})
+    for (int64_t format : {DENSE, SPARSE, BITMAP}) b->Args({density, format});
+}
+
+static void FillFormatLists(benchmark::State& state, List<T>* a, List<T>* b) {
+  std::mt19937 rng(0);
+  for (auto i = 0; i < 65536; i++) {
+    if (int64_t(rng() % 100) < state.range(0)) a->Append(i, 1);
+    if (int64_t(rng() % 100) < state.range(0)) b->Append(i, 2);
+  }
+  // A DENSE list covers all 65536 elements, not just up to the last one.
+  a->Append(65535, 1);
+  b->Append(65535, 2);
+  a->ConvertTo(ListStorageFormat(state.range(1)));
+  b->ConvertTo(ListStorageFormat(state.range(1)));
+}
+
+static void List_Dot_Formats(benchmark::State& state) {
+  List<T> a, b;
+  FillFormatLists(state, &a, &b);
+  for (auto _ : state) benchmark::DoNotOptimize(a.Dot(&b));
+}
+BENCHMARK(List_Dot_Formats)->Apply(FormatArguments);
+
+static void List_Mul_Formats(benchmark::State& state) {
+  List<T> a, b;
+  FillFormatLists(state, &a, &b);
+  for (auto _ : state) {
+    state.PauseTiming();
+    List<T> product(&a);
+    state.ResumeTiming();
+    product.Mul(&b);
+  }
+}
+BENCHMARK(List_Mul_Formats)->Apply(FormatArguments);
+
+/* Adds b and takes it away again, which leaves a as it was. */
+static void List_Add_Formats(benchmark::State& state) {
+  List<T> a, b;
+  FillFormatLists(state, &a, &b);
+  for (auto _ : state) {
+    a.AddScaled(&b, 1, true);
+    a.AddScaled(&b, -1, true);
+  }
+}
+BENCHMARK(List_Add_Formats)->Apply(FormatArguments);
+
+/*
+ * Dot of a sparse list of 2^20 elements spaced range(0) apart on average with
+ * a dense list, for sparse indices stored as range(1) bit integers or, for
+ * 0, delta compressed. The sparse list is streamed, so the bytes it takes
+ * per element bound the time on large lists.
+ */
+static void IndexStorageArguments(benchmark::internal::Benchmark* b) {
+  for (int64_t stride : {1, 4, 16})
+    for (int64_t bits : {64, 32, 0}) b->Args({stride, bits});
+}
+
+template <typename I>
+static void FillIndexStorageList(benchmark::State& state, List<T, I>* sparse,
+                                 List<T, I>* dense) {
+  std::mt19937 rng(0);
+  for (auto i = 0; i < dense->Size(); i++) dense->Append(i, i % 7);
+  tableau_index_t index = 0;
+  for (auto i = 0; i < (1 << 20) and index < dense->Size(); i++) {
+    sparse->Append(index, i % 5 + 1);
+    index += 1 + rng() % (2 * state.range(0) - 1);
+  }
+}
+
+template <typename I>
+static void RunIndexStorageDot(benchmark::State& state) {
+  List<T, I> sparse(1 << 20), dense((1 << 20) * state.range(0), DENSE);
+  FillIndexStorageList(state, &sparse, &dense);
+  tableau_size_t bytes = sparse.Size() * (sizeof(T) + sizeof(I));
+  if (state.range(1) == 0) {
+    CompressedList<T> compressed(&sparse);
+    bytes = compressed.Bytes();
+    for (auto _ : state) benchmark::DoNotOptimize(compressed.Dot(&dense));
+  } else {
+    for (auto _ : state) benchmark::DoNotOptimize(sparse.Dot(&dense));
+  }
+  state.counters["bytes_per_element"] = double(bytes) / sparse.Size();
+  state.SetItemsProcessed(state.iterations() * sparse.Size());
+}
+
+static void List_Dot_IndexStorage(benchmark::State& state) {
+  if (state.range(1) == 32)
+    RunIndexStorageDot<uint32_t>(state);
+  else
+    RunIndexStorageDot<tableau_index_t>(state);
+}
+BENCHMARK(List_Dot_IndexStorage)->Apply(IndexStorageArguments);
 
 static void List_Reduce(benchmark::State& state) {
   tableau_size_t sparse_element_size = state.range(0);
@@ -146,6 +534,99 @@ static void List_SparseCross(benchmark::State& state) {
 }
 BENCHMARK(List_SparseCross)->Apply(CustomArguments2);
 
+static void List_SparseCross_Arena(benchmark::State& state) {
+  tableau_size_t sparse_element_size = state.range(0);
+  List<T>* list1 = new List<T>(sparse_element_size);
+  List<T>* list2 = new List<T>(sparse_element_size);
+  for (auto i = 0; i < sparse_element_size; i++) {
+    list1->Append(i, i);
+    list2->Append(i, i);
+  }
+  for (auto _ : state) {
+    auto tableau = list1->SparseCross(list2, ROW_AND_COLUMN, ARENA_ALLOCATION);
+    delete tableau;
+  }
+  delete list1;
+  delete list2;
+}
+BENCHMARK(List_SparseCross_Arena)->Apply(CustomArguments2);
+
+/* The pivot update tableau += u * v^T on a size x size tableau. */
+static void FillPivotUpdate(benchmark::State& state, Tableau<T>** tableau,
+                            List<T>* u, List<T>* v) {
+  tableau_size_t size = state.range(0);
+  *tableau = new Tableau<T>(size, size);
+  for (auto i = 0; i < size; i++) {
+    u->Append(i, i + 1);
+    v->Append(i, size - i);
+  }
+}
+
+static void Tableau_Add_SparseCross(benchmark::State& state) {
+  Tableau<T>* tableau;
+  List<T> u(0, SPARSE), v(0, SPARSE);
+  FillPivotUpdate(state, &tableau, &u, &v);
+  ListAllocator* heap = HeapAllocator::Instance();
+  int64_t allocations = heap->Allocations();
+  int64_t system_allocations = heap->SystemAllocations();
+  for (auto _ : state) {
+    SparseTableau<T>* product = u.SparseCross(&v);
+    tableau->Add(product);
+    delete product;
+  }
+  ReportAllocations(state, heap, allocations, system_allocations);
+  delete tableau;
+}
+BENCHMARK(Tableau_Add_SparseCross)->Apply(CustomArguments2);
+
+static void Tableau_Add_OuterProduct(benchmark::State& state) {
+  Tableau<T>* tableau;
+  List<T> u(0, SPARSE), v(0, SPARSE);
+  FillPivotUpdate(state, &tableau, &u, &v);
+  ListAllocator* heap = HeapAllocator::Instance();
+  int64_t allocations = heap->Allocations();
+  int64_t system_allocations = heap->SystemAllocations();
+  for (auto _ : state) tableau->Add(u.Outer(&v));
+  ReportAllocations(state, heap, allocations, system_allocations);
+  delete tableau;
+}
+BENCHMARK(Tableau_Add_OuterProduct)->Apply(CustomArguments2);
+
+/*
+ * Pivot updates on a 10000 x 10000 tableau by a u of range(0) and a v of
+ * range(1) random nonzeros. Each row starts out with 16 random nonzeros.
+ */
+static void RankOneUpdateArguments(benchmark::internal::Benchmark* b) {
+  for (tableau_size_t u_size : {10, 100, 1000})
+    for (tableau_size_t v_size : {10, 100, 1000}) b->Args({u_size, v_size});
+}
+
+static void FillRandomList(std::mt19937* rng, tableau_size_t length,
+                           tableau_size_t size, List<T>* list) {
+  std::vector<tableau_index_t> indices(length);
+  for (auto i = 0; i < length; i++) indices[i] = i;
+  std::shuffle(indices.begin(), indices.end(), *rng);
+  indices.resize(size);
+  std::sort(indices.begin(), indices.end());
+  for (auto index : indices) list->Append(index, 1 + (*rng)() % 7);
+}
+
+static void Tableau_RankOneUpdate(benchmark::State& state) {
+  const tableau_size_t size = 10000;
+  std::mt19937 rng(0);
+  Tableau<T> tableau(size, size);
+  List<T> all(0, SPARSE), background(0, SPARSE), u(0, SPARSE), v(0, SPARSE);
+  FillRandomList(&rng, size, size, &all);
+  FillRandomList(&rng, size, 16, &background);
+  tableau.Add(all.Outer(&background));
+  FillRandomList(&rng, size, state.range(0), &u);
+  FillRandomList(&rng, size, state.range(1), &v);
+  for (auto _ : state) tableau.Add(u.Outer(&v));
+  state.SetItemsProcessed(state.iterations() * 2 * state.range(0) *
+                          state.range(1));
+}
+BENCHMARK(Tableau_RankOneUpdate)->Apply(RankOneUpdateArguments);
+
 static void CustomTableauArguments1(benchmark::internal::Benchmark* b) {
   for (tableau_size_t row = 1000; row <= 10000000; row = row * 10)
     for (tableau_size_t col = 1000; col <= 10000000; col *= 10)
@@ -162,6 +643,234 @@ static void Tableau_Constructor(benchmark::State& state) {
 }
 BENCHMARK(Tableau_Constructor)->Apply(CustomTableauArguments1);
 
+static void Tableau_Constructor_Csr(benchmark::State& state) {
+  tableau_size_t row = state.range(0);
+  tableau_size_t col = state.range(1);
+  for (auto _ : state) {
+    Tableau<T>* tableau =
+        new Tableau<T>(row, col, ROW_AND_COLUMN, CSR_ALLOCATION);
+    delete tableau;
+  }
+}
+BENCHMARK(Tableau_Constructor_Csr)->Apply(CustomTableauArguments1);
+
+/*
+ * Times on a ROW_ONLY tableau of range(0) rows with 8 random nonzeros each
+ * out of 10000 columns, one in each eighth, stored with
+ * TableauAllocationPolicy range(1).
+ */
+static void TimesArguments(benchmark::internal::Benchmark* b) {
+  for (tableau_size_t rows = 10000; rows <= 1000000; rows *= 10)
+    for (tableau_size_t allocation : {HEAP_ALLOCATION, CSR_ALLOCATION})
+      b->Args({rows, allocation});
+}
+
+/* Gives every row 8 random nonzeros, one in each eighth of the columns. */
+static void FillEighths(std::mt19937* rng, Tableau<T>* tableau) {
+  tableau_size_t cols = tableau->Cols();
+  for (auto i = 0; i < tableau->Rows(); i++) {
+    List<T>* row = new List<T>(8);
+    // Column j * cols / 8 plus a random offset into its eighth.
+    for (auto j = 0; j < 8; j++)
+      row->Append(j * cols / 8 + (*rng)() % (cols / 8), 1 + (*rng)() % 7);
+    tableau->AppendRow(i, row);
+  }
+}
+
+static void Tableau_Times(benchmark::State& state) {
+  const tableau_size_t cols = 10000;
+  tableau_size_t rows = state.range(0);
+  std::mt19937 rng(0);
+  Tableau<T> tableau(rows, cols, ROW_ONLY,
+                     static_cast<TableauAllocationPolicy>(state.range(1)));
+  FillEighths(&rng, &tableau);
+  List<T> x(cols, DENSE);
+  for (auto j = 0; j < cols; j++) x.Set(j, j % 7);
+  for (auto _ : state) delete tableau.Times(&x);
+  state.SetItemsProcessed(state.iterations() * rows * 8);
+  ReportSpmv(state, rows, cols, rows * 8);
+}
+BENCHMARK(Tableau_Times)->Apply(TimesArguments);
+
+/*
+ * Times as above, but row lengths follow a Pareto distribution with shape
+ * range(2) / 10, from 1 up to all 10000 columns, in random row order.
+ */
+static void PowerLawTimesArguments(benchmark::internal::Benchmark* b) {
+  for (tableau_size_t rows = 10000; rows <= 1000000; rows *= 10)
+    for (tableau_size_t allocation : {HEAP_ALLOCATION, CSR_ALLOCATION})
+      for (tableau_size_t shape : {12, 20})
+        b->Args({rows, allocation, shape});
+}
+
+static void Tableau_Times_PowerLaw(benchmark::State& state) {
+  const tableau_size_t cols = 10000;
+  tableau_size_t rows = state.range(0);
+  double shape = state.range(2) / 10.0;
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  Tableau<T> tableau(rows, cols, ROW_ONLY,
+                     static_cast<TableauAllocationPolicy>(state.range(1)));
+  tableau_size_t nonzeros = 0;
+  std::vector<tableau_index_t> indices;
+  for (auto i = 0; i < rows; i++) {
+    double length = std::pow(1 - uniform(rng), -1 / shape);
+    indices.resize(std::min<double>(length, cols));
+    for (auto& index : indices) index = rng() % cols;
+    std::sort(indices.begin(), indices.end());
+    indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+    List<T>* row = new List<T>(indices.size());
+    for (auto index : indices) row->Append(index, 1 + rng() % 7);
+    nonzeros += indices.size();
+    tableau.AppendRow(i, row);
+  }
+  List<T> x(cols, DENSE);
+  for (auto j = 0; j < cols; j++) x.Set(j, j % 7);
+  for (auto _ : state) delete tableau.Times(&x);
+  state.SetItemsProcessed(state.iterations() * nonzeros);
+  ReportSpmv(state, rows, cols, nonzeros);
+}
+BENCHMARK(Tableau_Times_PowerLaw)->Apply(PowerLawTimesArguments);
+
+/*
+ * Times of a 500000 x 10000000 tableau with 16 random nonzeros per row, so x
+ * does not fit in the cache. range(0) is the columns per panel, with 0 for no
+ * panels and 1 for the default of half the last level cache.
+ */
+static void PanelArguments(benchmark::internal::Benchmark* b) {
+  for (tableau_size_t panel_columns : {0, 1, 65536, 262144, 1048576})
+    b->Arg(panel_columns);
+  b->Unit(benchmark::kMillisecond);
+}
+
+static void Tableau_Times_Panels(benchmark::State& state) {
+  const tableau_size_t rows = 500000, cols = 10000000, row_size = 16;
+  std::mt19937 rng(0);
+  Tableau<T> tableau(rows, cols, ROW_ONLY);
+  std::vector<tableau_index_t> indices(row_size);
+  for (auto i = 0; i < rows; i++) {
+    for (auto& index : indices) index = rng() % cols;
+    std::sort(indices.begin(), indices.end());
+    List<T>* row = new List<T>(row_size);
+    for (auto j = 0; j < row_size; j++)
+      if (j == 0 or indices[j] != indices[j - 1])
+        row->Append(indices[j], 1 + rng() % 7);
+    tableau.AppendRow(i, row);
+  }
+  if (state.range(0) > 0)
+    tableau.BuildColumnPanels(state.range(0) == 1 ? 0 : state.range(0));
+  List<T> x(cols, DENSE);
+  for (auto j = 0; j < cols; j++) x.Set(j, j % 7);
+  for (auto _ : state) delete tableau.Times(&x);
+  ReportSpmv(state, rows, cols, rows * row_size);
+}
+BENCHMARK(Tableau_Times_Panels)->Apply(PanelArguments);
+
+/*
+ * range(0) products of a 100000 x 10000 tableau filled as for Tableau_Times,
+ * as one block if range(1) is 1 and one Times each otherwise.
+ */
+static void BlockArguments(benchmark::internal::Benchmark* b) {
+  for (tableau_size_t k : {1, 2, 4, 8, 16})
+    for (tableau_size_t block : {0, 1}) b->Args({k, block});
+}
+
+static void Tableau_Times_Block(benchmark::State& state) {
+  const tableau_size_t rows = 100000, cols = 10000;
+  tableau_size_t k = state.range(0);
+  std::mt19937 rng(0);
+  Tableau<T> tableau(rows, cols, ROW_ONLY);
+  FillEighths(&rng, &tableau);
+  std::vector<List<T>*> xs;
+  for (auto j = 0; j < k; j++) {
+    xs.push_back(new List<T>(cols, DENSE));
+    for (auto c = 0; c < cols; c++) xs[j]->Set(c, (c + j) % 7);
+  }
+  std::vector<T> x(cols * k), y(rows * k);
+  for (auto c = 0; c < cols; c++)
+    for (auto j = 0; j < k; j++) x[c * k + j] = xs[j]->At(c);
+  for (auto _ : state) {
+    if (state.range(1) == 1) {
+      tableau.Times(x.data(), k, y.data());
+    } else {
+      for (auto j = 0; j < k; j++) delete tableau.Times(xs[j]);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * rows * 8 * k);
+  ReportSpmv(state, rows, cols, rows * 8 * k);
+  for (auto list : xs) delete list;
+}
+BENCHMARK(Tableau_Times_Block)->Apply(BlockArguments);
+
+static void Tableau_SumScaledRows_Block(benchmark::State& state) {
+  const tableau_size_t rows = 100000, cols = 10000;
+  tableau_size_t k = state.range(0);
+  std::mt19937 rng(0);
+  Tableau<T> tableau(rows, cols, ROW_ONLY);
+  FillEighths(&rng, &tableau);
+  std::vector<List<T>*> scales;
+  for (auto j = 0; j < k; j++) {
+    scales.push_back(new List<T>(rows, DENSE));
+    for (auto r = 0; r < rows; r++) scales[j]->Set(r, (r + j) % 7);
+  }
+  std::vector<T> scale(rows * k), y(cols * k);
+  for (auto r = 0; r < rows; r++)
+    for (auto j = 0; j < k; j++) scale[r * k + j] = scales[j]->At(r);
+  for (auto _ : state) {
+    if (state.range(1) == 1) {
+      tableau.SumScaledRows(scale.data(), k, y.data());
+    } else {
+      for (auto j = 0; j < k; j++) delete tableau.SumScaledRows(scales[j]);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * rows * 8 * k);
+  for (auto list : scales) delete list;
+}
+BENCHMARK(Tableau_SumScaledRows_Block)->Apply(BlockArguments);
+
+/*
+ * SumScaledRows of a 100000 x 10000 tableau filled as for Tableau_Times in
+ * TableauStorageFormat range(1), with range(0) random rows in scale.
+ */
+static void SumScaledRowsArguments(benchmark::internal::Benchmark* b) {
+  for (tableau_size_t scale_size = 100; scale_size <= 100000; scale_size *= 10)
+    for (tableau_size_t format : {ROW_ONLY, COLUMN_ONLY, ROW_AND_COLUMN})
+      b->Args({scale_size, format});
+}
+
+static void Tableau_SumScaledRows(benchmark::State& state) {
+  const tableau_size_t rows = 100000, cols = 10000;
+  std::mt19937 rng(0);
+  Tableau<T> tableau(rows, cols,
+                     static_cast<TableauStorageFormat>(state.range(1)));
+  FillEighths(&rng, &tableau);
+  List<T> scale(0, SPARSE);
+  for (auto i = 0; i < rows; i += rows / state.range(0))
+    scale.Append(i, 1 + rng() % 7);
+  for (auto _ : state) delete tableau.SumScaledRows(&scale);
+  state.SetItemsProcessed(state.iterations() * scale.Size() * 8);
+}
+BENCHMARK(Tableau_SumScaledRows)->Apply(SumScaledRowsArguments);
+
+/*
+ * SumScaledRows of range(0) rows of a 1000 x 10000000 ROW_ONLY tableau
+ * filled as for Tableau_Times, where the result is far from dense.
+ */
+static void Tableau_SumScaledRows_Hypersparse(benchmark::State& state) {
+  const tableau_size_t rows = 1000, cols = 10000000;
+  std::mt19937 rng(0);
+  Tableau<T> tableau(rows, cols, ROW_ONLY);
+  FillEighths(&rng, &tableau);
+  List<T> scale(0, SPARSE);
+  for (auto i = 0; i < rows; i += rows / state.range(0))
+    scale.Append(i, 1 + rng() % 7);
+  for (auto _ : state) delete tableau.SumScaledRows(&scale);
+  state.SetItemsProcessed(state.iterations() * scale.Size() * 8);
+}
+BENCHMARK(Tableau_SumScaledRows_Hypersparse)
+    ->RangeMultiplier(10)
+    ->Range(1, 1000);
+
 static void CustomTableauArguments2(benchmark::internal::Benchmark* b) {
   for (tableau_size_t row = 1000; row <= 10000000; row = row * 10)
     for (tableau_size_t col = 1000; col <= 10000000; col *= 10)
@@ -177,6 +886,9 @@ static void Tableau_AppendRow(benchmark::State& state) {
   tableau_size_t col = state.range(1);
   tableau_size_t row_element_size = state.range(2);
   tableau_size_t col_element_size = state.range(3);
+  ListAllocator* heap = HeapAllocator::Instance();
+  int64_t allocations = heap->Allocations();
+  int64_t system_allocations = heap->SystemAllocations();
   for (auto _ : state) {
     Tableau<T>* tableau = new Tableau<T>(row, col);
     for (auto i = 0; i < col_element_size; i++) {
@@ -188,7 +900,310 @@ static void Tableau_AppendRow(benchmark::State& state) {
     }
     delete tableau;
   }
+  ReportAllocations(state, heap, allocations, system_allocations);
 }
 BENCHMARK(Tableau_AppendRow)->Apply(CustomTableauArguments2);
 
-BENCHMARK_MAIN();
\ No newline at end of file
+static void Tableau_AppendRow_Arena(benchmark::State& state) {
+  tableau_size_t row = state.range(0);
+  tableau_size_t col = state.range(1);
+  tableau_size_t row_element_size = state.range(2);
+  tableau_size_t col_element_size = state.range(3);
+  int64_t allocations = 0, system_allocations = 0;
+  for (auto _ : state) {
+    Tableau<T>* tableau =
+        new Tableau<T>(row, col, ROW_AND_COLUMN, ARENA_ALLOCATION);
+    for (auto i = 0; i < col_element_size; i++) {
+      List<T>* list = tableau->NewList(row_element_size);
+      for (auto i = 0; i < row_element_size; i++) {
+        list->Append(i * (col / row_element_size), i);
+      }
+      tableau->AppendRow(i, list);
+    }
+    allocations += tableau->Allocator()->Allocations();
+    system_allocations += tableau->Allocator()->SystemAllocations();
+    delete tableau;
+  }
+  state.counters["allocations"] =
+      benchmark::Counter(allocations, benchmark::Counter::kAvgIterations);
+  state.counters["system_allocations"] = benchmark::Counter(
+      system_allocations, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(Tableau_AppendRow_Arena)->Apply(CustomTableauArguments2);
+
+/*
+ * Pivots on a synthetic LP in ROW_AND_COLUMN storage: range(0) rows, each with
+ * four random structural columns and its own slack, on range(1) threads. The
+ * pivots walk the structural columns in order, each on the first row of the
+ * column, and the rate is reported in pivots per second.
+ */
+static void PivotArguments(benchmark::internal::Benchmark* b) {
+  for (tableau_size_t rows : {10000, 100000, 1000000})
+    for (tableau_size_t threads : {1, 2, 4}) b->Args({rows, threads});
+  b->Iterations(500);
+}
+
+static void Tableau_Pivot(benchmark::State& state) {
+  const tableau_size_t rows = state.range(0), row_size = 4;
+  int threads = omp_get_max_threads();
+  omp_set_num_threads(state.range(1));
+  std::mt19937 rng(0);
+  Tableau<T> tableau(rows, 2 * rows);
+  std::vector<tableau_index_t> indices(row_size);
+  for (auto i = 0; i < rows; i++) {
+    for (auto& index : indices) index = rng() % rows;
+    std::sort(indices.begin(), indices.end());
+    List<T>* row = new List<T>(row_size + 1);
+    for (auto j = 0; j < row_size; j++)
+      if (j == 0 or indices[j] != indices[j - 1])
+        row->Append(indices[j], 1 + rng() % 7);
+    row->Append(rows + i, 1);
+    tableau.AppendRow(i, row);
+  }
+  tableau_index_t col = 0;
+  for (auto _ : state) {
+    while (tableau.Col(col)->Size() == 0) col++;
+    tableau_index_t row = (*tableau.Col(col)->begin()).index;
+    tableau.Pivot(row, col++);
+  }
+  state.SetItemsProcessed(state.iterations());
+  omp_set_num_threads(threads);
+}
+BENCHMARK(Tableau_Pivot)->Apply(PivotArguments);
+
+/*
+ * L x = b for a COLUMN_ONLY lower triangular L of range(0) rows shaped like
+ * the L of an LU factor: half the columns have one element below the
+ * diagonal, at most 100 rows down. b has range(1) random nonzeros, and
+ * range(2) picks SparseTriangularSolver::Solve, or the dense sweep with 0.
+ */
+static void TriangularSolveArguments(benchmark::internal::Benchmark* b) {
+  for (tableau_size_t nonzeros : {1, 10, 100, 1000, 10000, 100000})
+    for (tableau_size_t sparse : {1, 0}) b->Args({1000000, nonzeros, sparse});
+}
+
+static void SparseTriangularSolver_Solve(benchmark::State& state) {
+  const tableau_size_t size = state.range(0), nonzeros = state.range(1);
+  std::mt19937 rng(0);
+  Tableau<double> lower(size, size, COLUMN_ONLY);
+  for (auto j = 0; j < size; j++) {
+    List<double>* col = new List<double>(2);
+    col->Append(j, 1 + rng() % 4);
+    if (rng() % 2 and j + 1 < size)
+      col->Append(j + 1 + rng() % std::min<tableau_size_t>(100, size - j - 1),
+                  1);
+    lower.AppendCol(j, col);
+  }
+  std::vector<tableau_index_t> indices(nonzeros);
+  for (auto& index : indices) index = rng() % size;
+  std::sort(indices.begin(), indices.end());
+  List<double> b;
+  for (auto k = 0; k < nonzeros; k++)
+    if (k == 0 or indices[k] != indices[k - 1]) b.Append(indices[k], 1);
+  SparseTriangularSolver<double> solver(size);
+  tableau_size_t result = 0;
+  for (auto _ : state) {
+    List<double>* x = state.range(2) ? solver.Solve(&lower, &b)
+                                     : solver.SolveDense(&lower, &b, false);
+    result = x->Size();
+    delete x;
+  }
+  state.counters["result_nonzeros"] = result;
+}
+BENCHMARK(SparseTriangularSolver_Solve)
+    ->Apply(TriangularSolveArguments)
+    ->Unit(benchmark::kMicrosecond);
+
+/*
+ * The first 200 iterations of RevisedSimplex on an LP with range(0) rows and
+ * twice as many columns, four nonzeros per row of which two are random and
+ * two make sure every column has one, and costs that make every column
+ * attractive, in iterations per second. factor_nonzeros is the size of the
+ * LU factor at the end.
+ */
+static void RevisedSimplex_Iterations(benchmark::State& state) {
+  const tableau_size_t rows = state.range(0), cols = 2 * rows, row_size = 4;
+  const tableau_size_t iterations = 200;
+  std::mt19937 rng(0);
+  Tableau<double> a(rows, cols);
+  List<double> b, c;
+  for (auto i = 0; i < rows; i++) {
+    std::vector<tableau_index_t> indices(row_size);
+    for (auto& index : indices) index = rng() % cols;
+    indices[0] = 2 * i;
+    indices[1] = 2 * i + 1;
+    std::sort(indices.begin(), indices.end());
+    List<double>* row = new List<double>(row_size);
+    for (auto j = 0; j < row_size; j++)
+      if (j == 0 or indices[j] != indices[j - 1])
+        row->Append(indices[j], 1 + rng() % 7);
+    a.AppendRow(i, row);
+    b.Append(i, 10 + rng() % 90);
+  }
+  for (auto j = 0; j < cols; j++) c.Append(j, -1.0 - rng() % 50);
+  tableau_size_t nonzeros = 0;
+  for (auto _ : state) {
+    RevisedSimplex<double> simplex(&a, &b, &c);
+    simplex.Solve(iterations);
+    nonzeros = simplex.Factor().Nonzeros();
+  }
+  state.SetItemsProcessed(state.iterations() * iterations);
+  state.counters["factor_nonzeros"] = nonzeros;
+}
+BENCHMARK(RevisedSimplex_Iterations)
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Arg(100000)
+    ->Unit(benchmark::kMillisecond);
+
+/*
+ * One Pricing::Choose over range(0) variables with random reduced costs and
+ * signs, Devex weights if range(1) is 1 and Dantzig's rule otherwise, on
+ * range(2) threads with the kernels restricted to SimdLevel range(3).
+ */
+static void PricingArguments(benchmark::internal::Benchmark* b) {
+  for (tableau_size_t size : {100000, 1000000, 10000000})
+    for (tableau_size_t weighted : {0, 1})
+      for (tableau_size_t threads : {1, 4})
+        for (tableau_size_t level : {SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512})
+          b->Args({size, weighted, threads, level});
+}
+
+static void Pricing_Choose(benchmark::State& state) {
+  const tableau_size_t size = state.range(0);
+  int threads = omp_get_max_threads();
+  omp_set_num_threads(state.range(2));
+  SimdLevel level = GetSimdLevel();
+  SetSimdLevel(static_cast<SimdLevel>(state.range(3)));
+  state.counters["simd_level"] = GetSimdLevel();
+  std::mt19937 rng(0);
+  std::vector<double> d(size), sign(size);
+  for (auto j = 0; j < size; j++) {
+    d[j] = static_cast<int>(rng() % 2001) - 1000;
+    sign[j] = static_cast<int>(rng() % 3) - 1;
+  }
+  Pricing<double> pricing(size, state.range(1) ? DEVEX : DANTZIG);
+  pricing.Reset(sign.data());
+  // Weights of about the size of the gains.
+  pricing.Update(
+      0, 0, 1, 1000,
+      [&](auto visit) {
+        for (auto j = 1; j < size; j++) visit(j, (rng() % 1000) / 1000.0);
+      },
+      nullptr);
+  for (auto _ : state)
+    benchmark::DoNotOptimize(pricing.Choose(d.data(), sign.data(), 1e-6));
+  state.SetItemsProcessed(state.iterations() * size);
+  SetSimdLevel(level);
+  omp_set_num_threads(threads);
+}
+BENCHMARK(Pricing_Choose)
+    ->Apply(PricingArguments)
+    ->Unit(benchmark::kMicrosecond);
+
+/*
+ * RevisedSimplex to the optimum of an LP with range(0) rows, twice as many
+ * columns and about ten nonzeros per row, by PricingRule range(1), with
+ * partial pricing in blocks of a twentieth of the variables and eight
+ * candidates if range(2) is 1. iterations counts the simplex iterations.
+ */
+static void SimplexPricingArguments(benchmark::internal::Benchmark* b) {
+  for (tableau_size_t rule : {DANTZIG, DEVEX, STEEPEST_EDGE})
+    for (tableau_size_t partial : {0, 1}) b->Args({500, rule, partial});
+}
+
+static void RevisedSimplex_Pricing(benchmark::State& state) {
+  const tableau_size_t rows = state.range(0), cols = 2 * rows, row_size = 10;
+  std::mt19937 rng(1);
+  Tableau<double> a(rows, cols);
+  List<double> b, c;
+  for (auto i = 0; i < rows; i++) {
+    std::vector<tableau_index_t> indices(row_size);
+    for (auto& index : indices) index = rng() % cols;
+    indices[0] = i;
+    indices[1] = rows + i;
+    std::sort(indices.begin(), indices.end());
+    List<double>* row = new List<double>(row_size);
+    for (auto j = 0; j < row_size; j++)
+      if (j == 0 or indices[j] != indices[j - 1])
+        row->Append(indices[j], 1 + rng() % 97 / 10.0);
+    a.AppendRow(i, row);
+    b.Append(i, 10 + rng() % 89);
+  }
+  for (auto j = 0; j < cols; j++) c.Append(j, -1.0 - rng() % 53 / 7.0);
+  tableau_size_t iterations = 0;
+  for (auto _ : state) {
+    RevisedSimplex<double> simplex(&a, &b, &c);
+    if (state.range(2))
+      simplex.SetPricing(static_cast<PricingRule>(state.range(1)),
+                         (rows + cols) / 20, 8);
+    else
+      simplex.SetPricing(static_cast<PricingRule>(state.range(1)));
+    simplex.Solve();
+    iterations = simplex.Iterations();
+  }
+  state.counters["iterations"] = iterations;
+}
+BENCHMARK(RevisedSimplex_Pricing)
+    ->Apply(SimplexPricingArguments)
+    ->Unit(benchmark::kMillisecond);
+
+/*
+ * The ratio test of a column of range(0) basic variables, DENSE if range(1)
+ * is 0 and SPARSE with 1% of them otherwise. RatioTest::Harris on range(2)
+ * threads with the kernels restricted to SimdLevel range(3), or, if range(4)
+ * is 1, the textbook test through a List of the ratios and its minimum.
+ */
+static void RatioTestArguments(benchmark::internal::Benchmark* b) {
+  for (tableau_size_t size : {100000, 1000000})
+    for (tableau_size_t sparse : {0, 1}) {
+      b->Args({size, sparse, 1, SIMD_SCALAR, 1});
+      for (tableau_size_t threads : {1, 4})
+        for (tableau_size_t level : {SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512})
+          b->Args({size, sparse, threads, level, 0});
+    }
+}
+
+static void RatioTest_Harris(benchmark::State& state) {
+  const tableau_size_t size = state.range(0);
+  int threads = omp_get_max_threads();
+  omp_set_num_threads(state.range(2));
+  SimdLevel level = GetSimdLevel();
+  SetSimdLevel(static_cast<SimdLevel>(state.range(3)));
+  state.counters["simd_level"] = GetSimdLevel();
+  std::mt19937 rng(0);
+  std::vector<double> down(size), up(size);
+  List<double> alpha(size, state.range(1) ? SPARSE : DENSE);
+  for (auto i = 0; i < size; i++) {
+    down[i] = rng() % 1000;
+    up[i] = rng() % 1000;
+    double rate = (static_cast<int>(rng() % 2001) - 1000) / 100.0;
+    if (not state.range(1))
+      alpha.Set(i, rate);
+    else if (rng() % 100 == 0)
+      alpha.Append(i, rate);
+  }
+  RatioTest<double> ratio_test;
+  for (auto _ : state) {
+    if (not state.range(4)) {
+      benchmark::DoNotOptimize(
+          ratio_test.Harris(&alpha, down.data(), up.data(), 1e9));
+      continue;
+    }
+    List<double> ratios(alpha.Size());
+    alpha.ForEach([&](tableau_index_t i, double value) {
+      if (std::abs(value) > 1e-9)
+        ratios.Append(i, (value > 0 ? down[i] : up[i]) / std::abs(value));
+    });
+    benchmark::DoNotOptimize(ratios.Reduce(
+        List<double>::MinReduce, {-1, RatioTest<double>::Infinity()}));
+  }
+  state.SetItemsProcessed(state.iterations() * alpha.Size());
+  SetSimdLevel(level);
+  omp_set_num_threads(threads);
+}
+BENCHMARK(RatioTest_Harris)
+    ->Apply(RatioTestArguments)
+    ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "tableau.h"
+
+/**
+ * A read-only copy of a list for rows and columns that no longer change.
+ * The indices are delta encoded in blocks of kBlockSize elements: a block
+ * keeps its first index in full and the gaps to the rest in the narrowest of
+ * 1, 2 or 4 bytes that holds all of them, so a list with small gaps costs
+ * little more than a byte per index. Blocks are decoded into a buffer on the
+ * stack and handed to the same kernels as a SPARSE list.
+ */
+template <typename T>
+class CompressedList {
+ public:
+  static constexpr tableau_size_t kBlockSize = 128;
+
+  template <typename I>
+  explicit CompressedList(const List<T, I>* list) {
+    if (list->StorageFormat() != SPARSE) {
+      List<T, I> sparse(list);
+      sparse.ConvertTo(SPARSE);
+      Compress(sparse.index_, sparse.data_, sparse.Size());
+    } else {
+      Compress(list->index_, list->data_, list->Size());
+    }
+  }
+
+  tableau_size_t Size() const { return values_.size(); }
+
+  /* Bytes held by the encoded indices and the values. */
+  tableau_size_t Bytes() const {
+    return deltas_.size() + values_.size() * sizeof(T) +
+           first_index_.size() * (2 * sizeof(int64_t) + sizeof(uint8_t));
+  }
+
+  T At(tableau_index_t index) const {
+    auto block = std::upper_bound(first_index_.begin(), first_index_.end(),
+                                  index) -
+                 first_index_.begin() - 1;
+    if (block < 0) return 0;
+    int64_t block_index[kBlockSize];
+    tableau_size_t n = Decode(block, block_index);
+    for (tableau_size_t i = 0; i < n; i++)
+      if (block_index[i] == index) return values_[block * kBlockSize + i];
+    return 0;
+  }
+
+  /* Calls visit(index, value) for every element in increasing order. */
+  template <typename Visitor>
+  void ForEach(Visitor visit) const {
+    int64_t block_index[kBlockSize];
+    for (tableau_index_t block = 0; block < Blocks(); block++) {
+      tableau_size_t n = Decode(block, block_index);
+      for (tableau_size_t i = 0; i < n; i++)
+        visit(block_index[i], values_[block * kBlockSize + i]);
+    }
+  }
+
+  template <typename I>
+  T Dot(const List<T, I>* dense) const {
+    assert_msg(dense->StorageFormat() == DENSE,
+               "CompressedList only supports Dot with a DENSE list");
+    T product = 0;
+    int64_t block_index[kBlockSize];
+    for (tableau_index_t block = 0; block < Blocks(); block++) {
+      tableau_size_t n = Decode(block, block_index);
+      assert(block_index[n - 1] < dense->Size());
+      product += GatherDot(values_.data() + block * kBlockSize, block_index, n,
+                           dense->data_);
+    }
+    return product;
+  }
+
+  /* dense += scale * this */
+  template <typename I>
+  void AddScaledTo(List<T, I>* dense, T scale) const {
+    assert_msg(dense->StorageFormat() == DENSE,
+               "CompressedList can only be added to a DENSE list");
+    int64_t block_index[kBlockSize];
+    for (tableau_index_t block = 0; block < Blocks(); block++) {
+      tableau_size_t n = Decode(block, block_index);
+      assert(block_index[n - 1] < dense->Size());
+      ScatterAxpy(dense->data_, block_index,
+                  values_.data() + block * kBlockSize, scale, n);
+    }
+  }
+
+  /* A SPARSE list with the same elements. */
+  template <typename I = tableau_index_t>
+  List<T, I>* Decompress() const {
+    List<T, I>* list = new List<T, I>(Size());
+    ForEach(
+        [&](tableau_index_t index, T value) { list->Append(index, value); });
+    return list;
+  }
+
+ private:
+  std::vector<T> values_;
+  std::vector<uint8_t> deltas_;
+  // Per block: the first index, where its gaps start in deltas_, and the
+  // number of bytes per gap.
+  std::vector<int64_t> first_index_;
+  std::vector<int64_t> delta_offset_;
+  std::vector<uint8_t> delta_bytes_;
+
+  tableau_size_t Blocks() const { return first_index_.size(); }
+
+  template <typename I>
+  void Compress(const I* index, const T* data, tableau_size_t size) {
+    values_.assign(data, data + size);
+    for (tableau_index_t begin = 0; begin < size; begin += kBlockSize) {
+      tableau_index_t end = std::min(begin + kBlockSize, size);
+      int64_t max_gap = 0;
+      for (tableau_index_t i = begin + 1; i < end; i++)
+        max_gap = std::max<int64_t>(max_gap, index[i] - index[i - 1]);
+      uint8_t bytes = max_gap < (1 << 8) ? 1 : max_gap < (1 << 16) ? 2 : 4;
+      assert_msg(max_gap < (int64_t(1) << 32),
+                 "Gaps of 2^32 and more cannot be compressed");
+      first_index_.push_back(index[begin]);
+      delta_offset_.push_back(deltas_.size());
+      delta_bytes_.push_back(bytes);
+      for (tableau_index_t i = begin + 1; i < end; i++) {
+        uint32_t gap = index[i] - index[i - 1];
+        uint16_t short_gap = gap;
+        uint8_t byte_gap = gap;
+        const void* bytes_of_gap =
+            bytes == 1 ? static_cast<const void*>(&byte_gap)
+                       : bytes == 2 ? static_cast<const void*>(&short_gap)
+                                    : static_cast<const void*>(&gap);
+        deltas_.resize(deltas_.size() + bytes);
+        std::memcpy(deltas_.data() + deltas_.size() - bytes, bytes_of_gap,
+                    bytes);
+      }
+    }
+  }
+
+  /* Writes the indices of block to block_index and returns their number. */
+  tableau_size_t Decode(tableau_index_t block, int64_t* block_index) const {
+    tableau_size_t n =
+        std::min<tableau_size_t>(kBlockSize, Size() - block * kBlockSize);
+    const uint8_t* gaps = deltas_.data() + delta_offset_[block];
+    int64_t index = first_index_[block];
+    block_index[0] = index;
+    switch (delta_bytes_[block]) {
+      case 1:
+        for (tableau_size_t i = 1; i < n; i++)
+          block_index[i] = index += gaps[i - 1];
+        break;
+      case 2:
+        for (tableau_size_t i = 1; i < n; i++) {
+          uint16_t gap;
+          std::memcpy(&gap, gaps + 2 * (i - 1), sizeof(gap));
+          block_index[i] = index += gap;
+        }
+        break;
+      default:
+        for (tableau_size_t i = 1; i < n; i++) {
+          uint32_t gap;
+          std::memcpy(&gap, gaps + 4 * (i - 1), sizeof(gap));
+          block_index[i] = index += gap;
+        }
+        break;
+    }
+    return n;
+  }
+};
@@ -0,0 +1,1398 @@
+#pragma once
+
+#include <stdint.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TABLEAU_X86 1
+#endif
+
+/*
+ * Many of GCC's AVX-512 intrinsics, alignr, the reductions, the gathers and
+ * the 256 bit extracts among them, start from an undefined vector, which
+ * -Wuninitialized and -Wmaybe-uninitialized report in every kernel that
+ * inlines them. Only the AVX-512 code is bracketed by these.
+ */
+#define TABLEAU_AVX512_BEGIN                                                  \
+  _Pragma("GCC diagnostic push")                                              \
+  _Pragma("GCC diagnostic ignored \"-Wuninitialized\"")                       \
+  _Pragma("GCC diagnostic ignored \"-Wmaybe-uninitialized\"")
+#define TABLEAU_AVX512_END _Pragma("GCC diagnostic pop")
+
+/**
+ * Instruction set used by the List kernels. Kernels are compiled for every
+ * level with per-function target attributes and picked at runtime, so the
+ * library does not need to be built with -march flags. SIMD_AVX2 includes
+ * FMA, and SIMD_AVX512 includes SIMD_AVX2.
+ */
+enum SimdLevel {
+  SIMD_SCALAR,
+  SIMD_AVX2,
+  SIMD_AVX512,
+};
+
+/* The best level supported by the running CPU. */
+inline SimdLevel DetectSimdLevel() {
+#ifdef TABLEAU_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma")) {
+    if (__builtin_cpu_supports("avx512f")) return SIMD_AVX512;
+    return SIMD_AVX2;
+  }
+#endif
+  return SIMD_SCALAR;
+}
+
+inline SimdLevel& ActiveSimdLevel() {
+  static SimdLevel level = DetectSimdLevel();
+  return level;
+}
+
+/* The level the kernels dispatch on. */
+inline SimdLevel GetSimdLevel() { return ActiveSimdLevel(); }
+
+/**
+ * Restricts the kernels to level, e.g. to compare against the scalar
+ * fallback. Levels the CPU does not support are clamped to the detected one.
+ * Not thread safe; call it before starting any List operation.
+ */
+inline void SetSimdLevel(SimdLevel level) {
+  ActiveSimdLevel() = std::min(level, DetectSimdLevel());
+}
+
+/**
+ * Calls visit(i, j) for every a[i] == b[j], in increasing order of i. Both
+ * arrays must be strictly increasing. Matches are only reported after the
+ * block holding a[i] has been loaded, so visit may overwrite a[0..i].
+ */
+template <typename I, typename Visitor>
+inline void ScalarIntersect(const I* a, int64_t na, const I* b, int64_t nb,
+                            int64_t i, int64_t j, Visitor& visit) {
+  while (i < na and j < nb) {
+    I left = a[i], right = b[j];
+    if (left == right) visit(i, j);
+    i += left <= right;
+    j += right <= left;
+  }
+}
+
+/**
+ * Operands whose lengths differ by at least this factor are merged by
+ * galloping over the longer one. Zero disables galloping.
+ */
+inline int64_t& ActiveGallopRatio() {
+  static int64_t ratio = 32;
+  return ratio;
+}
+
+inline int64_t GetGallopRatio() { return ActiveGallopRatio(); }
+
+/* Not thread safe; call it before starting any List operation. */
+inline void SetGallopRatio(int64_t ratio) { ActiveGallopRatio() = ratio; }
+
+/* True if a list of length n should be galloped over for one of length m. */
+inline bool ShouldGallop(int64_t n, int64_t m) {
+  int64_t ratio = GetGallopRatio();
+  return ratio > 0 and n / ratio >= std::max<int64_t>(m, 1);
+}
+
+/**
+ * First position p in [lo, n) with a[p] >= key, or n. Probes lo + 1, lo + 3,
+ * lo + 7, ... before a binary search, so finding a key d positions ahead
+ * costs O(log d) instead of O(d).
+ */
+template <typename I>
+inline int64_t GallopLowerBound(const I* a, int64_t lo, int64_t n,
+                                int64_t key) {
+  if (lo >= n or a[lo] >= key) return lo;
+  // Invariant: a[lo] < key and a[hi] >= key, where a[n] counts as infinite.
+  int64_t step = 1, hi = lo + 1;
+  while (hi < n and a[hi] < key) {
+    lo = hi;
+    step <<= 1;
+    hi = lo + step;
+  }
+  if (hi > n) hi = n;
+  while (hi - lo > 1) {
+    int64_t middle = lo + (hi - lo) / 2;
+    if (a[middle] < key)
+      lo = middle;
+    else
+      hi = middle;
+  }
+  return hi;
+}
+
+/*
+ * Intersection for na much smaller than nb, in O(na log(nb / na)). Calls
+ * visit(i, j) like ScalarIntersect.
+ */
+template <typename I, typename Visitor>
+inline void GallopIntersect(const I* a, int64_t na, const I* b, int64_t nb,
+                            Visitor& visit) {
+  int64_t j = 0;
+  for (int64_t i = 0; i < na and j < nb; i++) {
+    j = GallopLowerBound(b, j, nb, a[i]);
+    if (j < nb and b[j] == a[i]) visit(i, j++);
+  }
+}
+
+#ifdef TABLEAU_X86
+/*
+ * The block kernels compare a block of a with every rotation of a block of b,
+ * which finds all matching pairs of the two blocks without branches. The
+ * block whose last element is smaller is then replaced by the next one.
+ */
+template <typename Visitor>
+__attribute__((target("avx2"))) inline void Avx2Intersect(
+    const int64_t* a, int64_t na, const int64_t* b, int64_t nb,
+    Visitor& visit) {
+  // Lane k of rotation r holds b[j + (k + r) % 4].
+  const __m256i rot1 = _mm256_setr_epi64x(1, 2, 3, 0);
+  const __m256i rot2 = _mm256_setr_epi64x(2, 3, 0, 1);
+  const __m256i rot3 = _mm256_setr_epi64x(3, 0, 1, 2);
+  int64_t i = 0, j = 0;
+  while (i + 4 <= na and j + 4 <= nb) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + j));
+    int64_t a_max = a[i + 3], b_max = b[j + 3];
+    __m256i eq0 = _mm256_cmpeq_epi64(va, vb);
+    __m256i eq1 =
+        _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, 0x39));
+    __m256i eq2 =
+        _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, 0x4e));
+    __m256i eq3 =
+        _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, 0x93));
+    __m256i eq =
+        _mm256_or_si256(_mm256_or_si256(eq0, eq1), _mm256_or_si256(eq2, eq3));
+    unsigned mask = _mm256_movemask_pd(_mm256_castsi256_pd(eq));
+    if (mask != 0) {
+      // Offset into the block of b that matched each lane of a.
+      __m256i offset = _mm256_setr_epi64x(0, 1, 2, 3);
+      offset = _mm256_blendv_epi8(offset, rot1, eq1);
+      offset = _mm256_blendv_epi8(offset, rot2, eq2);
+      offset = _mm256_blendv_epi8(offset, rot3, eq3);
+      alignas(32) int64_t offsets[4];
+      _mm256_store_si256(reinterpret_cast<__m256i*>(offsets), offset);
+      do {
+        int k = __builtin_ctz(mask);
+        visit(i + k, j + offsets[k]);
+        mask &= mask - 1;
+      } while (mask != 0);
+    }
+    i += a_max <= b_max ? 4 : 0;
+    j += b_max <= a_max ? 4 : 0;
+  }
+  ScalarIntersect(a, na, b, nb, i, j, visit);
+}
+
+TABLEAU_AVX512_BEGIN
+template <typename Visitor>
+__attribute__((target("avx512f"))) inline void Avx512Intersect(
+    const int64_t* a, int64_t na, const int64_t* b, int64_t nb,
+    Visitor& visit) {
+  const __m512i iota = _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+  int64_t i = 0, j = 0;
+  while (i + 8 <= na and j + 8 <= nb) {
+    __m512i va = _mm512_loadu_si512(a + i);
+    __m512i vb = _mm512_loadu_si512(b + j);
+    int64_t a_max = a[i + 7], b_max = b[j + 7];
+    // Lane k of rotation r holds b[j + (k + r) % 8], and offset collects
+    // (k + r) % 8 for the rotation that matched lane k.
+    __m512i offset = iota;
+    __mmask8 mask = _mm512_cmpeq_epi64_mask(va, vb);
+#define TABLEAU_AVX512_ROTATION(r)                                     \
+  {                                                                    \
+    __mmask8 eq =                                                      \
+        _mm512_cmpeq_epi64_mask(va, _mm512_alignr_epi64(vb, vb, r));   \
+    offset = _mm512_mask_mov_epi64(offset, eq,                         \
+                                   _mm512_alignr_epi64(iota, iota, r)); \
+    mask |= eq;                                                        \
+  }
+    TABLEAU_AVX512_ROTATION(1)
+    TABLEAU_AVX512_ROTATION(2)
+    TABLEAU_AVX512_ROTATION(3)
+    TABLEAU_AVX512_ROTATION(4)
+    TABLEAU_AVX512_ROTATION(5)
+    TABLEAU_AVX512_ROTATION(6)
+    TABLEAU_AVX512_ROTATION(7)
+#undef TABLEAU_AVX512_ROTATION
+    if (mask != 0) {
+      alignas(64) int64_t offsets[8];
+      _mm512_store_si512(offsets, offset);
+      unsigned bits = mask;
+      do {
+        int k = __builtin_ctz(bits);
+        visit(i + k, j + offsets[k]);
+        bits &= bits - 1;
+      } while (bits != 0);
+    }
+    i += a_max <= b_max ? 8 : 0;
+    j += b_max <= a_max ? 8 : 0;
+  }
+  ScalarIntersect(a, na, b, nb, i, j, visit);
+}
+TABLEAU_AVX512_END
+
+/* The same for 32 bit indices, with twice the lanes per block. */
+template <typename Visitor>
+__attribute__((target("avx2"))) inline void Avx2Intersect(
+    const uint32_t* a, int64_t na, const uint32_t* b, int64_t nb,
+    Visitor& visit) {
+  int64_t i = 0, j = 0;
+  while (i + 8 <= na and j + 8 <= nb) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + j));
+    uint32_t a_max = a[i + 7], b_max = b[j + 7];
+    // Lane k of rotation r holds b[j + rotation[k]], for rotation[k] equal
+    // to (k + r) % 8, so rotation is also the offset of the matched lane.
+    __m256i rotation = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i step = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+    __m256i offset = rotation, eq = _mm256_cmpeq_epi32(va, vb);
+    for (int r = 1; r < 8; r++) {
+      rotation = _mm256_permutevar8x32_epi32(rotation, step);
+      __m256i eq_r =
+          _mm256_cmpeq_epi32(va, _mm256_permutevar8x32_epi32(vb, rotation));
+      offset = _mm256_blendv_epi8(offset, rotation, eq_r);
+      eq = _mm256_or_si256(eq, eq_r);
+    }
+    unsigned mask = _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+    if (mask != 0) {
+      alignas(32) int32_t offsets[8];
+      _mm256_store_si256(reinterpret_cast<__m256i*>(offsets), offset);
+      do {
+        int k = __builtin_ctz(mask);
+        visit(i + k, j + offsets[k]);
+        mask &= mask - 1;
+      } while (mask != 0);
+    }
+    i += a_max <= b_max ? 8 : 0;
+    j += b_max <= a_max ? 8 : 0;
+  }
+  ScalarIntersect(a, na, b, nb, i, j, visit);
+}
+
+TABLEAU_AVX512_BEGIN
+template <typename Visitor>
+__attribute__((target("avx512f"))) inline void Avx512Intersect(
+    const uint32_t* a, int64_t na, const uint32_t* b, int64_t nb,
+    Visitor& visit) {
+  const __m512i iota =
+      _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  int64_t i = 0, j = 0;
+  while (i + 16 <= na and j + 16 <= nb) {
+    __m512i va = _mm512_loadu_si512(a + i);
+    __m512i vb = _mm512_loadu_si512(b + j);
+    uint32_t a_max = a[i + 15], b_max = b[j + 15];
+    __m512i offset = iota;
+    __mmask16 mask = _mm512_cmpeq_epi32_mask(va, vb);
+#define TABLEAU_AVX512_ROTATION(r)                                     \
+  {                                                                    \
+    __mmask16 eq =                                                     \
+        _mm512_cmpeq_epi32_mask(va, _mm512_alignr_epi32(vb, vb, r));   \
+    offset = _mm512_mask_mov_epi32(offset, eq,                         \
+                                   _mm512_alignr_epi32(iota, iota, r)); \
+    mask |= eq;                                                        \
+  }
+    TABLEAU_AVX512_ROTATION(1)
+    TABLEAU_AVX512_ROTATION(2)
+    TABLEAU_AVX512_ROTATION(3)
+    TABLEAU_AVX512_ROTATION(4)
+    TABLEAU_AVX512_ROTATION(5)
+    TABLEAU_AVX512_ROTATION(6)
+    TABLEAU_AVX512_ROTATION(7)
+    TABLEAU_AVX512_ROTATION(8)
+    TABLEAU_AVX512_ROTATION(9)
+    TABLEAU_AVX512_ROTATION(10)
+    TABLEAU_AVX512_ROTATION(11)
+    TABLEAU_AVX512_ROTATION(12)
+    TABLEAU_AVX512_ROTATION(13)
+    TABLEAU_AVX512_ROTATION(14)
+    TABLEAU_AVX512_ROTATION(15)
+#undef TABLEAU_AVX512_ROTATION
+    if (mask != 0) {
+      alignas(64) int32_t offsets[16];
+      _mm512_store_si512(offsets, offset);
+      unsigned bits = mask;
+      do {
+        int k = __builtin_ctz(bits);
+        visit(i + k, j + offsets[k]);
+        bits &= bits - 1;
+      } while (bits != 0);
+    }
+    i += a_max <= b_max ? 16 : 0;
+    j += b_max <= a_max ? 16 : 0;
+  }
+  ScalarIntersect(a, na, b, nb, i, j, visit);
+}
+TABLEAU_AVX512_END
+#endif
+
+/* True for the index types that have vectorized sparse kernels. */
+template <typename I>
+constexpr bool HasSimdIndexKernels() {
+  return std::is_same<I, int64_t>::value or std::is_same<I, uint32_t>::value;
+}
+
+/**
+ * Sorted index intersection for SPARSE x SPARSE Dot and Mul. Skewed operands
+ * are galloped over, everything else is dispatched on GetSimdLevel(). See
+ * ScalarIntersect for the contract of visit.
+ */
+template <typename I, typename Visitor>
+inline void SparseIntersect(const I* a, int64_t na, const I* b, int64_t nb,
+                            Visitor visit) {
+  if (ShouldGallop(nb, na)) return GallopIntersect(a, na, b, nb, visit);
+  if (ShouldGallop(na, nb)) {
+    // Matches are increasing in both arrays, so visiting in the order of b
+    // keeps i increasing.
+    auto swapped = [&](int64_t j, int64_t i) { visit(i, j); };
+    return GallopIntersect(b, nb, a, na, swapped);
+  }
+#ifdef TABLEAU_X86
+  if constexpr (HasSimdIndexKernels<I>()) {
+    switch (GetSimdLevel()) {
+      case SIMD_AVX512:
+        return Avx512Intersect(a, na, b, nb, visit);
+      case SIMD_AVX2:
+        return Avx2Intersect(a, na, b, nb, visit);
+      default:
+        break;
+    }
+  }
+#endif
+  ScalarIntersect(a, na, b, nb, 0, 0, visit);
+}
+
+/*
+ * Dense kernels. The generic versions keep four independent accumulators so
+ * Dot is not bound by the latency of a single add chain, float and double
+ * additionally get AVX2+FMA and AVX-512 versions.
+ */
+template <typename T>
+inline T ScalarDenseDot(const T* a, const T* b, int64_t n) {
+  T sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+  int64_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    sum0 += a[i] * b[i];
+    sum1 += a[i + 1] * b[i + 1];
+    sum2 += a[i + 2] * b[i + 2];
+    sum3 += a[i + 3] * b[i + 3];
+  }
+  T product = (sum0 + sum1) + (sum2 + sum3);
+  for (; i < n; i++) product += a[i] * b[i];
+  return product;
+}
+/* y += scale * x */
+template <typename T>
+inline void ScalarDenseAxpy(T* y, const T* x, T scale, int64_t n, bool) {
+  for (int64_t i = 0; i < n; i++) y[i] += scale * x[i];
+}
+/* y *= x, elementwise */
+template <typename T>
+inline void ScalarDenseMul(T* y, const T* x, int64_t n, bool) {
+  for (int64_t i = 0; i < n; i++) y[i] *= x[i];
+}
+template <typename T>
+inline void ScalarDenseScale(T* y, T scale, int64_t n, bool) {
+  for (int64_t i = 0; i < n; i++) y[i] *= scale;
+}
+/* The pricing score of element i, see DenseArgMaxScore. */
+template <typename T>
+inline T ScalarPriceScore(const T* d, const T* sign, const T* weight,
+                          T tolerance, int64_t i) {
+  T gain = d[i] * sign[i];
+  if (not(gain > tolerance)) return 0;
+  return weight == nullptr ? gain * gain : gain * gain / weight[i];
+}
+template <typename T>
+inline std::pair<int64_t, T> ScalarDenseArgMaxScore(const T* d, const T* sign,
+                                                    const T* weight,
+                                                    T tolerance, int64_t n) {
+  std::pair<int64_t, T> best = {-1, 0};
+  for (int64_t i = 0; i < n; i++) {
+    T score = ScalarPriceScore(d, sign, weight, tolerance, i);
+    if (score > best.second) best = {i, score};
+  }
+  return best;
+}
+/* The passes of the Harris ratio test, see DenseHarrisBound. */
+template <typename T>
+inline T ScalarDenseHarrisBound(const T* alpha, const T* down, const T* up,
+                                T pivot_tolerance, T harris_tolerance,
+                                int64_t n) {
+  T bound = std::numeric_limits<T>::infinity();
+  for (int64_t i = 0; i < n; i++) {
+    T rate = std::abs(alpha[i]);
+    if (not(rate > pivot_tolerance)) continue;
+    T room = alpha[i] > 0 ? down[i] : up[i];
+    bound = std::min(bound, (room + harris_tolerance) / rate);
+  }
+  return bound;
+}
+/* The score of element i in the second pass: |alpha[i]| or 0. */
+template <typename T>
+inline T ScalarHarrisScore(const T* alpha, const T* down, const T* up,
+                           T pivot_tolerance, T bound, int64_t i) {
+  T rate = std::abs(alpha[i]);
+  if (not(rate > pivot_tolerance)) return 0;
+  T room = alpha[i] > 0 ? down[i] : up[i];
+  return room > bound * rate ? 0 : rate;
+}
+template <typename T>
+inline std::pair<int64_t, T> ScalarDenseHarrisChoose(const T* alpha,
+                                                     const T* down,
+                                                     const T* up,
+                                                     T pivot_tolerance,
+                                                     T bound, int64_t n) {
+  std::pair<int64_t, T> best = {-1, 0};
+  for (int64_t i = 0; i < n; i++) {
+    T score = ScalarHarrisScore(alpha, down, up, pivot_tolerance, bound, i);
+    if (score > best.second) best = {i, score};
+  }
+  return best;
+}
+
+/*
+ * Outputs of at least this many bytes are written with non-temporal stores,
+ * if they are aligned to the vector width and the caller passes stream, so
+ * that streaming over a vector larger than the last level cache does not
+ * evict the rest of the working set. Only for outputs that are not read
+ * again soon: an accumulator that is added into over and over would miss
+ * on every line.
+ */
+constexpr int64_t kStreamingStoreBytes = int64_t(1) << 25;
+
+#ifdef TABLEAU_X86
+#define TABLEAU_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TABLEAU_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+
+/* Vector operations the dense kernels are written against. */
+template <typename T>
+struct Avx2Vector;
+template <typename T>
+struct Avx512Vector;
+
+template <>
+struct Avx2Vector<float> {
+  typedef float T;
+  typedef __m256 V;
+  static constexpr int kWidth = 8;
+  TABLEAU_TARGET_AVX2 static V Zero() { return _mm256_setzero_ps(); }
+  TABLEAU_TARGET_AVX2 static V Set1(T x) { return _mm256_set1_ps(x); }
+  TABLEAU_TARGET_AVX2 static V Load(const T* p) { return _mm256_loadu_ps(p); }
+  TABLEAU_TARGET_AVX2 static void Store(T* p, V v) { _mm256_storeu_ps(p, v); }
+  TABLEAU_TARGET_AVX2 static void Stream(T* p, V v) { _mm256_stream_ps(p, v); }
+  /* The first n < kWidth lanes. */
+  TABLEAU_TARGET_AVX2 static __m256i Mask(int n) {
+    return _mm256_cmpgt_epi32(_mm256_set1_epi32(n),
+                              _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+  }
+  TABLEAU_TARGET_AVX2 static V LoadPartial(const T* p, int n) {
+    return _mm256_maskload_ps(p, Mask(n));
+  }
+  TABLEAU_TARGET_AVX2 static void StorePartial(T* p, V v, int n) {
+    _mm256_maskstore_ps(p, Mask(n), v);
+  }
+  TABLEAU_TARGET_AVX2 static V Add(V a, V b) { return _mm256_add_ps(a, b); }
+  TABLEAU_TARGET_AVX2 static V Mul(V a, V b) { return _mm256_mul_ps(a, b); }
+  TABLEAU_TARGET_AVX2 static V Div(V a, V b) { return _mm256_div_ps(a, b); }
+  TABLEAU_TARGET_AVX2 static V Max(V a, V b) { return _mm256_max_ps(a, b); }
+  TABLEAU_TARGET_AVX2 static V Min(V a, V b) { return _mm256_min_ps(a, b); }
+  TABLEAU_TARGET_AVX2 static V Abs(V a) {
+    return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a);
+  }
+  /* x where a > b, zero elsewhere. */
+  TABLEAU_TARGET_AVX2 static V KeepGreater(V a, V b, V x) {
+    return _mm256_and_ps(_mm256_cmp_ps(a, b, _CMP_GT_OQ), x);
+  }
+  /* x where a > b, y elsewhere. */
+  TABLEAU_TARGET_AVX2 static V SelectGreater(V a, V b, V x, V y) {
+    return _mm256_blendv_ps(y, x, _mm256_cmp_ps(a, b, _CMP_GT_OQ));
+  }
+  TABLEAU_TARGET_AVX2 static V Fma(V a, V b, V c) {
+    return _mm256_fmadd_ps(a, b, c);
+  }
+  TABLEAU_TARGET_AVX2 static T Sum(V v) {
+    __m128 x =
+        _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_add_ss(x, _mm_shuffle_ps(x, x, 1));
+    return _mm_cvtss_f32(x);
+  }
+  TABLEAU_TARGET_AVX2 static T ReduceMax(V v) {
+    __m128 x =
+        _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    x = _mm_max_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_max_ss(x, _mm_shuffle_ps(x, x, 1));
+    return _mm_cvtss_f32(x);
+  }
+  TABLEAU_TARGET_AVX2 static T ReduceMin(V v) {
+    __m128 x =
+        _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    x = _mm_min_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_min_ss(x, _mm_shuffle_ps(x, x, 1));
+    return _mm_cvtss_f32(x);
+  }
+};
+
+template <>
+struct Avx2Vector<double> {
+  typedef double T;
+  typedef __m256d V;
+  static constexpr int kWidth = 4;
+  TABLEAU_TARGET_AVX2 static V Zero() { return _mm256_setzero_pd(); }
+  TABLEAU_TARGET_AVX2 static V Set1(T x) { return _mm256_set1_pd(x); }
+  TABLEAU_TARGET_AVX2 static V Load(const T* p) { return _mm256_loadu_pd(p); }
+  TABLEAU_TARGET_AVX2 static void Store(T* p, V v) { _mm256_storeu_pd(p, v); }
+  TABLEAU_TARGET_AVX2 static void Stream(T* p, V v) { _mm256_stream_pd(p, v); }
+  TABLEAU_TARGET_AVX2 static __m256i Mask(int n) {
+    return _mm256_cmpgt_epi64(_mm256_set1_epi64x(n),
+                              _mm256_setr_epi64x(0, 1, 2, 3));
+  }
+  TABLEAU_TARGET_AVX2 static V LoadPartial(const T* p, int n) {
+    return _mm256_maskload_pd(p, Mask(n));
+  }
+  TABLEAU_TARGET_AVX2 static void StorePartial(T* p, V v, int n) {
+    _mm256_maskstore_pd(p, Mask(n), v);
+  }
+  TABLEAU_TARGET_AVX2 static V Add(V a, V b) { return _mm256_add_pd(a, b); }
+  TABLEAU_TARGET_AVX2 static V Mul(V a, V b) { return _mm256_mul_pd(a, b); }
+  TABLEAU_TARGET_AVX2 static V Div(V a, V b) { return _mm256_div_pd(a, b); }
+  TABLEAU_TARGET_AVX2 static V Max(V a, V b) { return _mm256_max_pd(a, b); }
+  TABLEAU_TARGET_AVX2 static V Min(V a, V b) { return _mm256_min_pd(a, b); }
+  TABLEAU_TARGET_AVX2 static V Abs(V a) {
+    return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a);
+  }
+  TABLEAU_TARGET_AVX2 static V KeepGreater(V a, V b, V x) {
+    return _mm256_and_pd(_mm256_cmp_pd(a, b, _CMP_GT_OQ), x);
+  }
+  TABLEAU_TARGET_AVX2 static V SelectGreater(V a, V b, V x, V y) {
+    return _mm256_blendv_pd(y, x, _mm256_cmp_pd(a, b, _CMP_GT_OQ));
+  }
+  TABLEAU_TARGET_AVX2 static V Fma(V a, V b, V c) {
+    return _mm256_fmadd_pd(a, b, c);
+  }
+  TABLEAU_TARGET_AVX2 static T Sum(V v) {
+    __m128d x =
+        _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    x = _mm_add_sd(x, _mm_unpackhi_pd(x, x));
+    return _mm_cvtsd_f64(x);
+  }
+  TABLEAU_TARGET_AVX2 static T ReduceMax(V v) {
+    __m128d x =
+        _mm_max_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    x = _mm_max_sd(x, _mm_unpackhi_pd(x, x));
+    return _mm_cvtsd_f64(x);
+  }
+  TABLEAU_TARGET_AVX2 static T ReduceMin(V v) {
+    __m128d x =
+        _mm_min_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    x = _mm_min_sd(x, _mm_unpackhi_pd(x, x));
+    return _mm_cvtsd_f64(x);
+  }
+};
+
+TABLEAU_AVX512_BEGIN
+template <>
+struct Avx512Vector<float> {
+  typedef float T;
+  typedef __m512 V;
+  static constexpr int kWidth = 16;
+  TABLEAU_TARGET_AVX512 static V Zero() { return _mm512_setzero_ps(); }
+  TABLEAU_TARGET_AVX512 static V Set1(T x) { return _mm512_set1_ps(x); }
+  TABLEAU_TARGET_AVX512 static V Load(const T* p) { return _mm512_loadu_ps(p); }
+  TABLEAU_TARGET_AVX512 static void Store(T* p, V v) { _mm512_storeu_ps(p, v); }
+  TABLEAU_TARGET_AVX512 static void Stream(T* p, V v) {
+    _mm512_stream_ps(p, v);
+  }
+  TABLEAU_TARGET_AVX512 static V LoadPartial(const T* p, int n) {
+    return _mm512_maskz_loadu_ps(__mmask16((1u << n) - 1), p);
+  }
+  TABLEAU_TARGET_AVX512 static void StorePartial(T* p, V v, int n) {
+    _mm512_mask_storeu_ps(p, __mmask16((1u << n) - 1), v);
+  }
+  TABLEAU_TARGET_AVX512 static V Add(V a, V b) { return _mm512_add_ps(a, b); }
+  TABLEAU_TARGET_AVX512 static V Mul(V a, V b) { return _mm512_mul_ps(a, b); }
+  TABLEAU_TARGET_AVX512 static V Div(V a, V b) { return _mm512_div_ps(a, b); }
+  TABLEAU_TARGET_AVX512 static V Max(V a, V b) { return _mm512_max_ps(a, b); }
+  TABLEAU_TARGET_AVX512 static V Min(V a, V b) { return _mm512_min_ps(a, b); }
+  TABLEAU_TARGET_AVX512 static V Abs(V a) { return _mm512_abs_ps(a); }
+  TABLEAU_TARGET_AVX512 static V KeepGreater(V a, V b, V x) {
+    return _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(a, b, _CMP_GT_OQ), x);
+  }
+  TABLEAU_TARGET_AVX512 static V SelectGreater(V a, V b, V x, V y) {
+    return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(a, b, _CMP_GT_OQ), y, x);
+  }
+  TABLEAU_TARGET_AVX512 static V Fma(V a, V b, V c) {
+    return _mm512_fmadd_ps(a, b, c);
+  }
+  TABLEAU_TARGET_AVX512 static T Sum(V v) { return _mm512_reduce_add_ps(v); }
+  TABLEAU_TARGET_AVX512 static T ReduceMax(V v) {
+    return _mm512_reduce_max_ps(v);
+  }
+  TABLEAU_TARGET_AVX512 static T ReduceMin(V v) {
+    return _mm512_reduce_min_ps(v);
+  }
+};
+
+template <>
+struct Avx512Vector<double> {
+  typedef double T;
+  typedef __m512d V;
+  static constexpr int kWidth = 8;
+  TABLEAU_TARGET_AVX512 static V Zero() { return _mm512_setzero_pd(); }
+  TABLEAU_TARGET_AVX512 static V Set1(T x) { return _mm512_set1_pd(x); }
+  TABLEAU_TARGET_AVX512 static V Load(const T* p) { return _mm512_loadu_pd(p); }
+  TABLEAU_TARGET_AVX512 static void Store(T* p, V v) { _mm512_storeu_pd(p, v); }
+  TABLEAU_TARGET_AVX512 static void Stream(T* p, V v) {
+    _mm512_stream_pd(p, v);
+  }
+  TABLEAU_TARGET_AVX512 static V LoadPartial(const T* p, int n) {
+    return _mm512_maskz_loadu_pd(__mmask8((1u << n) - 1), p);
+  }
+  TABLEAU_TARGET_AVX512 static void StorePartial(T* p, V v, int n) {
+    _mm512_mask_storeu_pd(p, __mmask8((1u << n) - 1), v);
+  }
+  TABLEAU_TARGET_AVX512 static V Add(V a, V b) { return _mm512_add_pd(a, b); }
+  TABLEAU_TARGET_AVX512 static V Mul(V a, V b) { return _mm512_mul_pd(a, b); }
+  TABLEAU_TARGET_AVX512 static V Div(V a, V b) { return _mm512_div_pd(a, b); }
+  TABLEAU_TARGET_AVX512 static V Max(V a, V b) { return _mm512_max_pd(a, b); }
+  TABLEAU_TARGET_AVX512 static V Min(V a, V b) { return _mm512_min_pd(a, b); }
+  TABLEAU_TARGET_AVX512 static V Abs(V a) { return _mm512_abs_pd(a); }
+  TABLEAU_TARGET_AVX512 static V KeepGreater(V a, V b, V x) {
+    return _mm512_maskz_mov_pd(_mm512_cmp_pd_mask(a, b, _CMP_GT_OQ), x);
+  }
+  TABLEAU_TARGET_AVX512 static V SelectGreater(V a, V b, V x, V y) {
+    return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(a, b, _CMP_GT_OQ), y, x);
+  }
+  TABLEAU_TARGET_AVX512 static V Fma(V a, V b, V c) {
+    return _mm512_fmadd_pd(a, b, c);
+  }
+  TABLEAU_TARGET_AVX512 static T Sum(V v) { return _mm512_reduce_add_pd(v); }
+  TABLEAU_TARGET_AVX512 static T ReduceMax(V v) {
+    return _mm512_reduce_max_pd(v);
+  }
+  TABLEAU_TARGET_AVX512 static T ReduceMin(V v) {
+    return _mm512_reduce_min_pd(v);
+  }
+};
+TABLEAU_AVX512_END
+
+/*
+ * The kernel bodies are the same for every instruction set, but the target
+ * attribute cannot be a template parameter, so they are stamped out once per
+ * level. Vec is one of the vector structs above.
+ */
+#define TABLEAU_DENSE_KERNELS(Prefix, Target)                                 \
+  template <typename Vec>                                                     \
+  Target inline typename Vec::T Prefix##DenseDot(                             \
+      const typename Vec::T* a, const typename Vec::T* b, int64_t n) {        \
+    constexpr int W = Vec::kWidth;                                            \
+    typename Vec::V sum0 = Vec::Zero(), sum1 = Vec::Zero(),                   \
+                    sum2 = Vec::Zero(), sum3 = Vec::Zero();                   \
+    int64_t i = 0;                                                            \
+    for (; i + 4 * W <= n; i += 4 * W) {                                      \
+      sum0 = Vec::Fma(Vec::Load(a + i), Vec::Load(b + i), sum0);              \
+      sum1 = Vec::Fma(Vec::Load(a + i + W), Vec::Load(b + i + W), sum1);      \
+      sum2 = Vec::Fma(Vec::Load(a + i + 2 * W), Vec::Load(b + i + 2 * W),     \
+                      sum2);                                                  \
+      sum3 = Vec::Fma(Vec::Load(a + i + 3 * W), Vec::Load(b + i + 3 * W),     \
+                      sum3);                                                  \
+    }                                                                         \
+    for (; i + W <= n; i += W)                                                \
+      sum0 = Vec::Fma(Vec::Load(a + i), Vec::Load(b + i), sum0);              \
+    typename Vec::T product =                                                 \
+        Vec::Sum(Vec::Add(Vec::Add(sum0, sum1), Vec::Add(sum2, sum3)));       \
+    for (; i < n; i++) product += a[i] * b[i];                                \
+    return product;                                                           \
+  }                                                                           \
+  template <typename Vec>                                                     \
+  Target inline bool Prefix##ShouldStream(typename Vec::T* y, int64_t n,      \
+                                          bool stream) {                      \
+    return stream and                                                         \
+           n * int64_t(sizeof(typename Vec::T)) >= kStreamingStoreBytes and   \
+           reinterpret_cast<uintptr_t>(y) % sizeof(typename Vec::V) == 0;     \
+  }                                                                           \
+  template <typename Vec>                                                     \
+  Target inline void Prefix##DenseAxpy(typename Vec::T* y,                    \
+                                       const typename Vec::T* x,              \
+                                       typename Vec::T scale, int64_t n,      \
+                                       bool stream) {                         \
+    constexpr int W = Vec::kWidth;                                            \
+    typename Vec::V s = Vec::Set1(scale);                                     \
+    int64_t i = 0;                                                            \
+    if (Prefix##ShouldStream<Vec>(y, n, stream)) {                            \
+      for (; i + W <= n; i += W)                                              \
+        Vec::Stream(y + i, Vec::Fma(s, Vec::Load(x + i), Vec::Load(y + i)));  \
+      _mm_sfence();                                                           \
+    }                                                                         \
+    for (; i + W <= n; i += W)                                                \
+      Vec::Store(y + i, Vec::Fma(s, Vec::Load(x + i), Vec::Load(y + i)));     \
+    for (; i < n; i++) y[i] += scale * x[i];                                  \
+  }                                                                           \
+  template <typename Vec>                                                     \
+  Target inline void Prefix##DenseMul(typename Vec::T* y,                     \
+                                      const typename Vec::T* x, int64_t n,    \
+                                      bool stream) {                          \
+    constexpr int W = Vec::kWidth;                                            \
+    int64_t i = 0;                                                            \
+    if (Prefix##ShouldStream<Vec>(y, n, stream)) {                            \
+      for (; i + W <= n; i += W)                                              \
+        Vec::Stream(y + i, Vec::Mul(Vec::Load(y + i), Vec::Load(x + i)));     \
+      _mm_sfence();                                                           \
+    }                                                                         \
+    for (; i + W <= n; i += W)                                                \
+      Vec::Store(y + i, Vec::Mul(Vec::Load(y + i), Vec::Load(x + i)));        \
+    for (; i < n; i++) y[i] *= x[i];                                          \
+  }                                                                           \
+  template <typename Vec>                                                     \
+  Target inline void Prefix##DenseScale(typename Vec::T* y,                   \
+                                        typename Vec::T scale, int64_t n,     \
+                                        bool stream) {                        \
+    constexpr int W = Vec::kWidth;                                            \
+    typename Vec::V s = Vec::Set1(scale);                                     \
+    int64_t i = 0;                                                            \
+    if (Prefix##ShouldStream<Vec>(y, n, stream)) {                            \
+      for (; i + W <= n; i += W)                                              \
+        Vec::Stream(y + i, Vec::Mul(Vec::Load(y + i), s));                    \
+      _mm_sfence();                                                           \
+    }                                                                         \
+    for (; i + W <= n; i += W)                                                \
+      Vec::Store(y + i, Vec::Mul(Vec::Load(y + i), s));                       \
+    for (; i < n; i++) y[i] *= scale;                                         \
+  }                                                                           \
+  template <typename Vec>                                                     \
+  Target inline typename Vec::V Prefix##PriceScore(                           \
+      const typename Vec::T* d, const typename Vec::T* sign,                  \
+      const typename Vec::T* weight, typename Vec::V tolerance, int64_t i) {  \
+    typename Vec::V gain = Vec::Mul(Vec::Load(d + i), Vec::Load(sign + i));   \
+    typename Vec::V score = Vec::Mul(gain, gain);                             \
+    if (weight != nullptr) score = Vec::Div(score, Vec::Load(weight + i));    \
+    return Vec::KeepGreater(gain, tolerance, score);                          \
+  }                                                                           \
+  /* Blocks whose maximum beats the best so far are scanned again, in the  */ \
+  /* cache, for its index, which is rare after the first few blocks.       */ \
+  template <typename Vec>                                                     \
+  Target inline std::pair<int64_t, typename Vec::T> Prefix##DenseArgMaxScore( \
+      const typename Vec::T* d, const typename Vec::T* sign,                  \
+      const typename Vec::T* weight, typename Vec::T tolerance, int64_t n) {  \
+    constexpr int W = Vec::kWidth;                                            \
+    constexpr int64_t kBlock = 16 * W;                                        \
+    typename Vec::V t = Vec::Set1(tolerance);                                 \
+    std::pair<int64_t, typename Vec::T> best = {-1, 0};                       \
+    int64_t i = 0;                                                            \
+    for (; i + kBlock <= n; i += kBlock) {                                    \
+      typename Vec::V max0 = Vec::Zero(), max1 = Vec::Zero();                 \
+      for (int64_t k = i; k < i + kBlock; k += 2 * W) {                       \
+        max0 =                                                                \
+            Vec::Max(max0, Prefix##PriceScore<Vec>(d, sign, weight, t, k));   \
+        max1 = Vec::Max(max1,                                                 \
+                        Prefix##PriceScore<Vec>(d, sign, weight, t, k + W));  \
+      }                                                                       \
+      if (not(Vec::ReduceMax(Vec::Max(max0, max1)) > best.second)) continue;  \
+      for (int64_t k = i; k < i + kBlock; k++) {                              \
+        typename Vec::T score =                                               \
+            ScalarPriceScore(d, sign, weight, tolerance, k);                  \
+        if (score > best.second) best = {k, score};                           \
+      }                                                                       \
+    }                                                                         \
+    for (; i < n; i++) {                                                      \
+      typename Vec::T score =                                                 \
+          ScalarPriceScore(d, sign, weight, tolerance, i);                    \
+      if (score > best.second) best = {i, score};                             \
+    }                                                                         \
+    return best;                                                              \
+  }                                                                           \
+  template <typename Vec>                                                     \
+  Target inline typename Vec::T Prefix##DenseHarrisBound(                     \
+      const typename Vec::T* alpha, const typename Vec::T* down,              \
+      const typename Vec::T* up, typename Vec::T pivot_tolerance,             \
+      typename Vec::T harris_tolerance, int64_t n) {                          \
+    constexpr int W = Vec::kWidth;                                            \
+    typename Vec::V infinity =                                                \
+        Vec::Set1(std::numeric_limits<typename Vec::T>::infinity());          \
+    typename Vec::V tolerance = Vec::Set1(pivot_tolerance);                   \
+    typename Vec::V relax = Vec::Set1(harris_tolerance);                      \
+    typename Vec::V bound = infinity;                                         \
+    int64_t i = 0;                                                            \
+    for (; i + W <= n; i += W) {                                              \
+      typename Vec::V a = Vec::Load(alpha + i), rate = Vec::Abs(a);           \
+      typename Vec::V room = Vec::SelectGreater(a, Vec::Zero(),               \
+                                                Vec::Load(down + i),          \
+                                                Vec::Load(up + i));           \
+      typename Vec::V ratio = Vec::Div(Vec::Add(room, relax), rate);          \
+      bound = Vec::Min(bound,                                                 \
+                       Vec::SelectGreater(rate, tolerance, ratio, infinity)); \
+    }                                                                         \
+    return std::min(Vec::ReduceMin(bound),                                    \
+                    ScalarDenseHarrisBound(alpha + i, down + i, up + i,       \
+                                           pivot_tolerance, harris_tolerance, \
+                                           n - i));                           \
+  }                                                                           \
+  template <typename Vec>                                                     \
+  Target inline typename Vec::V Prefix##HarrisScore(                          \
+      const typename Vec::T* alpha, const typename Vec::T* down,              \
+      const typename Vec::T* up, typename Vec::V tolerance,                   \
+      typename Vec::V bound, int64_t i) {                                     \
+    typename Vec::V a = Vec::Load(alpha + i), rate = Vec::Abs(a);             \
+    typename Vec::V room = Vec::SelectGreater(a, Vec::Zero(),                 \
+                                              Vec::Load(down + i),            \
+                                              Vec::Load(up + i));             \
+    return Vec::SelectGreater(room, Vec::Mul(bound, rate), Vec::Zero(),       \
+                              Vec::KeepGreater(rate, tolerance, rate));       \
+  }                                                                           \
+  /* Blocked like DenseArgMaxScore. */                                        \
+  template <typename Vec>                                                     \
+  Target inline std::pair<int64_t, typename Vec::T> Prefix##DenseHarrisChoose(\
+      const typename Vec::T* alpha, const typename Vec::T* down,              \
+      const typename Vec::T* up, typename Vec::T pivot_tolerance,             \
+      typename Vec::T bound, int64_t n) {                                     \
+    constexpr int W = Vec::kWidth;                                            \
+    constexpr int64_t kBlock = 16 * W;                                        \
+    typename Vec::V t = Vec::Set1(pivot_tolerance), b = Vec::Set1(bound);     \
+    std::pair<int64_t, typename Vec::T> best = {-1, 0};                       \
+    int64_t i = 0;                                                            \
+    for (; i + kBlock <= n; i += kBlock) {                                    \
+      typename Vec::V max0 = Vec::Zero(), max1 = Vec::Zero();                 \
+      for (int64_t k = i; k < i + kBlock; k += 2 * W) {                       \
+        max0 = Vec::Max(max0, Prefix##HarrisScore<Vec>(alpha, down, up, t, b, \
+                                                       k));                   \
+        max1 = Vec::Max(max1, Prefix##HarrisScore<Vec>(alpha, down, up, t, b, \
+                                                       k + W));               \
+      }                                                                       \
+      if (not(Vec::ReduceMax(Vec::Max(max0, max1)) > best.second)) continue;  \
+      for (int64_t k = i; k < i + kBlock; k++) {                              \
+        typename Vec::T score =                                               \
+            ScalarHarrisScore(alpha, down, up, pivot_tolerance, bound, k);    \
+        if (score > best.second) best = {k, score};                           \
+      }                                                                       \
+    }                                                                         \
+    for (; i < n; i++) {                                                      \
+      typename Vec::T score =                                                 \
+          ScalarHarrisScore(alpha, down, up, pivot_tolerance, bound, i);      \
+      if (score > best.second) best = {i, score};                             \
+    }                                                                         \
+    return best;                                                              \
+  }
+
+TABLEAU_DENSE_KERNELS(Avx2, TABLEAU_TARGET_AVX2)
+TABLEAU_AVX512_BEGIN
+TABLEAU_DENSE_KERNELS(Avx512, TABLEAU_TARGET_AVX512)
+TABLEAU_AVX512_END
+#undef TABLEAU_DENSE_KERNELS
+#endif
+
+/* True for the element types that have vectorized dense kernels. */
+template <typename T>
+constexpr bool HasSimdDenseKernels() {
+  return std::is_same<T, float>::value or std::is_same<T, double>::value;
+}
+
+/*
+ * Dispatches Op on GetSimdLevel(): Avx512, Avx2 or the generic Scalar
+ * version. Used by the Dense* entry points below.
+ */
+#ifdef TABLEAU_X86
+#define TABLEAU_DISPATCH_DENSE(T, Op, ...)                   \
+  if constexpr (HasSimdDenseKernels<T>()) {                  \
+    switch (GetSimdLevel()) {                                \
+      case SIMD_AVX512:                                      \
+        return Avx512##Op<Avx512Vector<T>>(__VA_ARGS__);     \
+      case SIMD_AVX2:                                        \
+        return Avx2##Op<Avx2Vector<T>>(__VA_ARGS__);         \
+      default:                                               \
+        break;                                               \
+    }                                                        \
+  }                                                          \
+  return Scalar##Op(__VA_ARGS__)
+#else
+#define TABLEAU_DISPATCH_DENSE(T, Op, ...) return Scalar##Op(__VA_ARGS__)
+#endif
+
+/* Dot product of two dense arrays of length n. */
+template <typename T>
+inline T DenseDot(const T* a, const T* b, int64_t n) {
+  TABLEAU_DISPATCH_DENSE(T, DenseDot, a, b, n);
+}
+/*
+ * y += scale * x for dense arrays of length n. stream asks for
+ * non-temporal stores, see kStreamingStoreBytes.
+ */
+template <typename T>
+inline void DenseAxpy(T* y, const T* x, T scale, int64_t n,
+                      bool stream = false) {
+  TABLEAU_DISPATCH_DENSE(T, DenseAxpy, y, x, scale, n, stream);
+}
+/* y *= x elementwise for dense arrays of length n. */
+template <typename T>
+inline void DenseMul(T* y, const T* x, int64_t n, bool stream = false) {
+  TABLEAU_DISPATCH_DENSE(T, DenseMul, y, x, n, stream);
+}
+/* y *= scale for a dense array of length n. */
+template <typename T>
+inline void DenseScale(T* y, T scale, int64_t n, bool stream = false) {
+  TABLEAU_DISPATCH_DENSE(T, DenseScale, y, scale, n, stream);
+}
+/**
+ * The pricing scan of the simplex method. Element i scores gain^2 /
+ * weight[i] for gain = d[i] * sign[i] above tolerance and 0 otherwise, and
+ * the result is the first index with the largest score and the score, or
+ * {-1, 0} if none is positive. A null weight stands for all ones.
+ */
+template <typename T>
+inline std::pair<int64_t, T> DenseArgMaxScore(const T* d, const T* sign,
+                                              const T* weight, T tolerance,
+                                              int64_t n) {
+  TABLEAU_DISPATCH_DENSE(T, DenseArgMaxScore, d, sign, weight, tolerance, n);
+}
+/**
+ * The first pass of the Harris ratio test over n basic variables that
+ * decrease at the rates alpha, those with a positive rate having down[i]
+ * to go to their bound and those with a negative rate up[i]. Rates of at
+ * most pivot_tolerance in magnitude are ignored. Returns the smallest step
+ * that takes a basic variable harris_tolerance beyond its bound, or
+ * infinity.
+ */
+template <typename T>
+inline T DenseHarrisBound(const T* alpha, const T* down, const T* up,
+                          T pivot_tolerance, T harris_tolerance, int64_t n) {
+  TABLEAU_DISPATCH_DENSE(T, DenseHarrisBound, alpha, down, up,
+                         pivot_tolerance, harris_tolerance, n);
+}
+/**
+ * The second pass: of the basic variables that reach their bound within a
+ * finite bound, the first with the largest rate, and the rate, or {-1, 0}.
+ */
+template <typename T>
+inline std::pair<int64_t, T> DenseHarrisChoose(const T* alpha, const T* down,
+                                               const T* up, T pivot_tolerance,
+                                               T bound, int64_t n) {
+  TABLEAU_DISPATCH_DENSE(T, DenseHarrisChoose, alpha, down, up,
+                         pivot_tolerance, bound, n);
+}
+#undef TABLEAU_DISPATCH_DENSE
+
+/**
+ * Number of elements the sparse x dense kernels prefetch ahead in the dense
+ * array. Zero disables prefetching.
+ */
+inline int64_t& ActivePrefetchDistance() {
+  static int64_t distance = 64;
+  return distance;
+}
+
+inline int64_t GetPrefetchDistance() { return ActivePrefetchDistance(); }
+
+/* Not thread safe; call it before starting any List operation. */
+inline void SetPrefetchDistance(int64_t distance) {
+  ActivePrefetchDistance() = distance;
+}
+
+/*
+ * Gathers from a span of the dense array smaller than this are served by the
+ * caches or the hardware prefetcher, and software prefetches only cost
+ * instructions.
+ */
+constexpr int64_t kPrefetchMinSpanBytes = int64_t(1) << 22;
+
+/* Size of the last level cache, or 8 MiB if the system does not tell. */
+inline int64_t LastLevelCacheBytes() {
+  static int64_t bytes = [] {
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    for (int level : {_SC_LEVEL3_CACHE_SIZE, _SC_LEVEL2_CACHE_SIZE}) {
+      long size = sysconf(level);
+      if (size > 0) return int64_t(size);
+    }
+#endif
+    return int64_t(8) << 20;
+  }();
+  return bytes;
+}
+
+/* The prefetch distance for gathering n elements at index from T's. */
+template <typename T, typename I>
+inline int64_t GatherPrefetchDistance(const I* index, int64_t n) {
+  if (n == 0 or (int64_t(index[n - 1]) - int64_t(index[0])) *
+                        int64_t(sizeof(T)) <
+                    kPrefetchMinSpanBytes)
+    return 0;
+  return GetPrefetchDistance();
+}
+
+/*
+ * Prefetches dense[index[i + distance]], clamped to the last element so the
+ * index array is never read out of bounds.
+ */
+#define TABLEAU_PREFETCH_GATHER(dense, index, i, distance, n, rw) \
+  __builtin_prefetch(                                             \
+      (dense) + (index)[std::min<int64_t>((i) + (distance), (n) - 1)], (rw))
+
+/*
+ * Sparse x dense kernels. index and values hold n sparse elements, index is
+ * strictly increasing and every index is inside dense.
+ */
+template <typename T, typename I>
+inline T ScalarGatherDot(const T* values, const I* index, int64_t n,
+                         const T* dense) {
+  int64_t distance = GatherPrefetchDistance<T, I>(index, n);
+  T sum0 = 0, sum1 = 0;
+  int64_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    if (distance > 0) {
+      TABLEAU_PREFETCH_GATHER(dense, index, i, distance, n, 0);
+      TABLEAU_PREFETCH_GATHER(dense, index, i + 1, distance, n, 0);
+    }
+    sum0 += values[i] * dense[index[i]];
+    sum1 += values[i + 1] * dense[index[i + 1]];
+  }
+  T product = sum0 + sum1;
+  for (; i < n; i++) product += values[i] * dense[index[i]];
+  return product;
+}
+/* dense[index[i]] += scale * values[i] */
+template <typename T, typename I>
+inline void ScalarScatterAxpy(T* dense, const I* index, const T* values,
+                              T scale, int64_t n) {
+  int64_t distance = GatherPrefetchDistance<T, I>(index, n);
+  for (int64_t i = 0; i < n; i++) {
+    if (distance > 0) TABLEAU_PREFETCH_GATHER(dense, index, i, distance, n, 1);
+    dense[index[i]] += scale * values[i];
+  }
+}
+
+#ifdef TABLEAU_X86
+/*
+ * The vector versions gather a block of dense values with one instruction
+ * and, on AVX-512, write them back with a scatter. Scatters are safe because
+ * the indices of a block are distinct. AVX2 has no scatter and uses
+ * ScalarScatterAxpy.
+ */
+#define TABLEAU_PREFETCH_BLOCK(dense, index, i, width, distance, n, rw) \
+  if ((distance) > 0)                                                   \
+    for (int k = 0; k < (width); k++)                                   \
+      TABLEAU_PREFETCH_GATHER(dense, index, (i) + k, distance, n, rw);
+
+/* Loads a block of indices as 64 bit lanes for the i64 gathers. */
+TABLEAU_TARGET_AVX2 inline __m256i Avx2LoadIndex(const int64_t* index) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(index));
+}
+TABLEAU_TARGET_AVX2 inline __m256i Avx2LoadIndex(const uint32_t* index) {
+  return _mm256_cvtepu32_epi64(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(index)));
+}
+TABLEAU_AVX512_BEGIN
+TABLEAU_TARGET_AVX512 inline __m512i Avx512LoadIndex(const int64_t* index) {
+  return _mm512_loadu_si512(index);
+}
+TABLEAU_TARGET_AVX512 inline __m512i Avx512LoadIndex(const uint32_t* index) {
+  return _mm512_cvtepu32_epi64(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(index)));
+}
+
+template <typename I>
+TABLEAU_TARGET_AVX2 inline float Avx2GatherDot(const float* values,
+                                               const I* index, int64_t n,
+                                               const float* dense) {
+  int64_t distance = GatherPrefetchDistance<float, I>(index, n);
+  __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    TABLEAU_PREFETCH_BLOCK(dense, index, i, 8, distance, n, 0)
+    __m256i index0 = Avx2LoadIndex(index + i);
+    __m256i index1 = Avx2LoadIndex(index + i + 4);
+    sum0 = _mm_fmadd_ps(_mm_loadu_ps(values + i),
+                        _mm256_i64gather_ps(dense, index0, 4), sum0);
+    sum1 = _mm_fmadd_ps(_mm_loadu_ps(values + i + 4),
+                        _mm256_i64gather_ps(dense, index1, 4), sum1);
+  }
+  __m128 sum = _mm_add_ps(sum0, sum1);
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  float product = _mm_cvtss_f32(sum);
+  for (; i < n; i++) product += values[i] * dense[index[i]];
+  return product;
+}
+
+template <typename I>
+TABLEAU_TARGET_AVX2 inline double Avx2GatherDot(const double* values,
+                                                const I* index, int64_t n,
+                                                const double* dense) {
+  int64_t distance = GatherPrefetchDistance<double, I>(index, n);
+  __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    TABLEAU_PREFETCH_BLOCK(dense, index, i, 8, distance, n, 0)
+    __m256i index0 = Avx2LoadIndex(index + i);
+    __m256i index1 = Avx2LoadIndex(index + i + 4);
+    sum0 = _mm256_fmadd_pd(_mm256_loadu_pd(values + i),
+                           _mm256_i64gather_pd(dense, index0, 8), sum0);
+    sum1 = _mm256_fmadd_pd(_mm256_loadu_pd(values + i + 4),
+                           _mm256_i64gather_pd(dense, index1, 8), sum1);
+  }
+  double product = Avx2Vector<double>::Sum(_mm256_add_pd(sum0, sum1));
+  for (; i < n; i++) product += values[i] * dense[index[i]];
+  return product;
+}
+
+template <typename I>
+TABLEAU_TARGET_AVX512 inline float Avx512GatherDot(const float* values,
+                                                   const I* index, int64_t n,
+                                                   const float* dense) {
+  int64_t distance = GatherPrefetchDistance<float, I>(index, n);
+  __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+  int64_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    TABLEAU_PREFETCH_BLOCK(dense, index, i, 16, distance, n, 0)
+    __m512i index0 = Avx512LoadIndex(index + i);
+    __m512i index1 = Avx512LoadIndex(index + i + 8);
+    sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(values + i),
+                           _mm512_i64gather_ps(index0, dense, 4), sum0);
+    sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(values + i + 8),
+                           _mm512_i64gather_ps(index1, dense, 4), sum1);
+  }
+  float product = Avx2Vector<float>::Sum(_mm256_add_ps(sum0, sum1));
+  for (; i < n; i++) product += values[i] * dense[index[i]];
+  return product;
+}
+
+template <typename I>
+TABLEAU_TARGET_AVX512 inline double Avx512GatherDot(const double* values,
+                                                    const I* index, int64_t n,
+                                                    const double* dense) {
+  int64_t distance = GatherPrefetchDistance<double, I>(index, n);
+  __m512d sum0 = _mm512_setzero_pd(), sum1 = _mm512_setzero_pd();
+  int64_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    TABLEAU_PREFETCH_BLOCK(dense, index, i, 16, distance, n, 0)
+    __m512i index0 = Avx512LoadIndex(index + i);
+    __m512i index1 = Avx512LoadIndex(index + i + 8);
+    sum0 = _mm512_fmadd_pd(_mm512_loadu_pd(values + i),
+                           _mm512_i64gather_pd(index0, dense, 8), sum0);
+    sum1 = _mm512_fmadd_pd(_mm512_loadu_pd(values + i + 8),
+                           _mm512_i64gather_pd(index1, dense, 8), sum1);
+  }
+  double product = _mm512_reduce_add_pd(_mm512_add_pd(sum0, sum1));
+  for (; i < n; i++) product += values[i] * dense[index[i]];
+  return product;
+}
+
+template <typename I>
+TABLEAU_TARGET_AVX512 inline void Avx512ScatterAxpy(float* dense,
+                                                    const I* index,
+                                                    const float* values,
+                                                    float scale, int64_t n) {
+  int64_t distance = GatherPrefetchDistance<float, I>(index, n);
+  __m256 s = _mm256_set1_ps(scale);
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    TABLEAU_PREFETCH_BLOCK(dense, index, i, 8, distance, n, 1)
+    __m512i block = Avx512LoadIndex(index + i);
+    __m256 sum = _mm256_fmadd_ps(s, _mm256_loadu_ps(values + i),
+                                 _mm512_i64gather_ps(block, dense, 4));
+    _mm512_i64scatter_ps(dense, block, sum, 4);
+  }
+  for (; i < n; i++) dense[index[i]] += scale * values[i];
+}
+
+template <typename I>
+TABLEAU_TARGET_AVX512 inline void Avx512ScatterAxpy(double* dense,
+                                                    const I* index,
+                                                    const double* values,
+                                                    double scale, int64_t n) {
+  int64_t distance = GatherPrefetchDistance<double, I>(index, n);
+  __m512d s = _mm512_set1_pd(scale);
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    TABLEAU_PREFETCH_BLOCK(dense, index, i, 8, distance, n, 1)
+    __m512i block = Avx512LoadIndex(index + i);
+    __m512d sum = _mm512_fmadd_pd(s, _mm512_loadu_pd(values + i),
+                                  _mm512_i64gather_pd(block, dense, 8));
+    _mm512_i64scatter_pd(dense, block, sum, 8);
+  }
+  for (; i < n; i++) dense[index[i]] += scale * values[i];
+}
+TABLEAU_AVX512_END
+#undef TABLEAU_PREFETCH_BLOCK
+#endif
+
+/* Sum of values[i] * dense[index[i]]. */
+template <typename T, typename I>
+inline T GatherDot(const T* values, const I* index, int64_t n,
+                   const T* dense) {
+#ifdef TABLEAU_X86
+  if constexpr (HasSimdDenseKernels<T>() and HasSimdIndexKernels<I>()) {
+    switch (GetSimdLevel()) {
+      case SIMD_AVX512:
+        return Avx512GatherDot(values, index, n, dense);
+      case SIMD_AVX2:
+        return Avx2GatherDot(values, index, n, dense);
+      default:
+        break;
+    }
+  }
+#endif
+  return ScalarGatherDot(values, index, n, dense);
+}
+/* dense[index[i]] += scale * values[i] */
+template <typename T, typename I>
+inline void ScatterAxpy(T* dense, const I* index, const T* values, T scale,
+                        int64_t n) {
+#ifdef TABLEAU_X86
+  if constexpr (HasSimdDenseKernels<T>() and HasSimdIndexKernels<I>()) {
+    if (GetSimdLevel() == SIMD_AVX512)
+      return Avx512ScatterAxpy(dense, index, values, scale, n);
+  }
+#endif
+  ScalarScatterAxpy(dense, index, values, scale, n);
+}
+#undef TABLEAU_PREFETCH_GATHER
+
+/*
+ * Block kernels for k vectors at once, stored row-major so that the k values
+ * of one index are contiguous: dense[index * k + j] is element index of
+ * vector j. The vector versions work on k in chunks of the vector width,
+ * the last one masked, so the sparse elements are read once per chunk.
+ */
+/* out[j] = sum of values[i] * dense[index[i] * k + j] */
+template <typename T, typename I>
+inline void ScalarBlockGatherDot(const T* values, const I* index, int64_t n,
+                                 const T* dense, int64_t k, T* out) {
+  for (int64_t j = 0; j < k; j++) out[j] = 0;
+  for (int64_t i = 0; i < n; i++) {
+    const T* row = dense + int64_t(index[i]) * k;
+    for (int64_t j = 0; j < k; j++) out[j] += values[i] * row[j];
+  }
+}
+/* dense[index[i] * k + j] += values[i] * scale[j] */
+template <typename T, typename I>
+inline void ScalarBlockScatterAxpy(T* dense, const I* index, const T* values,
+                                   const T* scale, int64_t n, int64_t k) {
+  for (int64_t i = 0; i < n; i++) {
+    T* row = dense + int64_t(index[i]) * k;
+    for (int64_t j = 0; j < k; j++) row[j] += values[i] * scale[j];
+  }
+}
+
+#ifdef TABLEAU_X86
+#define TABLEAU_BLOCK_KERNELS(Prefix, Target)                                 \
+  template <typename Vec, typename I>                                         \
+  Target inline void Prefix##BlockGatherDot(                                  \
+      const typename Vec::T* values, const I* index, int64_t n,               \
+      const typename Vec::T* dense, int64_t k, typename Vec::T* out) {        \
+    constexpr int W = Vec::kWidth;                                            \
+    int64_t j = 0;                                                            \
+    for (; j + W <= k; j += W) {                                              \
+      typename Vec::V sum0 = Vec::Zero(), sum1 = Vec::Zero();                 \
+      int64_t i = 0;                                                          \
+      for (; i + 2 <= n; i += 2) {                                            \
+        sum0 = Vec::Fma(Vec::Set1(values[i]),                                 \
+                        Vec::Load(dense + int64_t(index[i]) * k + j), sum0);  \
+        sum1 = Vec::Fma(Vec::Set1(values[i + 1]),                             \
+                        Vec::Load(dense + int64_t(index[i + 1]) * k + j),     \
+                        sum1);                                                \
+      }                                                                       \
+      if (i < n)                                                              \
+        sum0 = Vec::Fma(Vec::Set1(values[i]),                                 \
+                        Vec::Load(dense + int64_t(index[i]) * k + j), sum0);  \
+      Vec::Store(out + j, Vec::Add(sum0, sum1));                              \
+    }                                                                         \
+    if (j == k) return;                                                       \
+    int rest = k - j;                                                         \
+    typename Vec::V sum = Vec::Zero();                                        \
+    for (int64_t i = 0; i < n; i++)                                           \
+      sum = Vec::Fma(Vec::Set1(values[i]),                                    \
+                     Vec::LoadPartial(dense + int64_t(index[i]) * k + j,      \
+                                      rest),                                  \
+                     sum);                                                    \
+    Vec::StorePartial(out + j, sum, rest);                                    \
+  }                                                                           \
+  template <typename Vec, typename I>                                         \
+  Target inline void Prefix##BlockScatterAxpy(                                \
+      typename Vec::T* dense, const I* index, const typename Vec::T* values,  \
+      const typename Vec::T* scale, int64_t n, int64_t k) {                   \
+    constexpr int W = Vec::kWidth;                                            \
+    int64_t j = 0;                                                            \
+    for (; j + W <= k; j += W) {                                              \
+      typename Vec::V s = Vec::Load(scale + j);                               \
+      for (int64_t i = 0; i < n; i++) {                                       \
+        typename Vec::T* row = dense + int64_t(index[i]) * k + j;             \
+        Vec::Store(row, Vec::Fma(Vec::Set1(values[i]), s, Vec::Load(row)));   \
+      }                                                                       \
+    }                                                                         \
+    if (j == k) return;                                                       \
+    int rest = k - j;                                                         \
+    typename Vec::V s = Vec::LoadPartial(scale + j, rest);                    \
+    for (int64_t i = 0; i < n; i++) {                                         \
+      typename Vec::T* row = dense + int64_t(index[i]) * k + j;               \
+      Vec::StorePartial(                                                      \
+          row, Vec::Fma(Vec::Set1(values[i]), s, Vec::LoadPartial(row, rest)), \
+          rest);                                                              \
+    }                                                                         \
+  }
+
+TABLEAU_BLOCK_KERNELS(Avx2, TABLEAU_TARGET_AVX2)
+TABLEAU_AVX512_BEGIN
+TABLEAU_BLOCK_KERNELS(Avx512, TABLEAU_TARGET_AVX512)
+TABLEAU_AVX512_END
+#undef TABLEAU_BLOCK_KERNELS
+#endif
+
+/*
+ * Dispatches Op on GetSimdLevel() like TABLEAU_DISPATCH_DENSE, for kernels
+ * that are also templated on the index type.
+ */
+#ifdef TABLEAU_X86
+#define TABLEAU_DISPATCH_BLOCK(T, I, Op, ...)                \
+  if constexpr (HasSimdDenseKernels<T>()) {                  \
+    switch (GetSimdLevel()) {                                \
+      case SIMD_AVX512:                                      \
+        return Avx512##Op<Avx512Vector<T>, I>(__VA_ARGS__);  \
+      case SIMD_AVX2:                                        \
+        return Avx2##Op<Avx2Vector<T>, I>(__VA_ARGS__);      \
+      default:                                               \
+        break;                                               \
+    }                                                        \
+  }                                                          \
+  return Scalar##Op(__VA_ARGS__)
+#else
+#define TABLEAU_DISPATCH_BLOCK(T, I, Op, ...) return Scalar##Op(__VA_ARGS__)
+#endif
+
+/* out[j] = sum of values[i] * dense[index[i] * k + j] for j < k. */
+template <typename T, typename I>
+inline void BlockGatherDot(const T* values, const I* index, int64_t n,
+                           const T* dense, int64_t k, T* out) {
+  TABLEAU_DISPATCH_BLOCK(T, I, BlockGatherDot, values, index, n, dense, k,
+                         out);
+}
+/* dense[index[i] * k + j] += values[i] * scale[j] for j < k. */
+template <typename T, typename I>
+inline void BlockScatterAxpy(T* dense, const I* index, const T* values,
+                             const T* scale, int64_t n, int64_t k) {
+  TABLEAU_DISPATCH_BLOCK(T, I, BlockScatterAxpy, dense, index, values, scale,
+                         n, k);
+}
+#undef TABLEAU_DISPATCH_BLOCK
+
+/**
+ * Number of set bits of x. __builtin_popcountll is a library call unless the
+ * build targets popcnt, so this falls back to a branch free bit count.
+ */
+inline int PopCount(uint64_t x) {
+#ifdef __POPCNT__
+  return __builtin_popcountll(x);
+#else
+  x = x - ((x >> 1) & 0x5555555555555555ULL);
+  x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+  x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return (x * 0x0101010101010101ULL) >> 56;
+#endif
+}
@@ -0,0 +1,723 @@
+#pragma once
+
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "tableau.h"
+#include "tableau_triangular.h"
+
+/**
+ * Sparse LU factorization of a square basis matrix B for FTRAN (B x = a) and
+ * BTRAN (B^T y = e) in the revised simplex method. Rows are the rows of the
+ * constraint matrix, columns the positions of the basis.
+ *
+ * Factorize eliminates in Markowitz order: the pivot is the element of least
+ * (row count - 1) * (column count - 1) that is at least kThreshold of the
+ * largest in its column, searched among the sparsest rows and columns. This
+ * leaves B = L^-1 U with L a product of column etas and U triangular in pivot
+ * order, kept by both rows and columns.
+ *
+ * Update replaces a column in the Forrest-Tomlin way: the new column, as it
+ * was after L in the last Ftran, replaces the old one in U, its pivot moves
+ * to the end of the order, and the rest of its row is eliminated into a row
+ * eta R. The factor grows by the spike and the eta, so callers factorize
+ * again after some updates.
+ *
+ * A right-hand side with fewer than Size() / kHypersparseRatio nonzeros is
+ * solved the Gilbert-Peierls way: L and U are walked from its nonzeros
+ * through a SparseReach, over L by columns and by rows, and U by columns
+ * and by rows, so the solve costs what it touches. Denser ones are swept.
+ */
+template <typename T, typename I = tableau_index_t>
+class LuFactor {
+ public:
+  /* Relative size of a pivot to the largest element of its column. */
+  static constexpr double kThreshold = 0.1;
+  /* Columns and rows the pivot search looks at once it has a candidate. */
+  static constexpr tableau_size_t kSearchLimit = 4;
+  static constexpr tableau_size_t kHypersparseRatio = 100;
+
+  explicit LuFactor(tableau_size_t size)
+      : size_(size),
+        row_of_(size),
+        position_of_(size),
+        diag_(size),
+        pivot_of_row_(size),
+        pivot_of_position_(size),
+        rank_(size),
+        u_row_(size),
+        u_col_(size),
+        row_work_(size),
+        position_work_(size),
+        pivot_work_(size),
+        queued_(size),
+        active_(size),
+        pending_u_(size),
+        eta_of_row_(size),
+        l_row_start_(size + 1),
+        in_pattern_(size),
+        reach_(size) {}
+
+  tableau_size_t Size() const { return size_; }
+  /* Forrest-Tomlin updates since the last Factorize. */
+  tableau_size_t Updates() const { return r_row_.size(); }
+  /* Stored elements of L, R and U, the diagonal included. */
+  tableau_size_t Nonzeros() const {
+    tableau_size_t nonzeros = size_ + l_index_.size() + r_index_.size();
+    for (const auto& col : u_col_) nonzeros += col.size();
+    return nonzeros;
+  }
+
+  /**
+   * Factorizes the basis whose column at position p is read by
+   * read_column(p, visit), which calls visit(row, value) for its elements.
+   * Columns that are left without a pivot, because the basis is singular,
+   * are replaced by unit columns of the rows left without one; the returned
+   * (position, row) pairs tell which.
+   */
+  template <typename ColumnReader>
+  std::vector<std::pair<tableau_index_t, tableau_index_t>> Factorize(
+      ColumnReader read_column) {
+    Clear();
+    ActiveMatrix& active = active_;
+    for (tableau_index_t p = 0; p < size_; p++) {
+      read_column(p, [&](tableau_index_t row, T value) {
+        if (value == T(0)) return;
+        active.cols[p].push_back({static_cast<I>(row), value});
+        active.rows[row].push_back(p);
+      });
+    }
+    active.col_buckets.head.assign(size_ + 1, -1);
+    active.row_buckets.head.assign(size_ + 1, -1);
+    for (tableau_index_t i = 0; i < size_; i++) {
+      active.col_buckets.Insert(i, active.cols[i].size());
+      active.row_buckets.Insert(i, active.rows[i].size());
+    }
+    // The U rows are recorded by position until every column has a pivot.
+    auto& u_rows = pending_u_;
+    tableau_size_t pivots = 0;
+    for (; pivots < size_; pivots++) {
+      tableau_index_t row, position;
+      if (not FindPivot(&active, &row, &position)) break;
+      Eliminate(&active, pivots, row, position, &u_rows[pivots]);
+    }
+    std::vector<std::pair<tableau_index_t, tableau_index_t>> replaced;
+    std::vector<char> unpivoted_row(size_, 1), unpivoted_position(size_, 1);
+    for (tableau_index_t k = 0; k < pivots; k++) {
+      unpivoted_row[row_of_[k]] = 0;
+      unpivoted_position[position_of_[k]] = 0;
+    }
+    for (tableau_index_t row = 0, position = 0; pivots < size_; pivots++) {
+      while (not unpivoted_row[row]) row++;
+      while (not unpivoted_position[position]) position++;
+      AddPivot(pivots, row, position, 1);
+      replaced.push_back({position, row});
+      row++;
+      position++;
+    }
+    for (tableau_index_t k = 0; k < size_; k++) {
+      for (auto [position, value] : u_rows[k]) {
+        // A replaced column is a unit column, with nothing above its pivot.
+        if (unpivoted_position[position]) continue;
+        I pivot = pivot_of_position_[position];
+        u_row_[k].push_back({pivot, value});
+        u_col_[pivot].push_back({static_cast<I>(k), value});
+      }
+      u_rows[k].clear();
+      // Left over by a singular basis.
+      active.cols[k].clear();
+      active.rows[k].clear();
+    }
+    IndexL();
+    spike_valid_ = false;
+    return replaced;
+  }
+
+  /**
+   * B^-1 a as a SPARSE list over positions, for a over rows. With keep_spike
+   * the column is kept, as it is after L and R, for the next Update.
+   */
+  List<T, I>* Ftran(const List<T, I>* a, bool keep_spike = false) {
+    if (IsHypersparse(a)) return SparseFtran(a, keep_spike);
+    a->ForEach([&](tableau_index_t row, T value) { row_work_[row] = value; });
+    ApplyL(row_work_.data());
+    ApplyR(row_work_.data());
+    if (keep_spike) {
+      spike_.clear();
+      for (tableau_index_t row = 0; row < size_; row++)
+        if (row_work_[row] != T(0)) spike_.push_back({row, row_work_[row]});
+      spike_valid_ = true;
+    }
+    SolveU(row_work_.data(), position_work_.data());
+    return Gather(&position_work_);
+  }
+
+  /* B^-T e as a SPARSE list over rows, for e over positions. */
+  List<T, I>* Btran(const List<T, I>* e) {
+    if (IsHypersparse(e)) return SparseBtran(e);
+    e->ForEach([&](tableau_index_t position, T value) {
+      position_work_[position] = value;
+    });
+    SolveUTransposed(position_work_.data(), row_work_.data());
+    ApplyRTransposed(row_work_.data());
+    ApplyLTransposed(row_work_.data());
+    return Gather(&row_work_);
+  }
+
+  /**
+   * Replaces the column at position by the column of the last Ftran with
+   * keep_spike. Returns false if the new pivot is small against the column,
+   * in which case the factor is exact but should be factorized again.
+   */
+  bool Update(tableau_index_t position) {
+    assert_msg(spike_valid_, "Update needs an Ftran with keep_spike first");
+    spike_valid_ = false;
+    I k = pivot_of_position_[position];
+    // The old column leaves U.
+    for (auto [pivot, value] : u_col_[k]) EraseEntry(&u_row_[pivot], k);
+    u_col_[k].clear();
+    // The rest of row k is eliminated by the rows after it in order, which
+    // are popped by rank since eliminating one can fill in the later ones.
+    std::priority_queue<std::pair<tableau_index_t, I>,
+                        std::vector<std::pair<tableau_index_t, I>>,
+                        std::greater<std::pair<tableau_index_t, I>>>
+        queue;
+    for (auto [pivot, value] : u_row_[k]) {
+      EraseEntry(&u_col_[pivot], k);
+      pivot_work_[pivot] = value;
+      queued_[pivot] = 1;
+      queue.push({rank_[pivot], pivot});
+    }
+    u_row_[k].clear();
+    r_row_.push_back(row_of_[k]);
+    while (not queue.empty()) {
+      I pivot = queue.top().second;
+      queue.pop();
+      T value = pivot_work_[pivot];
+      pivot_work_[pivot] = 0;
+      queued_[pivot] = 0;
+      if (value == T(0)) continue;
+      T multiplier = value / diag_[pivot];
+      r_index_.push_back(row_of_[pivot]);
+      r_value_.push_back(multiplier);
+      for (auto [later, u] : u_row_[pivot]) {
+        if (not queued_[later]) {
+          queued_[later] = 1;
+          queue.push({rank_[later], later});
+        }
+        pivot_work_[later] -= multiplier * u;
+      }
+    }
+    r_start_.push_back(r_index_.size());
+    // The spike through the new eta is the new column of U.
+    T largest = 0;
+    for (auto [row, value] : spike_) {
+      row_work_[row] = value;
+      largest = std::max<T>(largest, std::abs(value));
+    }
+    T diag = row_work_[row_of_[k]];
+    for (tableau_index_t e = r_start_[r_start_.size() - 2];
+         e < r_start_.back(); e++)
+      diag -= r_value_[e] * row_work_[r_index_[e]];
+    for (auto [row, value] : spike_) {
+      row_work_[row] = 0;
+      I pivot = pivot_of_row_[row];
+      if (pivot == k or value == T(0)) continue;
+      u_col_[k].push_back({pivot, value});
+      u_row_[pivot].push_back({k, value});
+    }
+    diag_[k] = diag;
+    order_[rank_[k]] = kNoPivot;
+    rank_[k] = order_.size();
+    order_.push_back(k);
+    return std::abs(diag) > std::sqrt(Epsilon()) * largest;
+  }
+
+ private:
+  static constexpr I kNoPivot = I(-1);
+
+  /* Lists of the active rows or columns by their count of elements. */
+  struct CountBuckets {
+    explicit CountBuckets(tableau_size_t size)
+        : head(size + 1, -1), next(size, -1), prev(size, -1), count(size, 0) {}
+    void Insert(tableau_index_t i, tableau_size_t c) {
+      count[i] = c;
+      prev[i] = -1;
+      next[i] = head[c];
+      if (head[c] >= 0) prev[head[c]] = i;
+      head[c] = i;
+    }
+    void Remove(tableau_index_t i) {
+      if (prev[i] >= 0)
+        next[prev[i]] = next[i];
+      else
+        head[count[i]] = next[i];
+      if (next[i] >= 0) prev[next[i]] = prev[i];
+    }
+    void Move(tableau_index_t i, tableau_size_t c) {
+      Remove(i);
+      Insert(i, c);
+    }
+    std::vector<tableau_index_t> head, next, prev;
+    std::vector<tableau_size_t> count;
+  };
+  /* The part of B not yet eliminated, columns with values, rows by pattern. */
+  struct ActiveMatrix {
+    explicit ActiveMatrix(tableau_size_t size)
+        : cols(size),
+          rows(size),
+          col_buckets(size),
+          row_buckets(size),
+          map(size, -1) {}
+    std::vector<std::vector<std::pair<I, T>>> cols;
+    std::vector<std::vector<I>> rows;
+    CountBuckets col_buckets, row_buckets;
+    // Position of each row in the column being updated, -1 if absent.
+    std::vector<tableau_index_t> map;
+  };
+
+  static T Epsilon() { return std::numeric_limits<T>::epsilon(); }
+
+  void Clear() {
+    order_.clear();
+    l_row_.clear();
+    l_start_.assign(1, 0);
+    l_index_.clear();
+    l_value_.clear();
+    r_row_.clear();
+    r_start_.assign(1, 0);
+    r_index_.clear();
+    r_value_.clear();
+    for (auto& row : u_row_) row.clear();
+    for (auto& col : u_col_) col.clear();
+  }
+
+  void AddPivot(tableau_index_t k, tableau_index_t row,
+                tableau_index_t position, T diag) {
+    row_of_[k] = row;
+    position_of_[k] = position;
+    diag_[k] = diag;
+    pivot_of_row_[row] = k;
+    pivot_of_position_[position] = k;
+    rank_[k] = order_.size();
+    order_.push_back(k);
+  }
+
+  static T LargestIn(const std::vector<std::pair<I, T>>& col) {
+    T largest = 0;
+    for (auto [row, value] : col)
+      largest = std::max<T>(largest, std::abs(value));
+    return largest;
+  }
+
+  /**
+   * The Markowitz search: rows and columns are visited by increasing count
+   * until kSearchLimit of them were looked at with a candidate found, or no
+   * later count can beat the best candidate. Empty rows and columns are
+   * dropped from the search, they cannot be pivoted on.
+   */
+  bool FindPivot(ActiveMatrix* active, tableau_index_t* best_row,
+                 tableau_index_t* best_position) const {
+    tableau_size_t best_cost = std::numeric_limits<tableau_size_t>::max();
+    tableau_size_t searched = 0;
+    auto consider = [&](tableau_index_t row, tableau_index_t position,
+                        tableau_size_t cost) {
+      if (cost >= best_cost) return;
+      best_cost = cost;
+      *best_row = row;
+      *best_position = position;
+    };
+    for (tableau_size_t count = 1; count <= size_; count++) {
+      for (tableau_index_t p = active->col_buckets.head[count]; p >= 0;
+           p = active->col_buckets.next[p]) {
+        const auto& col = active->cols[p];
+        T threshold = kThreshold * LargestIn(col);
+        for (auto [row, value] : col) {
+          if (value == T(0) or std::abs(value) < threshold) continue;
+          consider(row, p,
+                   (active->row_buckets.count[row] - 1) * (count - 1));
+        }
+        if (best_cost < std::numeric_limits<tableau_size_t>::max() and
+            ++searched >= kSearchLimit)
+          return true;
+      }
+      for (tableau_index_t r = active->row_buckets.head[count]; r >= 0;
+           r = active->row_buckets.next[r]) {
+        for (I p : active->rows[r]) {
+          const auto& col = active->cols[p];
+          T value = 0;
+          for (auto [row, v] : col)
+            if (row == r) value = v;
+          if (value == T(0) or std::abs(value) < kThreshold * LargestIn(col))
+            continue;
+          consider(r, p, (count - 1) * (tableau_size_t(col.size()) - 1));
+        }
+        if (best_cost < std::numeric_limits<tableau_size_t>::max() and
+            ++searched >= kSearchLimit)
+          return true;
+      }
+      // Whatever is left has at least count + 1 elements in its row and its
+      // column.
+      if (best_cost <= count * count) return true;
+    }
+    return best_cost < std::numeric_limits<tableau_size_t>::max();
+  }
+
+  /* Pivots on row and position, the k-th pivot, and updates the rest. */
+  void Eliminate(ActiveMatrix* active, tableau_index_t k, tableau_index_t row,
+                 tableau_index_t position,
+                 std::vector<std::pair<I, T>>* u_row) {
+    auto& pivot_col = active->cols[position];
+    T pivot = 0;
+    for (auto [r, value] : pivot_col)
+      if (r == row) pivot = value;
+    active->col_buckets.Remove(position);
+    active->row_buckets.Remove(row);
+    AddPivot(k, row, position, pivot);
+    // The column eta, whose rows lose the pivot column. Singleton columns,
+    // all of a slack basis, leave none, so the solves do not visit them.
+    tableau_index_t eta_begin = l_index_.size();
+    std::vector<tableau_index_t> touched_rows;
+    for (auto [r, value] : pivot_col) {
+      if (r == row) continue;
+      l_index_.push_back(r);
+      l_value_.push_back(value / pivot);
+      EraseValue(&active->rows[r], static_cast<I>(position));
+      touched_rows.push_back(r);
+    }
+    tableau_index_t eta_end = l_index_.size();
+    if (eta_end > eta_begin) {
+      l_row_.push_back(row);
+      l_start_.push_back(eta_end);
+    }
+    // The rest of the pivot row goes to U, and every column in it gets the
+    // eta scaled by its element.
+    for (I p : active->rows[row]) {
+      if (p == position) continue;
+      auto& col = active->cols[p];
+      T scale = 0;
+      for (size_t e = 0; e < col.size(); e++) {
+        if (col[e].first == row) {
+          scale = col[e].second;
+          col[e] = col.back();
+          col.pop_back();
+          break;
+        }
+      }
+      u_row->push_back({p, scale});
+      for (size_t e = 0; e < col.size(); e++) active->map[col[e].first] = e;
+      for (tableau_index_t e = eta_begin; e < eta_end; e++) {
+        tableau_index_t r = l_index_[e];
+        T update = -l_value_[e] * scale;
+        if (active->map[r] >= 0) {
+          col[active->map[r]].second += update;
+        } else {
+          col.push_back({static_cast<I>(r), update});
+          active->rows[r].push_back(p);
+        }
+      }
+      for (auto [r, value] : col) active->map[r] = -1;
+      active->col_buckets.Move(p, col.size());
+    }
+    for (tableau_index_t r : touched_rows)
+      active->row_buckets.Move(r, active->rows[r].size());
+    pivot_col.clear();
+    active->rows[row].clear();
+  }
+
+  static void EraseValue(std::vector<I>* values, I value) {
+    for (size_t e = 0; e < values->size(); e++) {
+      if ((*values)[e] == value) {
+        (*values)[e] = values->back();
+        values->pop_back();
+        return;
+      }
+    }
+  }
+  static void EraseEntry(std::vector<std::pair<I, T>>* entries, I pivot) {
+    for (size_t e = 0; e < entries->size(); e++) {
+      if ((*entries)[e].first == pivot) {
+        (*entries)[e] = entries->back();
+        entries->pop_back();
+        return;
+      }
+    }
+  }
+
+  /* x = L x, column etas in order. */
+  void ApplyL(T* x) const {
+    for (size_t eta = 0; eta < l_row_.size(); eta++) {
+      T pivot = x[l_row_[eta]];
+      if (pivot == T(0)) continue;
+      for (tableau_index_t e = l_start_[eta]; e < l_start_[eta + 1]; e++)
+        x[l_index_[e]] -= l_value_[e] * pivot;
+    }
+  }
+  /* x = L^T x, column etas in reverse. */
+  void ApplyLTransposed(T* x) const {
+    for (tableau_index_t eta = l_row_.size() - 1; eta >= 0; eta--) {
+      T sum = 0;
+      for (tableau_index_t e = l_start_[eta]; e < l_start_[eta + 1]; e++)
+        sum += l_value_[e] * x[l_index_[e]];
+      x[l_row_[eta]] -= sum;
+    }
+  }
+  /* x = R x, row etas in order. */
+  void ApplyR(T* x) const {
+    for (size_t eta = 0; eta < r_row_.size(); eta++) {
+      T sum = 0;
+      for (tableau_index_t e = r_start_[eta]; e < r_start_[eta + 1]; e++)
+        sum += r_value_[e] * x[r_index_[e]];
+      x[r_row_[eta]] -= sum;
+    }
+  }
+  /* x = R^T x, row etas in reverse. */
+  void ApplyRTransposed(T* x) const {
+    for (tableau_index_t eta = r_row_.size() - 1; eta >= 0; eta--) {
+      T value = x[r_row_[eta]];
+      if (value == T(0)) continue;
+      for (tableau_index_t e = r_start_[eta]; e < r_start_[eta + 1]; e++)
+        x[r_index_[e]] -= r_value_[e] * value;
+    }
+  }
+  /* Solves U z = x by columns, last pivot first; x is cleared. */
+  void SolveU(T* x, T* z) const {
+    for (tableau_index_t rank = order_.size() - 1; rank >= 0; rank--) {
+      I k = order_[rank];
+      if (k == kNoPivot) continue;
+      T value = x[row_of_[k]];
+      if (value == T(0)) continue;
+      x[row_of_[k]] = 0;
+      value /= diag_[k];
+      z[position_of_[k]] = value;
+      for (auto [pivot, u] : u_col_[k]) x[row_of_[pivot]] -= u * value;
+    }
+  }
+  /* Solves U^T w = z by rows, first pivot first; z is cleared. */
+  void SolveUTransposed(T* z, T* w) const {
+    for (size_t rank = 0; rank < order_.size(); rank++) {
+      I k = order_[rank];
+      if (k == kNoPivot) continue;
+      T value = z[position_of_[k]];
+      if (value == T(0)) continue;
+      z[position_of_[k]] = 0;
+      value /= diag_[k];
+      w[row_of_[k]] = value;
+      for (auto [pivot, u] : u_row_[k]) z[position_of_[pivot]] -= u * value;
+    }
+  }
+  bool IsHypersparse(const List<T, I>* rhs) const {
+    return rhs->StorageFormat() == SPARSE and
+           rhs->Size() * kHypersparseRatio < size_;
+  }
+
+  /* The etas of L by the row they pivot on and by the rows they change. */
+  void IndexL() {
+    std::fill(eta_of_row_.begin(), eta_of_row_.end(), -1);
+    for (size_t eta = 0; eta < l_row_.size(); eta++)
+      eta_of_row_[l_row_[eta]] = eta;
+    std::fill(l_row_start_.begin(), l_row_start_.end(), 0);
+    for (I row : l_index_) l_row_start_[row + 1]++;
+    for (tableau_index_t row = 0; row < size_; row++)
+      l_row_start_[row + 1] += l_row_start_[row];
+    l_row_eta_.resize(l_index_.size());
+    l_row_value_.resize(l_index_.size());
+    std::vector<tableau_index_t> next(l_row_start_.begin(),
+                                      l_row_start_.end() - 1);
+    for (size_t eta = 0; eta < l_row_.size(); eta++) {
+      for (tableau_index_t e = l_start_[eta]; e < l_start_[eta + 1]; e++) {
+        tableau_index_t at = next[l_index_[e]]++;
+        l_row_eta_[at] = eta;
+        l_row_value_[at] = l_value_[e];
+      }
+    }
+  }
+
+  /* Adds row to pattern_ unless it is in already. */
+  void AddToPattern(I row) {
+    if (in_pattern_[row]) return;
+    in_pattern_[row] = 1;
+    pattern_.push_back(row);
+  }
+  /* The nonzeros of work at pattern_ as a SPARSE list, leaving both empty. */
+  List<T, I>* GatherPattern(std::vector<T>* work) {
+    std::sort(pattern_.begin(), pattern_.end());
+    List<T, I>* list = new List<T, I>(pattern_.size());
+    for (I i : pattern_) {
+      if ((*work)[i] != T(0)) list->Append(i, (*work)[i]);
+      (*work)[i] = 0;
+      in_pattern_[i] = 0;
+    }
+    pattern_.clear();
+    return list;
+  }
+
+  /* Ftran for a hypersparse a, see the class comment. */
+  List<T, I>* SparseFtran(const List<T, I>* a, bool keep_spike) {
+    T* x = row_work_.data();
+    a->ForEach([&](tableau_index_t row, T value) { x[row] = value; });
+    // L: a row with an eta scatters into the rows of the eta.
+    const std::vector<I>& rows = reach_.Reach(
+        [&](auto visit) {
+          a->ForEach([&](tableau_index_t row, T value) {
+            if (value != T(0)) visit(row);
+          });
+        },
+        [&](tableau_index_t row, auto visit) {
+          tableau_index_t eta = eta_of_row_[row];
+          if (eta < 0) return;
+          for (tableau_index_t e = l_start_[eta]; e < l_start_[eta + 1]; e++)
+            visit(l_index_[e]);
+        });
+    for (I row : rows) {
+      AddToPattern(row);
+      tableau_index_t eta = eta_of_row_[row];
+      if (eta < 0 or x[row] == T(0)) continue;
+      for (tableau_index_t e = l_start_[eta]; e < l_start_[eta + 1]; e++)
+        x[l_index_[e]] -= l_value_[e] * x[row];
+    }
+    // R: few etas, each only gathers, so all of them are applied.
+    for (size_t eta = 0; eta < r_row_.size(); eta++) {
+      T sum = 0;
+      for (tableau_index_t e = r_start_[eta]; e < r_start_[eta + 1]; e++)
+        sum += r_value_[e] * x[r_index_[e]];
+      if (sum == T(0)) continue;
+      x[r_row_[eta]] -= sum;
+      AddToPattern(r_row_[eta]);
+    }
+    if (keep_spike) {
+      spike_.clear();
+      for (I row : pattern_)
+        if (x[row] != T(0)) spike_.push_back({row, x[row]});
+      spike_valid_ = true;
+    }
+    // U by columns, from the pivots of the rows left nonzero.
+    const std::vector<I>& pivots = reach_.Reach(
+        [&](auto visit) {
+          for (I row : pattern_)
+            if (x[row] != T(0)) visit(pivot_of_row_[row]);
+        },
+        [&](tableau_index_t k, auto visit) {
+          for (auto [pivot, u] : u_col_[k]) visit(pivot);
+        });
+    for (I row : pattern_) in_pattern_[row] = 0;
+    pattern_.clear();
+    for (I k : pivots) {
+      T value = x[row_of_[k]];
+      if (value == T(0)) continue;
+      x[row_of_[k]] = 0;
+      value /= diag_[k];
+      position_work_[position_of_[k]] = value;
+      AddToPattern(position_of_[k]);
+      for (auto [pivot, u] : u_col_[k]) x[row_of_[pivot]] -= u * value;
+    }
+    return GatherPattern(&position_work_);
+  }
+
+  /* Btran for a hypersparse e, see the class comment. */
+  List<T, I>* SparseBtran(const List<T, I>* e) {
+    T* z = position_work_.data();
+    T* w = row_work_.data();
+    e->ForEach([&](tableau_index_t position, T value) { z[position] = value; });
+    // U^T by rows, from the pivots of the positions of e.
+    const std::vector<I>& pivots = reach_.Reach(
+        [&](auto visit) {
+          e->ForEach([&](tableau_index_t position, T value) {
+            if (value != T(0)) visit(pivot_of_position_[position]);
+          });
+        },
+        [&](tableau_index_t k, auto visit) {
+          for (auto [pivot, u] : u_row_[k]) visit(pivot);
+        });
+    for (I k : pivots) {
+      T value = z[position_of_[k]];
+      if (value == T(0)) continue;
+      z[position_of_[k]] = 0;
+      value /= diag_[k];
+      w[row_of_[k]] = value;
+      AddToPattern(row_of_[k]);
+      for (auto [pivot, u] : u_row_[k]) z[position_of_[pivot]] -= u * value;
+    }
+    // R^T, in reverse.
+    for (tableau_index_t eta = r_row_.size() - 1; eta >= 0; eta--) {
+      T value = w[r_row_[eta]];
+      if (value == T(0)) continue;
+      for (tableau_index_t k = r_start_[eta]; k < r_start_[eta + 1]; k++) {
+        w[r_index_[k]] -= r_value_[k] * value;
+        AddToPattern(r_index_[k]);
+      }
+    }
+    // L^T by rows: a row scatters into the pivot rows of the etas it is in.
+    const std::vector<I>& rows = reach_.Reach(
+        [&](auto visit) {
+          for (I row : pattern_)
+            if (w[row] != T(0)) visit(row);
+        },
+        [&](tableau_index_t row, auto visit) {
+          for (auto k = l_row_start_[row]; k < l_row_start_[row + 1]; k++)
+            visit(l_row_[l_row_eta_[k]]);
+        });
+    for (I row : rows) {
+      AddToPattern(row);
+      if (w[row] == T(0)) continue;
+      for (auto k = l_row_start_[row]; k < l_row_start_[row + 1]; k++)
+        w[l_row_[l_row_eta_[k]]] -= l_row_value_[k] * w[row];
+    }
+    return GatherPattern(&row_work_);
+  }
+
+  /* The nonzeros of work as a SPARSE list, leaving work zero. */
+  List<T, I>* Gather(std::vector<T>* work) const {
+    List<T, I>* list = new List<T, I>();
+    for (tableau_index_t i = 0; i < size_; i++) {
+      if ((*work)[i] == T(0)) continue;
+      list->Append(i, (*work)[i]);
+      (*work)[i] = 0;
+    }
+    return list;
+  }
+
+  tableau_size_t size_;
+  // Per pivot: its row, its position and the diagonal element of U.
+  std::vector<I> row_of_, position_of_;
+  std::vector<T> diag_;
+  std::vector<I> pivot_of_row_, pivot_of_position_;
+  // The pivots in triangular order, kNoPivot where one was moved to the end
+  // by an update, and the place of each in it.
+  std::vector<I> order_;
+  std::vector<tableau_index_t> rank_;
+  // Above diagonal elements of U by row and by column, keyed by the pivot
+  // of the column and of the row.
+  std::vector<std::vector<std::pair<I, T>>> u_row_, u_col_;
+  // Column etas of L and row etas of R: the pivot row and the elements of
+  // each, starting at *_start_.
+  std::vector<I> l_row_, l_index_;
+  std::vector<tableau_index_t> l_start_{0};
+  std::vector<T> l_value_;
+  std::vector<I> r_row_, r_index_;
+  std::vector<tableau_index_t> r_start_{0};
+  std::vector<T> r_value_;
+  // The column of the last Ftran with keep_spike, after L and R.
+  std::vector<std::pair<I, T>> spike_;
+  bool spike_valid_ = false;
+  // Zero between calls.
+  std::vector<T> row_work_, position_work_, pivot_work_;
+  std::vector<char> queued_;
+  // Kept between calls to Factorize, which reuses their buffers.
+  ActiveMatrix active_;
+  std::vector<std::vector<std::pair<I, T>>> pending_u_;
+  // The eta of L pivoting on each row, or -1, and the elements of L by row:
+  // the eta and value of each, starting at l_row_start_.
+  std::vector<tableau_index_t> eta_of_row_, l_row_start_;
+  std::vector<I> l_row_eta_;
+  std::vector<T> l_row_value_;
+  // Workspace of the hypersparse solves, the rows or positions that may be
+  // nonzero and a mark for each.
+  std::vector<I> pattern_;
+  std::vector<char> in_pattern_;
+  SparseReach<I> reach_;
+};
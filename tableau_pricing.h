@@ -0,0 +1,229 @@
+#pragma once
+
+#include <omp.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "tableau.h"
+#include "tableau_kernels.h"
+
+enum PricingRule {
+  DANTZIG,
+  DEVEX,
+  STEEPEST_EDGE,
+};
+
+/**
+ * Chooses the entering variable of the primal simplex method. Variable j
+ * improves the objective at the rate gain_j = d_j * sign_j, with d the
+ * reduced costs and sign_j -1 at a lower bound, 1 at an upper bound and 0
+ * for a basic or fixed variable, and the choice is the largest
+ * gain_j^2 / w_j for the weights of the rule:
+ *
+ *   DANTZIG        w_j = 1.
+ *   DEVEX          Forrest and Goldfarb's approximation of the projected
+ *                  steepest edge weights, w_j = max(w_j, (alpha_rj /
+ *                  alpha_rq)^2 w_q) at every basis change.
+ *   STEEPEST_EDGE  The projected steepest edge, w_j the squared norm of the
+ *                  edge of j restricted to a reference framework, updated
+ *                  exactly by the Goldfarb-Reid recurrence, which needs
+ *                  kappa = [A I]^T B^-T alpha_q over the framework.
+ *
+ * The framework is the set of nonbasic variables at the last Reset, where
+ * every weight is 1. Devex asks for a new one when the updated weight of
+ * the entering variable has strayed from its exact value.
+ *
+ * The scan is DenseArgMaxScore, split between the threads for large
+ * problems. With SetPartial it only covers a block at a time, rotating
+ * through the variables, and keeps the next best of the block as the
+ * candidates of the following choices (multiple pricing).
+ */
+template <typename T, typename I = tableau_index_t>
+class Pricing {
+ public:
+  // Smaller scans run on the calling thread.
+  static constexpr tableau_size_t kParallelWork = 1 << 16;
+
+  explicit Pricing(tableau_size_t size, PricingRule rule = DANTZIG)
+      : size_(size), rule_(rule), weights_(size, 1), in_framework_(size, 1) {}
+
+  PricingRule Rule() const { return rule_; }
+  /* Takes effect at the next Reset. */
+  void SetRule(PricingRule rule) { rule_ = rule; }
+  /**
+   * Scans block variables at a time and keeps up to candidates of them; 0
+   * scans every variable every time.
+   */
+  void SetPartial(tableau_size_t block, tableau_size_t candidates = 1) {
+    assert(candidates >= 1);
+    block_ = block;
+    max_candidates_ = candidates;
+    cursor_ = 0;
+    candidates_.clear();
+  }
+
+  /* A new framework of the variables with a nonzero sign, all weights 1. */
+  void Reset(const T* sign) {
+    std::fill(weights_.begin(), weights_.end(), T(1));
+    for (tableau_index_t j = 0; j < size_; j++)
+      in_framework_[j] = sign[j] != T(0);
+    reset_pending_ = false;
+  }
+  bool InFramework(tableau_index_t j) const { return in_framework_[j]; }
+  T Weight(tableau_index_t j) const { return weights_[j]; }
+
+  /* The entering variable, or -1 if no gain is above tolerance. */
+  tableau_index_t Choose(const T* d, const T* sign, T tolerance) {
+    if (reset_pending_) Reset(sign);
+    const T* weight = rule_ == DANTZIG ? nullptr : weights_.data();
+    if (block_ == 0) return Scan(d, sign, weight, tolerance, 0, size_).first;
+    // The candidates left by the last block, while any is attractive.
+    tableau_index_t best = -1;
+    T best_score = 0;
+    size_t kept = 0;
+    for (I j : candidates_) {
+      T score = ScalarPriceScore(d, sign, weight, tolerance, j);
+      if (score == T(0)) continue;
+      candidates_[kept++] = j;
+      if (score > best_score) {
+        best = j;
+        best_score = score;
+      }
+    }
+    candidates_.resize(kept);
+    if (best >= 0) {
+      candidates_.erase(
+          std::find(candidates_.begin(), candidates_.end(), best));
+      return best;
+    }
+    tableau_size_t blocks = (size_ + block_ - 1) / block_;
+    for (tableau_size_t b = 0; b < blocks; b++) {
+      tableau_index_t begin = cursor_;
+      tableau_index_t end = std::min<tableau_index_t>(begin + block_, size_);
+      cursor_ = end == size_ ? 0 : end;
+      best = Scan(d, sign, weight, tolerance, begin, end).first;
+      if (best < 0) continue;
+      if (max_candidates_ > 1)
+        KeepCandidates(d, sign, weight, tolerance, begin, end, best);
+      return best;
+    }
+    return -1;
+  }
+
+  /**
+   * The exact weight of entering from its column alpha = B^-1 a_q, whose
+   * positions basic(position) maps to variables.
+   */
+  template <typename Basic>
+  T ColumnWeight(tableau_index_t entering, const List<T, I>* alpha,
+                 Basic basic) const {
+    T weight = in_framework_[entering];
+    alpha->ForEach([&](tableau_index_t position, T value) {
+      if (in_framework_[basic(position)]) weight += value * value;
+    });
+    return weight;
+  }
+
+  /**
+   * Updates the weights for entering replacing leaving, pivot being
+   * alpha_rq and weight the ColumnWeight of entering. row(visit) calls
+   * visit(j, alpha_rj) for the nonbasic j of the pivot row. kappa is only
+   * read by STEEPEST_EDGE, at the same j.
+   */
+  template <typename Row>
+  void Update(tableau_index_t entering, tableau_index_t leaving, T pivot,
+              T weight, Row row, const T* kappa) {
+    if (rule_ == DANTZIG) return;
+    if (rule_ == DEVEX and weights_[entering] > kDevexError * weight)
+      reset_pending_ = true;
+    row([&](tableau_index_t j, T alpha) {
+      if (j == entering) return;
+      T ratio = alpha / pivot;
+      T projected = ratio * ratio * weight;
+      if (rule_ == DEVEX) {
+        weights_[j] = std::max(weights_[j], projected);
+        return;
+      }
+      // The two ends of the new edge of j are known exactly.
+      T floor = in_framework_[j] + in_framework_[entering] * ratio * ratio;
+      weights_[j] = std::max({weights_[j] - 2 * ratio * kappa[j] + projected,
+                              floor, MinWeight()});
+    });
+    weights_[leaving] = std::max(weight / (pivot * pivot),
+                                 rule_ == DEVEX ? T(1) : MinWeight());
+  }
+
+ private:
+  // A Devex weight this many times its exact value resets the framework.
+  static constexpr double kDevexError = 3;
+
+  static T MinWeight() { return std::sqrt(std::numeric_limits<T>::epsilon()); }
+
+  /* DenseArgMaxScore over [begin, end), by thread if it is large. */
+  std::pair<tableau_index_t, T> Scan(const T* d, const T* sign,
+                                     const T* weight, T tolerance,
+                                     tableau_index_t begin,
+                                     tableau_index_t end) {
+    int threads = omp_get_max_threads();
+    if (end - begin < kParallelWork or threads == 1)
+      return ScanRange(d, sign, weight, tolerance, begin, end);
+    // The chunks are reduced in order, so ties go to the first index as in
+    // the serial scan.
+    thread_best_.assign(threads, {-1, 0});
+#pragma omp parallel num_threads(threads)
+    {
+      tableau_size_t n = end - begin;
+      int t = omp_get_thread_num(), count = omp_get_num_threads();
+      tableau_index_t first = begin + n * t / count;
+      tableau_index_t last = begin + n * (t + 1) / count;
+      thread_best_[t] = ScanRange(d, sign, weight, tolerance, first, last);
+    }
+    std::pair<tableau_index_t, T> best = {-1, 0};
+    for (auto candidate : thread_best_)
+      if (candidate.second > best.second) best = candidate;
+    return best;
+  }
+  static std::pair<tableau_index_t, T> ScanRange(const T* d, const T* sign,
+                                                 const T* weight, T tolerance,
+                                                 tableau_index_t begin,
+                                                 tableau_index_t end) {
+    auto best = DenseArgMaxScore(d + begin, sign + begin,
+                                 weight == nullptr ? nullptr : weight + begin,
+                                 tolerance, end - begin);
+    if (best.first >= 0) best.first += begin;
+    return best;
+  }
+
+  /* The best max_candidates_ - 1 of [begin, end) but chosen. */
+  void KeepCandidates(const T* d, const T* sign, const T* weight,
+                      T tolerance, tableau_index_t begin, tableau_index_t end,
+                      tableau_index_t chosen) {
+    scored_.clear();
+    for (tableau_index_t j = begin; j < end; j++) {
+      T score = ScalarPriceScore(d, sign, weight, tolerance, j);
+      if (score > T(0) and j != chosen) scored_.push_back({score, j});
+    }
+    size_t keep = std::min<size_t>(max_candidates_ - 1, scored_.size());
+    std::nth_element(scored_.begin(), scored_.begin() + keep, scored_.end(),
+                     std::greater<std::pair<T, I>>());
+    candidates_.clear();
+    for (size_t k = 0; k < keep; k++) candidates_.push_back(scored_[k].second);
+  }
+
+  tableau_size_t size_;
+  PricingRule rule_;
+  std::vector<T> weights_;
+  std::vector<char> in_framework_;
+  bool reset_pending_ = false;
+  // Partial and multiple pricing: the block size, or 0, the first variable
+  // of the next block and the candidates left from the last one.
+  tableau_size_t block_ = 0, max_candidates_ = 1;
+  tableau_index_t cursor_ = 0;
+  std::vector<I> candidates_;
+  std::vector<std::pair<T, I>> scored_;
+  std::vector<std::pair<tableau_index_t, T>> thread_best_;
+};
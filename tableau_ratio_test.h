@@ -0,0 +1,228 @@
+#pragma once
+
+#include <omp.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "tableau.h"
+#include "tableau_kernels.h"
+
+/**
+ * The ratio test of the simplex method in one pass over a column and the
+ * room of the basic variables, without intermediate lists. The column
+ * holds the rates at which the basic variables decrease as the entering
+ * variable moves, by basis position; a basic variable with a positive rate
+ * has down[position] to go to its lower bound, one with a negative rate
+ * up[position] to its upper bound. Rates of at most pivot_tolerance in
+ * magnitude are treated as zero.
+ *
+ * Harris is the two pass test: the first pass finds the largest step that
+ * keeps every basic variable within harris_tolerance of its bounds, the
+ * second the largest rate among the variables that reach their bound
+ * before it, which gives a better conditioned pivot than the plain minimum
+ * ratio. DENSE columns run the DenseHarris* kernels in place; SPARSE
+ * columns first gather the room of their elements into a buffer, which both
+ * passes then read like a DENSE column. Columns of kParallelWork elements
+ * or more are split between the threads.
+ *
+ * LongStep is the bound flipping variant, for a caller whose objective
+ * stays improving past some breakpoints, as in the dual simplex method:
+ * passing the breakpoint of a variable costs its rate times its range,
+ * down + up, out of slope, and the breakpoints are passed in Harris groups
+ * while slope stays positive. Passed() lists them afterwards.
+ *
+ * Both reuse their buffers, so they do not allocate once these have grown
+ * to the size of the columns.
+ */
+template <typename T, typename I>
+class RatioTest {
+ public:
+  static constexpr tableau_size_t kParallelWork = 1 << 15;
+
+  /* The basic variable to leave, by position, or -1, and the step. */
+  struct Step {
+    tableau_index_t position;
+    T step;
+  };
+
+  explicit RatioTest(
+      T pivot_tolerance = std::sqrt(std::numeric_limits<T>::epsilon()),
+      T harris_tolerance = std::pow(std::numeric_limits<T>::epsilon(),
+                                    T(0.75)))
+      : pivot_tolerance_(pivot_tolerance),
+        harris_tolerance_(harris_tolerance) {}
+
+  static T Infinity() { return std::numeric_limits<T>::infinity(); }
+
+  /**
+   * limit is the step at which the entering variable reaches its other
+   * bound. A step of limit without a position is a bound flip, one of
+   * Infinity() means the column is unbounded.
+   */
+  Step Harris(const List<T, I>* alpha, const T* down, const T* up, T limit) {
+    Prepare(alpha, down, up);
+    int threads = omp_get_max_threads();
+    if (size_ < kParallelWork or threads == 1) {
+      Gather(0, size_);
+      T bound = DenseHarrisBound(values_, down_, up_, pivot_tolerance_,
+                                 harris_tolerance_, size_);
+      if (limit <= bound) return {-1, limit};
+      return Choose(DenseHarrisChoose(values_, down_, up_, pivot_tolerance_,
+                                      bound, size_));
+    }
+    thread_bound_.assign(threads, Infinity());
+    thread_best_.assign(threads, {-1, 0});
+    T bound = Infinity();
+#pragma omp parallel num_threads(threads)
+    {
+      int t = omp_get_thread_num(), count = omp_get_num_threads();
+      tableau_index_t first = size_ * t / count;
+      tableau_index_t last = size_ * (t + 1) / count;
+      Gather(first, last);
+      thread_bound_[t] =
+          DenseHarrisBound(values_ + first, down_ + first, up_ + first,
+                           pivot_tolerance_, harris_tolerance_, last - first);
+#pragma omp barrier
+#pragma omp single
+      bound = *std::min_element(thread_bound_.begin(), thread_bound_.end());
+      if (bound < limit) {
+        auto best = DenseHarrisChoose(values_ + first, down_ + first,
+                                      up_ + first, pivot_tolerance_, bound,
+                                      last - first);
+        if (best.first >= 0) best.first += first;
+        thread_best_[t] = best;
+      }
+    }
+    if (limit <= bound) return {-1, limit};
+    // In order, so ties go to the first position as in the serial pass.
+    std::pair<int64_t, T> best = {-1, 0};
+    for (auto candidate : thread_best_)
+      if (candidate.second > best.second) best = candidate;
+    return Choose(best);
+  }
+
+  /**
+   * The bound flipping test for a column whose objective improves at slope
+   * per unit of step. Returns the breakpoint where it stops improving, or
+   * no position and Infinity() if it does not.
+   */
+  Step LongStep(const List<T, I>* alpha, const T* down, const T* up,
+                T slope) {
+    passed_.clear();
+    breakpoints_.clear();
+    alpha->ForEach([&](tableau_index_t position, T value) {
+      T rate = std::abs(value);
+      if (not(rate > pivot_tolerance_)) return;
+      T room = value > 0 ? down[position] : up[position];
+      breakpoints_.push_back({static_cast<I>(position), rate, room / rate,
+                              (room + harris_tolerance_) / rate,
+                              rate * (down[position] + up[position])});
+    });
+    auto first = breakpoints_.begin();
+    while (first != breakpoints_.end()) {
+      T bound = Infinity();
+      for (auto point = first; point != breakpoints_.end(); point++)
+        bound = std::min(bound, point->relaxed);
+      if (bound == Infinity()) break;
+      auto group = std::partition(
+          first, breakpoints_.end(),
+          [&](const Breakpoint& point) { return point.ratio <= bound; });
+      T cost = 0;
+      for (auto point = first; point != group; point++) cost += point->cost;
+      if (cost < slope) {
+        slope -= cost;
+        for (auto point = first; point != group; point++)
+          passed_.push_back(point->position);
+        first = group;
+        continue;
+      }
+      auto leaving = std::max_element(
+          first, group, [](const Breakpoint& a, const Breakpoint& b) {
+            return a.rate < b.rate;
+          });
+      return {leaving->position, std::max<T>(leaving->ratio, 0)};
+    }
+    return {-1, Infinity()};
+  }
+  /* The positions whose breakpoints the last LongStep passed. */
+  const std::vector<I>& Passed() const { return passed_; }
+
+ private:
+  struct Breakpoint {
+    I position;
+    // The rate, the step to the bound and to harris_tolerance beyond it,
+    // and the cost of passing it.
+    T rate, ratio, relaxed, cost;
+  };
+
+  /* Points values_, down_ and up_ at size_ elements for the kernels. */
+  void Prepare(const List<T, I>* alpha, const T* down, const T* up) {
+    size_ = alpha->Size();
+    positions_ = nullptr;
+    if (alpha->StorageFormat() == DENSE) {
+      values_ = alpha->data_;
+      down_ = down;
+      up_ = up;
+      return;
+    }
+    // The gathered room serves as both down_ and up_, the kernels pick the
+    // same side again from the sign of the rate.
+    room_.resize(size_);
+    down_ = up_ = room_.data();
+    if (alpha->StorageFormat() == SPARSE) {
+      values_ = alpha->data_;
+      positions_ = alpha->index_;
+      source_down_ = down;
+      source_up_ = up;
+      return;
+    }
+    bitmap_values_.clear();
+    bitmap_positions_.clear();
+    alpha->ForEach([&](tableau_index_t position, T value) {
+      room_[bitmap_values_.size()] = value > 0 ? down[position] : up[position];
+      bitmap_values_.push_back(value);
+      bitmap_positions_.push_back(position);
+    });
+    values_ = bitmap_values_.data();
+    positions_ = bitmap_positions_.data();
+    source_down_ = nullptr;
+  }
+  /* The room of the elements in [first, last) of a SPARSE column. */
+  void Gather(tableau_index_t first, tableau_index_t last) {
+    if (positions_ == nullptr or source_down_ == nullptr) return;
+    for (tableau_index_t k = first; k < last; k++) {
+      I position = positions_[k];
+      room_[k] = values_[k] > 0 ? source_down_[position] : source_up_[position];
+    }
+  }
+
+  /* The step of the element of the second pass, by its index. */
+  Step Choose(std::pair<int64_t, T> best) {
+    tableau_index_t k = best.first;
+    if (k < 0) return {-1, Infinity()};
+    T room = values_[k] > 0 ? down_[k] : up_[k];
+    return {positions_ == nullptr ? k : tableau_index_t(positions_[k]),
+            std::max<T>(room / best.second, 0)};
+  }
+
+  T pivot_tolerance_, harris_tolerance_;
+  // The column of the current test: rates, the room on either side and,
+  // unless DENSE, the positions.
+  tableau_size_t size_ = 0;
+  const T* values_ = nullptr;
+  const T* down_ = nullptr;
+  const T* up_ = nullptr;
+  const I* positions_ = nullptr;
+  const T* source_down_ = nullptr;
+  const T* source_up_ = nullptr;
+  std::vector<T> room_, bitmap_values_;
+  std::vector<I> bitmap_positions_;
+  std::vector<T> thread_bound_;
+  std::vector<std::pair<int64_t, T>> thread_best_;
+  std::vector<Breakpoint> breakpoints_;
+  std::vector<I> passed_;
+};
@@ -0,0 +1,361 @@
+#pragma once
+
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "tableau.h"
+#include "tableau_lu.h"
+#include "tableau_pricing.h"
+#include "tableau_ratio_test.h"
+
+enum SimplexStatus {
+  OPTIMAL,
+  UNBOUNDED,
+  ITERATION_LIMIT,
+};
+
+/**
+ * The bounded primal revised simplex method for
+ *
+ *   min c^T x  subject to  A x <= b,  lower <= x <= upper
+ *
+ * with A a ROW_AND_COLUMN tableau. Every row gets a slack, variable
+ * Cols() + i of row i, with A x + s = b and s >= 0, and the slacks are the
+ * first basis, so the problem has to be feasible with x at its lower bounds.
+ *
+ * Instead of the tableau, an iteration works with an LuFactor of the basis:
+ * FTRAN of the entering column for the Harris ratio test of RatioTest,
+ * against the room of the basic variables to their bounds, BTRAN of the
+ * leaving row for the pivot row, rho^T A by SumScaledRows, which updates
+ * the reduced costs. The factor takes a Forrest-Tomlin update per basis
+ * change and is factorized again every kRefactorInterval of them, when the
+ * primal values and reduced costs are also computed afresh. Besides the
+ * pricing scan, an iteration costs the nonzeros of the factor that the
+ * hypersparse solves reach and of the rows rho touches, not the nonzeros of
+ * A. Pricing is Dantzig's rule over all variables unless SetPricing says
+ * otherwise; the steepest edge rule takes one more BTRAN and rho^T A per
+ * iteration.
+ */
+template <typename T, typename I = tableau_index_t>
+class RevisedSimplex {
+ public:
+  static constexpr tableau_size_t kRefactorInterval = 100;
+
+  /**
+   * a is read, not copied or owned, and must outlive the solver; b has an
+   * element per row and c per column. The bounds start out 0 and infinity.
+   */
+  RevisedSimplex(const Tableau<T, I>* a, const List<T, I>* b,
+                 const List<T, I>* c)
+      : a_(a),
+        rows_(a->Rows()),
+        cols_(a->Cols()),
+        b_(rows_),
+        c_(cols_ + rows_),
+        lower_(cols_ + rows_),
+        upper_(cols_ + rows_, Infinity()),
+        x_(cols_ + rows_),
+        d_(cols_ + rows_),
+        at_upper_(cols_ + rows_),
+        basis_(rows_),
+        position_of_(cols_ + rows_, -1),
+        room_down_(rows_),
+        room_up_(rows_),
+        sign_(cols_ + rows_),
+        kappa_(cols_ + rows_),
+        factor_(rows_),
+        pricing_(cols_ + rows_) {
+    assert_msg(a->StorageFormat() == ROW_AND_COLUMN,
+               "RevisedSimplex needs a ROW_AND_COLUMN tableau");
+    b->ForEach([&](tableau_index_t i, T value) { b_[i] = value; });
+    c->ForEach([&](tableau_index_t j, T value) { c_[j] = value; });
+  }
+
+  /* lower must be finite, upper may be Infinity(). */
+  void SetBounds(tableau_index_t col, T lower, T upper) {
+    assert(col < cols_ and lower <= upper and std::isfinite(lower));
+    lower_[col] = lower;
+    upper_[col] = upper;
+  }
+  static T Infinity() { return std::numeric_limits<T>::infinity(); }
+
+  /* The pricing rule, and partial pricing as in Pricing::SetPartial. */
+  void SetPricing(PricingRule rule, tableau_size_t block = 0,
+                  tableau_size_t candidates = 1) {
+    pricing_.SetRule(rule);
+    pricing_.SetPartial(block, candidates);
+  }
+
+  /**
+   * Runs at most max_iterations basis changes and bound flips. Throws if the
+   * slack basis is infeasible.
+   */
+  SimplexStatus Solve(tableau_size_t max_iterations = 1 << 30) {
+    Start();
+    for (iterations_ = 0; iterations_ < max_iterations; iterations_++) {
+      tableau_index_t entering = ChooseEntering();
+      if (entering < 0) return OPTIMAL;
+      if (not Iterate(entering)) return UNBOUNDED;
+    }
+    return ITERATION_LIMIT;
+  }
+
+  T Objective() const {
+    T objective = 0;
+    for (tableau_index_t j = 0; j < cols_; j++) objective += c_[j] * x_[j];
+    return objective;
+  }
+  /* The values of the columns as a DENSE list. */
+  List<T, I>* Primal() const {
+    List<T, I>* x = new List<T, I>(cols_, DENSE);
+    for (tableau_index_t j = 0; j < cols_; j++) x->Set(j, x_[j]);
+    return x;
+  }
+  tableau_size_t Iterations() const { return iterations_; }
+  const LuFactor<T, I>& Factor() const { return factor_; }
+
+ private:
+  static T Tolerance() { return std::sqrt(std::numeric_limits<T>::epsilon()); }
+
+  bool IsBasic(tableau_index_t j) const { return position_of_[j] >= 0; }
+  /* The room of RatioTest, from the value and bounds of the basic. */
+  void UpdateRoom(tableau_index_t position) {
+    tableau_index_t j = basis_[position];
+    room_down_[position] = x_[j] - lower_[j];
+    room_up_[position] = upper_[j] - x_[j];
+  }
+  /* The sign of Pricing, from the basis, the bounds and at_upper_. */
+  void UpdateSign(tableau_index_t j) {
+    if (IsBasic(j) or lower_[j] == upper_[j])
+      sign_[j] = 0;
+    else
+      sign_[j] = at_upper_[j] ? 1 : -1;
+  }
+
+  /* The slack basis, with every column at its lower bound. */
+  void Start() {
+    for (tableau_index_t j = 0; j < cols_; j++) {
+      position_of_[j] = -1;
+      at_upper_[j] = 0;
+      x_[j] = lower_[j];
+    }
+    for (tableau_index_t i = 0; i < rows_; i++) {
+      basis_[i] = cols_ + i;
+      position_of_[cols_ + i] = i;
+    }
+    for (tableau_index_t j = 0; j < cols_ + rows_; j++) UpdateSign(j);
+    Refactor();
+    pricing_.Reset(sign_.data());
+    for (tableau_index_t i = 0; i < rows_; i++) {
+      if (x_[cols_ + i] < -Tolerance() * (1 + std::abs(b_[i])))
+        throw std::runtime_error(
+            "RevisedSimplex needs A x <= b at the lower bounds of x");
+    }
+  }
+
+  /* Reads column j of [A I] as visit(row, value). */
+  template <typename Visitor>
+  void ReadColumn(tableau_index_t j, Visitor visit) const {
+    if (j >= cols_)
+      visit(j - cols_, T(1));
+    else
+      a_->ReadCol(j, [&](const List<T, I>* col) { col->ForEach(visit); });
+  }
+
+  /**
+   * Factorizes the basis, putting slacks in for the columns it is singular
+   * in, and computes the basic values and the reduced costs from scratch.
+   */
+  void Refactor() {
+    auto replaced = factor_.Factorize(
+        [&](tableau_index_t position, auto visit) {
+          ReadColumn(basis_[position], visit);
+        });
+    for (auto [position, row] : replaced) {
+      tableau_index_t leaving = basis_[position];
+      position_of_[leaving] = -1;
+      at_upper_[leaving] = 0;
+      x_[leaving] = lower_[leaving];
+      basis_[position] = cols_ + row;
+      position_of_[cols_ + row] = position;
+      UpdateSign(leaving);
+      UpdateSign(cols_ + row);
+    }
+    // x_B = B^-1 (b - N x_N)
+    List<T, I> rhs(rows_, DENSE);
+    for (tableau_index_t i = 0; i < rows_; i++) rhs.Set(i, b_[i]);
+    for (tableau_index_t j = 0; j < cols_ + rows_; j++) {
+      if (IsBasic(j) or x_[j] == T(0)) continue;
+      ReadColumn(j, [&](tableau_index_t row, T value) {
+        rhs.Set(row, rhs.At(row) - value * x_[j]);
+      });
+    }
+    List<T, I>* x_basic = factor_.Ftran(&rhs);
+    for (tableau_index_t i = 0; i < rows_; i++) x_[basis_[i]] = 0;
+    x_basic->ForEach([&](tableau_index_t position, T value) {
+      x_[basis_[position]] = value;
+    });
+    delete x_basic;
+    for (tableau_index_t i = 0; i < rows_; i++) UpdateRoom(i);
+    // d = c - [A I]^T B^-T c_B
+    List<T, I> c_basic;
+    for (tableau_index_t i = 0; i < rows_; i++)
+      if (c_[basis_[i]] != T(0)) c_basic.Append(i, c_[basis_[i]]);
+    List<T, I>* y = factor_.Btran(&c_basic);
+    List<T, I>* y_a = a_->SumScaledRows(y);
+    for (tableau_index_t j = 0; j < cols_ + rows_; j++) d_[j] = c_[j];
+    y_a->ForEach([&](tableau_index_t j, T value) { d_[j] -= value; });
+    y->ForEach([&](tableau_index_t i, T value) { d_[cols_ + i] -= value; });
+    for (tableau_index_t i = 0; i < rows_; i++) d_[basis_[i]] = 0;
+    delete y_a;
+    delete y;
+  }
+
+  /* The variable to enter the basis, or -1 at an optimum. */
+  tableau_index_t ChooseEntering() {
+    return pricing_.Choose(d_.data(), sign_.data(), Tolerance());
+  }
+
+  /**
+   * Moves entering off its bound until a basic variable or entering itself
+   * reaches a bound, and changes the basis in the first case. Returns false
+   * if nothing stops it.
+   */
+  bool Iterate(tableau_index_t entering) {
+    T direction = at_upper_[entering] ? -1 : 1;
+    List<T, I> column;
+    ReadColumn(entering, [&](tableau_index_t row, T value) {
+      column.Append(row, value);
+    });
+    List<T, I>* alpha = factor_.Ftran(&column, true);
+    // The basic variables decrease at direction * alpha, which swaps the
+    // sides of their room when direction is negative.
+    bool down = direction > 0;
+    auto [leaving_position, step] = ratio_test_.Harris(
+        alpha, down ? room_down_.data() : room_up_.data(),
+        down ? room_up_.data() : room_down_.data(),
+        upper_[entering] - lower_[entering]);
+    if (step == Infinity()) {
+      delete alpha;
+      return false;
+    }
+    T pivot = leaving_position < 0 ? 0 : alpha->At(leaving_position);
+    alpha->ForEach([&](tableau_index_t position, T value) {
+      x_[basis_[position]] -= direction * step * value;
+      UpdateRoom(position);
+    });
+    if (leaving_position < 0) {
+      // A bound flip, the basis stays.
+      delete alpha;
+      at_upper_[entering] = not at_upper_[entering];
+      x_[entering] = at_upper_[entering] ? upper_[entering] : lower_[entering];
+      UpdateSign(entering);
+      return true;
+    }
+    tableau_index_t leaving = basis_[leaving_position];
+    x_[entering] += direction * step;
+    UpdateReducedCosts(entering, leaving_position, pivot, alpha);
+    delete alpha;
+    at_upper_[leaving] = direction * pivot < 0;
+    x_[leaving] = at_upper_[leaving] ? upper_[leaving] : lower_[leaving];
+    at_upper_[entering] = 0;
+    basis_[leaving_position] = entering;
+    position_of_[entering] = leaving_position;
+    position_of_[leaving] = -1;
+    UpdateRoom(leaving_position);
+    UpdateSign(entering);
+    UpdateSign(leaving);
+    if (not factor_.Update(leaving_position) or
+        factor_.Updates() >= kRefactorInterval)
+      Refactor();
+    return true;
+  }
+
+  /**
+   * d -= d_q / alpha_rq * alpha_r for the pivot row alpha_r = e_r^T B^-1
+   * [A I], which only has elements in the columns of the rows in
+   * rho = B^-T e_r, and the pricing weights from the same row.
+   */
+  void UpdateReducedCosts(tableau_index_t entering, tableau_index_t position,
+                          T pivot, const List<T, I>* alpha) {
+    List<T, I> unit;
+    unit.Append(position, 1);
+    List<T, I>* rho = factor_.Btran(&unit);
+    List<T, I>* row = a_->SumScaledRows(rho);
+    UpdateWeights(entering, position, pivot, alpha, row, rho);
+    T ratio = d_[entering] / pivot;
+    row->ForEach([&](tableau_index_t j, T value) {
+      if (not IsBasic(j)) d_[j] -= ratio * value;
+    });
+    rho->ForEach([&](tableau_index_t i, T value) {
+      if (not IsBasic(cols_ + i)) d_[cols_ + i] -= ratio * value;
+    });
+    d_[basis_[position]] = -ratio;
+    d_[entering] = 0;
+    delete row;
+    delete rho;
+  }
+
+  /**
+   * Pricing::Update with the pivot row as row^T = rho^T A and rho for the
+   * slacks, and for the steepest edge kappa = [A I]^T tau for tau the BTRAN
+   * of alpha restricted to the framework, scattered into kappa_.
+   */
+  void UpdateWeights(tableau_index_t entering, tableau_index_t position,
+                     T pivot, const List<T, I>* alpha, const List<T, I>* row,
+                     const List<T, I>* rho) {
+    if (pricing_.Rule() == DANTZIG) return;
+    T weight = pricing_.ColumnWeight(
+        entering, alpha, [&](tableau_index_t p) { return basis_[p]; });
+    List<T, I>* tau = nullptr;
+    List<T, I>* tau_a = nullptr;
+    if (pricing_.Rule() == STEEPEST_EDGE) {
+      List<T, I> projected;
+      alpha->ForEach([&](tableau_index_t p, T value) {
+        if (pricing_.InFramework(basis_[p])) projected.Append(p, value);
+      });
+      tau = factor_.Btran(&projected);
+      tau_a = a_->SumScaledRows(tau);
+      tau_a->ForEach([&](tableau_index_t j, T value) { kappa_[j] = value; });
+      tau->ForEach(
+          [&](tableau_index_t i, T value) { kappa_[cols_ + i] = value; });
+    }
+    pricing_.Update(
+        entering, basis_[position], pivot, weight,
+        [&](auto visit) {
+          row->ForEach([&](tableau_index_t j, T value) {
+            if (not IsBasic(j)) visit(j, value);
+          });
+          rho->ForEach([&](tableau_index_t i, T value) {
+            if (not IsBasic(cols_ + i)) visit(cols_ + i, value);
+          });
+        },
+        kappa_.data());
+    if (tau == nullptr) return;
+    tau_a->ForEach([&](tableau_index_t j, T) { kappa_[j] = 0; });
+    tau->ForEach([&](tableau_index_t i, T) { kappa_[cols_ + i] = 0; });
+    delete tau_a;
+    delete tau;
+  }
+
+  const Tableau<T, I>* a_;
+  tableau_size_t rows_, cols_;
+  std::vector<T> b_;
+  // Per variable, the columns and then the slacks: cost, bounds, value,
+  // reduced cost and whether a nonbasic one is at its upper bound.
+  std::vector<T> c_, lower_, upper_, x_, d_;
+  std::vector<char> at_upper_;
+  // The variable at each basis position, and the position of each, or -1.
+  std::vector<tableau_index_t> basis_, position_of_;
+  // By basis position, x - lower and upper - x of the basic variable.
+  std::vector<T> room_down_, room_up_;
+  // Per variable, the sign of Pricing and kappa of UpdateWeights, which is
+  // zero between calls.
+  std::vector<T> sign_, kappa_;
+  LuFactor<T, I> factor_;
+  Pricing<T, I> pricing_;
+  RatioTest<T, I> ratio_test_;
+  tableau_size_t iterations_ = 0;
+};
@@ -1,8 +1,16 @@
 #include "tableau.h"
+#include "tableau_compressed_list.h"
+#include "tableau_lu.h"
+#include "tableau_pricing.h"
+#include "tableau_ratio_test.h"
+#include "tableau_simplex.h"
+#include "tableau_triangular.h"
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <random>
+
 typedef float T;
 
 template <>
@@ -10,6 +18,11 @@ inline bool _IsZeroT(const T &x) {
   return std::abs(x) < 1e-6;
 }
 
+template <>
+inline bool _IsZeroT(const double &x) {
+  return std::abs(x) < 1e-12;
+}
+
 TEST(List, Append) {
   List<T> list;
   for (auto i = 0; i < 1024; i += 1) {
@@ -35,14 +48,33 @@ TEST(List, Set) {
   }
 }
 
+TEST(List, CopyEmpty) {
+  // Lists without buffers: empty SPARSE, empty DENSE and moved from.
+  List<T> sparse, dense(0, DENSE), moved;
+  moved.Append(3, 1);
+  List<T> target(std::move(moved));
+  for (const List<T> *empty : {&sparse, &dense, &moved}) {
+    List<T> copy(empty);
+    EXPECT_EQ(copy.Size(), 0);
+  }
+  EXPECT_EQ(target.At(3), 1);
+}
+
 TEST(List, Iterator) {
   List<T> list;
   for (auto i = 0; i < 1024; i += 1) list.Append(i, i + 1);
-  auto iter = list.Begin();
-  while (!iter->IsEnd()) {
-    EXPECT_EQ(iter->Index() + 1.0f, iter->Data());
-    iter = iter->Next();
+  tableau_index_t count = 0;
+  for (auto [index, value] : list) {
+    EXPECT_EQ(index + 1.0f, value);
+    count++;
   }
+  EXPECT_EQ(count, list.Size());
+  count = 0;
+  list.ForEach([&](tableau_index_t index, T value) {
+    EXPECT_EQ(index + 1.0f, value);
+    count++;
+  });
+  EXPECT_EQ(count, list.Size());
 }
 
 T transform(const T &x) { return x + 1; }
@@ -154,6 +186,11 @@ TEST(List, Cross) {
       EXPECT_EQ(result->Col(j)->At(i), i);
     }
   }
+  // The rows and columns share private copies of the indices.
+  EXPECT_FALSE(list1.SharesIndex());
+  EXPECT_FALSE(list2.SharesIndex());
+  EXPECT_TRUE(result->Row(0)->SharesIndex());
+  delete result;
 }
 
 TEST(List, SparseCross) {
@@ -220,6 +257,90 @@ TEST(Tableau, AddSparseTableau) {
   }
 }
 
+TEST(Tableau, AddOuterProduct) {
+  List<T> left(0, SPARSE), right(16, DENSE);
+  for (auto i = 0; i < 16; i += 3) left.Append(i, i + 1);
+  for (auto i = 0; i < 16; i++) right.Set(i, i % 4 == 0 ? 0 : i);
+  List<T> bitmap_left(&left);
+  bitmap_left.ConvertTo(BITMAP);
+
+  List<T> ones(0, SPARSE);
+  for (auto i = 0; i < 16; i++) ones.Append(i, 1);
+  Tableau<T> *expected = ones.Cross(&ones, 16, 16);
+  Tableau<T> *lazy = ones.Cross(&ones, 16, 16);
+  Tableau<T> *from_bitmap = ones.Cross(&ones, 16, 16);
+  SparseTableau<T> *product = left.SparseCross(&right);
+  for (auto i = 0; i < product->Rows(); i++) product->Row(i)->Scale(2);
+  for (auto j = 0; j < product->Cols(); j++) product->Col(j)->Scale(2);
+  expected->Add(product);
+  lazy->Add(left.Outer(&right, 2));
+  from_bitmap->Add(OuterProduct<T>(&bitmap_left, &right, 2));
+  for (auto i = 0; i < 16; i++) {
+    for (auto j = 0; j < 16; j++) {
+      EXPECT_EQ(lazy->Row(i)->At(j), 1 + 2 * left.At(i) * right.At(j));
+      EXPECT_EQ(lazy->Row(i)->At(j), expected->Row(i)->At(j));
+      EXPECT_EQ(lazy->Col(j)->At(i), expected->Col(j)->At(i));
+      EXPECT_EQ(from_bitmap->Row(i)->At(j), lazy->Row(i)->At(j));
+      EXPECT_EQ(from_bitmap->Col(j)->At(i), lazy->Col(j)->At(i));
+    }
+  }
+  delete product;
+  delete expected;
+  delete lazy;
+  delete from_bitmap;
+}
+
+TEST(Tableau, RankOneUpdate) {
+  const tableau_size_t size = 64;
+  Tableau<T> *tableau = new Tableau<T>(size, size);
+  Tableau<T> *rows = new Tableau<T>(size, size, ROW_ONLY);
+  // Every third row and column starts out with the values of u * v^T, which
+  // the update below cancels, and every row with a diagonal element.
+  List<T> u(0, SPARSE), v(0, SPARSE), diagonal(0, SPARSE);
+  for (auto i = 0; i < size; i += 3) u.Append(i, i + 1);
+  for (auto j = 1; j < size; j += 3) v.Append(j, j % 5 + 1);
+  for (auto i = 0; i < size; i++) {
+    List<T> *row = new List<T>(0, SPARSE);
+    row->Append(i, 1);
+    tableau->AppendRow(i, row);
+    rows->AppendRow(i, new List<T>(row));
+  }
+  tableau->RankOneUpdate(&u, &v, 1);
+  rows->RankOneUpdate(&u, &v, 1);
+  for (auto i = 0; i < size; i++) {
+    for (auto j = 0; j < size; j++) {
+      T expected = (i == j) + u.At(i) * v.At(j);
+      EXPECT_EQ(tableau->Row(i)->At(j), expected);
+      EXPECT_EQ(tableau->Col(j)->At(i), expected);
+      EXPECT_EQ(rows->Row(i)->At(j), expected);
+    }
+  }
+  tableau->RankOneUpdate(&u, &v, -1);
+  for (auto i = 0; i < size; i++) {
+    EXPECT_EQ(tableau->Row(i)->Size(), 1);
+    EXPECT_EQ(tableau->Col(i)->Size(), 1);
+    EXPECT_EQ(tableau->Row(i)->At(i), 1);
+  }
+  delete tableau;
+  delete rows;
+
+  // A long row gets a few elements galloped in between its own.
+  Tableau<T> *wide = new Tableau<T>(1, 4096, ROW_ONLY);
+  List<T> *row = new List<T>(0, SPARSE);
+  for (auto j = 0; j < 4096; j += 2) row->Append(j, 1);
+  wide->AppendRow(0, row);
+  List<T> first(0, SPARSE), few(0, SPARSE);
+  first.Append(0, 1);
+  for (auto j : {1, 100, 2001, 4095}) few.Append(j, 2);
+  wide->RankOneUpdate(&first, &few, 1);
+  EXPECT_EQ(wide->Row(0)->Size(), 2048 + 3);
+  for (auto j = 0; j < 4096; j++)
+    EXPECT_EQ(wide->Row(0)->At(j),
+              (j % 2 == 0) + 2 * (j == 1 or j == 100 or j == 2001 or
+                                  j == 4095));
+  delete wide;
+}
+
 TEST(Tableau, AppendRow) {
   Tableau<T> *tableau = new Tableau<T>(16, 16);
   for (auto i = 0; i < 16; i++) {
@@ -292,6 +413,282 @@ TEST(Tableau, SumScaledRows2) {
   }
 }
 
+TEST(Tableau, SumScaledRowsParallel) {
+  const tableau_size_t rows = 256, cols = 64;
+  int threads = omp_get_max_threads();
+  omp_set_num_threads(4);
+  auto value = [](tableau_index_t i, tableau_index_t j) -> T {
+    return (i + j) % 3 == 0 ? 0 : i % 5 + 1;
+  };
+  std::vector<Tableau<T> *> tableaus = {
+      new Tableau<T>(rows, cols, ROW_ONLY),
+      new Tableau<T>(rows, cols, COLUMN_ONLY),
+      new Tableau<T>(rows, cols, ROW_AND_COLUMN),
+      new Tableau<T>(rows, cols, ROW_ONLY, CSR_ALLOCATION),
+      new Tableau<T>(rows, cols, ROW_AND_COLUMN, CSR_ALLOCATION)};
+  for (auto tableau : tableaus) {
+    for (auto i = 0; i < rows; i++) {
+      List<T> *list = new List<T>();
+      for (auto j = 0; j < cols; j++)
+        if (value(i, j) != 0) list->Append(j, value(i, j));
+      tableau->AppendRow(i, list);
+    }
+  }
+  // All rows go through the per thread sums or the columns, two rows
+  // through a single sum.
+  List<T> dense_scale(rows, DENSE), sparse_scale;
+  for (auto i = 0; i < rows; i++) dense_scale.Set(i, i % 4);
+  sparse_scale.Append(7, 2);
+  sparse_scale.Append(200, -1);
+  for (auto scale : {&dense_scale, &sparse_scale}) {
+    for (auto tableau : tableaus) {
+      List<T> *sum = tableau->SumScaledRows(scale);
+      for (auto j = 0; j < cols; j++) {
+        T expected = 0;
+        for (auto i = 0; i < rows; i++) expected += scale->At(i) * value(i, j);
+        EXPECT_EQ(sum->At(j), expected);
+      }
+      delete sum;
+    }
+  }
+  for (auto tableau : tableaus) delete tableau;
+  omp_set_num_threads(threads);
+}
+
+TEST(Tableau, MultiVector) {
+  const tableau_size_t rows = 300, cols = 200;
+  int threads = omp_get_max_threads();
+  SimdLevel detected = GetSimdLevel();
+  std::mt19937 rng(5);
+  std::vector<Tableau<T> *> tableaus = {
+      new Tableau<T>(rows, cols, ROW_ONLY),
+      new Tableau<T>(rows, cols, COLUMN_ONLY),
+      new Tableau<T>(rows, cols, ROW_AND_COLUMN, HEAP_ALLOCATION, BITMAP),
+      new Tableau<T>(rows, cols, ROW_ONLY, CSR_ALLOCATION)};
+  for (auto i = 0; i < rows; i++) {
+    List<T> list;
+    for (auto j = 0; j < cols; j++)
+      if (rng() % 5 == 0) list.Append(j, 1 + rng() % 4);
+    for (auto tableau : tableaus) tableau->AppendRow(i, new List<T>(&list));
+  }
+  // 17 vectors are one more than a whole number of vector widths.
+  for (tableau_size_t k : {1, 3, 16, 17}) {
+    std::vector<List<T> *> xs, scales;
+    for (auto j = 0; j < k; j++) {
+      xs.push_back(new List<T>(cols, DENSE));
+      for (auto c = 0; c < cols; c++) xs[j]->Set(c, rng() % 3);
+      scales.push_back(new List<T>());
+      for (auto r = 0; r < rows; r += 1 + rng() % 4)
+        scales[j]->Append(r, 1 + rng() % 2);
+    }
+    for (int thread_count : {1, 4}) {
+      omp_set_num_threads(thread_count);
+      for (auto level : {SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512}) {
+        SetSimdLevel(level);
+        for (auto tableau : tableaus) {
+          std::vector<List<T> *> sums = tableau->SumScaledRows(scales);
+          for (auto j = 0; j < k; j++) {
+            List<T> *expected = tableau->SumScaledRows(scales[j]);
+            for (auto c = 0; c < cols; c++)
+              ASSERT_EQ(sums[j]->At(c), expected->At(c));
+            delete expected;
+            delete sums[j];
+          }
+          if (tableau->StorageFormat() == COLUMN_ONLY) continue;
+          std::vector<List<T> *> products = tableau->Times(xs);
+          for (auto j = 0; j < k; j++) {
+            List<T> *expected = tableau->Times(xs[j]);
+            for (auto r = 0; r < rows; r++)
+              ASSERT_EQ(products[j]->At(r), expected->At(r));
+            delete expected;
+            delete products[j];
+          }
+        }
+      }
+    }
+    for (auto j = 0; j < k; j++) {
+      delete xs[j];
+      delete scales[j];
+    }
+  }
+  for (auto tableau : tableaus) delete tableau;
+  SetSimdLevel(detected);
+  omp_set_num_threads(threads);
+}
+
+TEST(Tableau, Pivot) {
+  const tableau_size_t rows = 16, cols = 24;
+  int threads = omp_get_max_threads();
+  std::mt19937 rng(3);
+  std::vector<std::vector<double>> dense(rows, std::vector<double>(cols));
+  for (auto &row : dense)
+    for (auto &value : row)
+      if (rng() % 3 == 0) value = 1 + rng() % 5;
+  std::vector<Tableau<T> *> tableaus = {
+      new Tableau<T>(rows, cols), new Tableau<T>(rows, cols, ROW_ONLY),
+      new Tableau<T>(rows, cols, COLUMN_ONLY),
+      new Tableau<T>(rows, cols, ROW_AND_COLUMN, CSR_ALLOCATION)};
+  for (auto tableau : tableaus) {
+    // AppendRow fills in the columns of a ROW_AND_COLUMN tableau as well.
+    if (tableau->StorageFormat() != COLUMN_ONLY) {
+      for (auto i = 0; i < rows; i++) {
+        List<T> *row = new List<T>();
+        for (auto j = 0; j < cols; j++)
+          if (dense[i][j] != 0) row->Append(j, dense[i][j]);
+        tableau->AppendRow(i, row);
+      }
+    } else {
+      for (auto j = 0; j < cols; j++) {
+        List<T> *col = new List<T>();
+        for (auto i = 0; i < rows; i++)
+          if (dense[i][j] != 0) col->Append(i, dense[i][j]);
+        tableau->AppendCol(j, col);
+      }
+    }
+  }
+  // Pivot on the first nonzero of the first few rows, as Gauss-Jordan would.
+  for (auto row = 0; row < 6; row++) {
+    auto col = 0;
+    while (std::abs(dense[row][col]) < 1e-9) col++;
+    double pivot = dense[row][col];
+    for (auto &value : dense[row]) value /= pivot;
+    for (auto i = 0; i < rows; i++) {
+      double factor = dense[i][col];
+      if (i == row or factor == 0) continue;
+      for (auto j = 0; j < cols; j++) dense[i][j] -= factor * dense[row][j];
+      dense[i][col] = 0;
+    }
+    omp_set_num_threads(row % 2 == 0 ? 1 : 4);
+    for (auto tableau : tableaus) {
+      tableau->Pivot(row, col);
+      for (auto i = 0; i < rows; i++) {
+        EXPECT_EQ(tableau->At(i, col), i == row);
+        for (auto j = 0; j < cols; j++)
+          ASSERT_NEAR(tableau->At(i, j), dense[i][j],
+                      1e-4 * (1 + std::abs(dense[i][j])));
+      }
+      if (tableau->StorageFormat() != ROW_AND_COLUMN) continue;
+      // Both orientations hold the same values, and col only once.
+      EXPECT_EQ(tableau->Col(col)->Size(), 1);
+      for (auto i = 0; i < rows; i++)
+        for (auto j = 0; j < cols; j++)
+          EXPECT_EQ(tableau->Row(i)->At(j), tableau->Col(j)->At(i));
+    }
+  }
+  omp_set_num_threads(threads);
+  for (auto tableau : tableaus) delete tableau;
+}
+
+TEST(Tableau, ColumnPanels) {
+  const tableau_size_t rows = 64, cols = 1000;
+  int threads = omp_get_max_threads();
+  std::mt19937 rng(7);
+  std::vector<Tableau<T> *> tableaus = {
+      new Tableau<T>(rows, cols, ROW_ONLY),
+      new Tableau<T>(rows, cols, ROW_AND_COLUMN, HEAP_ALLOCATION, BITMAP),
+      new Tableau<T>(rows, cols, ROW_ONLY, CSR_ALLOCATION)};
+  // Row 5 stays empty and row 9 is a single element.
+  for (auto i = 0; i < rows; i++) {
+    if (i == 5) continue;
+    List<T> list;
+    for (auto j = 0; j < cols; j++)
+      if (i == 9 ? j == 500 : rng() % 7 == 0) list.Append(j, 1 + rng() % 4);
+    for (auto tableau : tableaus) tableau->AppendRow(i, new List<T>(&list));
+  }
+  List<T> x(cols, DENSE);
+  for (auto j = 0; j < cols; j++) x.Set(j, rng() % 5);
+  for (auto tableau : tableaus) {
+    List<T> *expected = tableau->Times(&x);
+    // 37 does not divide the columns, and 1 is a panel per column.
+    for (tableau_size_t panel_columns : {37, 1, 0}) {
+      tableau->BuildColumnPanels(panel_columns);
+      EXPECT_TRUE(tableau->HasColumnPanels());
+      for (int thread_count : {1, 4}) {
+        omp_set_num_threads(thread_count);
+        List<T> *result = tableau->Times(&x);
+        for (auto i = 0; i < rows; i++)
+          ASSERT_EQ(result->At(i), expected->At(i));
+        delete result;
+      }
+    }
+    tableau->AppendRow(5, new List<T>());
+    EXPECT_FALSE(tableau->HasColumnPanels());
+    // A write through Row() shows in the next product.
+    tableau->BuildColumnPanels(37);
+    const Tableau<T> *reader = tableau;
+    reader->ReadRow(9, [](const List<T> *) {});
+    EXPECT_TRUE(tableau->HasColumnPanels());
+    tableau->Row(9)->Set(500, 100);
+    EXPECT_FALSE(tableau->HasColumnPanels());
+    List<T> *result = tableau->Times(&x);
+    EXPECT_EQ(result->At(9), 100 * x.At(500));
+    delete result;
+    delete expected;
+    delete tableau;
+  }
+  omp_set_num_threads(threads);
+}
+
+TEST(Tableau, SumScaledRowsSparse) {
+  const tableau_size_t rows = 8, cols = 4096;
+  std::vector<Tableau<T> *> tableaus = {
+      new Tableau<T>(rows, cols, ROW_ONLY),
+      new Tableau<T>(rows, cols, ROW_AND_COLUMN),
+      new Tableau<T>(rows, cols, ROW_ONLY, CSR_ALLOCATION)};
+  for (auto tableau : tableaus) {
+    // Rows 0 and 1 cancel in column 100, which row 2 touches again.
+    for (auto i = 0; i < rows; i++) {
+      List<T> *list = new List<T>();
+      list->Append(100, i == 1 ? -1 : 1);
+      list->Append(1000 + i, i + 1);
+      tableau->AppendRow(i, list);
+    }
+    List<T> scale;
+    scale.Append(0, 1);
+    scale.Append(1, 1);
+    List<T> *sum = tableau->SumScaledRows(&scale);
+    EXPECT_EQ(sum->StorageFormat(), SPARSE);
+    EXPECT_EQ(sum->Size(), 2);
+    EXPECT_EQ(sum->At(100), 0);
+    EXPECT_EQ(sum->At(1000), 1);
+    EXPECT_EQ(sum->At(1001), 2);
+    delete sum;
+    scale.Append(2, 2);
+    scale.Append(5, 1);
+    sum = tableau->SumScaledRows(&scale);
+    EXPECT_EQ(sum->Size(), 5);
+    EXPECT_EQ(sum->At(100), 3);
+    EXPECT_EQ(sum->At(1002), 6);
+    EXPECT_EQ(sum->At(1005), 6);
+    delete sum;
+    // The workspace grows with the tableau.
+    List<T> *extra = new List<T>();
+    extra->Append(5, 7);
+    tableau->AppendExtraCol(extra);
+    sum = tableau->SumScaledRows(&scale);
+    EXPECT_EQ(sum->Size(), 6);
+    EXPECT_EQ(sum->At(cols), 7);
+    delete sum;
+    // A sum that finds the workspace in use by another thread uses its own.
+    std::vector<tableau_size_t> sizes(64);
+    std::vector<T> values(64);
+#pragma omp parallel for num_threads(4)
+    for (auto k = 0; k < 64; k++) {
+      List<T> row;
+      row.Append(k % rows, 1);
+      List<T> *part = tableau->SumScaledRows(&row);
+      sizes[k] = part->Size();
+      values[k] = part->At(1000 + k % rows);
+      delete part;
+    }
+    for (auto k = 0; k < 64; k++) {
+      EXPECT_EQ(sizes[k], k % rows == 5 ? 3 : 2);
+      EXPECT_EQ(values[k], k % rows + 1);
+    }
+    delete tableau;
+  }
+}
+
 TEST(Tableau, Times) {
   Tableau<T> *tableau = new Tableau<T>(16, 1024, ROW_ONLY);
   for (auto i = 0; i < 16; i++) {
@@ -307,4 +704,1153 @@ TEST(Tableau, Times) {
   for (auto i = 0; i < 16; i++) {
     EXPECT_EQ(result->At(i), 128);
   }
-}
\ No newline at end of file
+  // Row i has 2^(i / 2) elements so the thread shares differ in rows.
+  Tableau<T> *skewed = new Tableau<T>(16, 1024, ROW_ONLY);
+  for (auto i = 0; i < 16; i++) {
+    List<T> *list = new List<T>();
+    for (auto j = 0; j < (1 << (i / 2)); j++) list->Append(j, 1);
+    skewed->AppendRow(i, list);
+  }
+  List<T> *sparse_x = new List<T>();
+  for (auto j = 0; j < 1024; j += 2) sparse_x->Append(j, 1);
+  List<T> *dense_result = skewed->Times(x);
+  List<T> *sparse_result = skewed->Times(sparse_x);
+  for (auto i = 0; i < 16; i++) {
+    EXPECT_EQ(dense_result->At(i), 1 << (i / 2));
+    EXPECT_EQ(sparse_result->At(i), (1 << (i / 2)) / 2 + (i < 2 ? 1 : 0));
+  }
+  delete skewed;
+  delete sparse_x;
+  delete dense_result;
+  delete sparse_result;
+}
+TEST(Tableau, LazyLists) {
+  for (auto format : {SPARSE, AUTO, BITMAP}) {
+    Tableau<T> *tableau =
+        new Tableau<T>(1024, 16, ROW_AND_COLUMN, HEAP_ALLOCATION, format);
+    // Only rows 3 and 700 and columns 1 and 5 are ever written.
+    List<T> *list = new List<T>();
+    list->Append(1, 2);
+    list->Append(5, 3);
+    tableau->AppendRow(3, list);
+    List<T> *u = new List<T>();
+    u->Append(700, 1);
+    List<T> *v = new List<T>();
+    v->Append(5, 4);
+    tableau->RankOneUpdate(u, v, 1);
+    EXPECT_EQ(tableau->At(3, 1), 2);
+    EXPECT_EQ(tableau->At(700, 5), 4);
+    EXPECT_EQ(tableau->At(500, 5), 0);
+    EXPECT_EQ(tableau->At(500, 9), 0);
+    List<T> *x = new List<T>(16, DENSE);
+    for (auto j = 0; j < 16; j++) x->Append(j, 1);
+    List<T> *result = tableau->Times(x);
+    EXPECT_EQ(result->At(3), 5);
+    EXPECT_EQ(result->At(700), 4);
+    EXPECT_EQ(result->At(4), 0);
+    List<T> *scale = new List<T>();
+    for (auto i = 0; i < 1024; i += 7) scale->Append(i, 1);
+    List<T> *sum = tableau->SumScaledRows(scale);
+    EXPECT_EQ(sum->At(5), 4);
+    EXPECT_EQ(sum->At(1), 0);
+    // Const readers share one empty list and leave the tableau alone, Add
+    // only creates the lines the other tableau has.
+    const Tableau<T> *reader = tableau;
+    EXPECT_EQ(reader->Row(42), reader->Row(43));
+    EXPECT_EQ(reader->Col(9), reader->Col(10));
+    Tableau<T> twice(1024, 16, ROW_AND_COLUMN, HEAP_ALLOCATION, format);
+    twice.Add(tableau);
+    twice.Add(tableau);
+    EXPECT_EQ(twice.At(700, 5), 8);
+    const Tableau<T> *sum_reader = &twice;
+    EXPECT_EQ(sum_reader->Row(42), reader->Row(42));
+    EXPECT_EQ(sum_reader->Col(9)->Size(), 0);
+    // Row() hands out an empty list even if the row was never written.
+    EXPECT_EQ(tableau->Row(42)->Size(), 0);
+    EXPECT_EQ(tableau->Col(9)->StorageFormat(),
+              format == BITMAP ? BITMAP : SPARSE);
+    delete tableau;
+    delete u;
+    delete v;
+    delete x;
+    delete result;
+    delete scale;
+    delete sum;
+  }
+}
+TEST(ArenaAllocator, ReusesFreedBlocks) {
+  ArenaAllocator arena;
+  void *first = arena.Allocate(100);
+  arena.Deallocate(first, 100);
+  // 100 and 128 bytes share a size class.
+  EXPECT_EQ(arena.Allocate(128), first);
+  EXPECT_EQ(arena.Allocations(), 2);
+  EXPECT_EQ(arena.SystemAllocations(), 1);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(arena.Allocate(256)) %
+                ListAllocator::kListBufferAlignment,
+            0);
+}
+
+TEST(HeapAllocator, AlignsLargeBuffers) {
+  HeapAllocator *heap = HeapAllocator::Instance();
+  void *small = heap->Allocate(12);
+  void *large = heap->Allocate(100);
+  EXPECT_NE(small, nullptr);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(large) %
+                ListAllocator::kListBufferAlignment,
+            0);
+  heap->Deallocate(small, 12);
+  heap->Deallocate(large, 100);
+}
+
+TEST(List, AppendArena) {
+  ArenaAllocator arena;
+  List<T> list(0, SPARSE, &arena);
+  for (auto i = 0; i < 1024; i += 1) list.Append(i, i + 1);
+  for (auto i = 0; i < 1024; i += 1) EXPECT_EQ(list.At(i), i + 1);
+  EXPECT_EQ(list.Allocator(), &arena);
+}
+
+TEST(Tableau, ArenaAllocation) {
+  Tableau<T> *tableau =
+      new Tableau<T>(16, 16, ROW_AND_COLUMN, ARENA_ALLOCATION);
+  for (auto i = 0; i < 16; i++) {
+    // Lists from the arena are adopted, heap lists are copied into it.
+    List<T> *list = i % 2 == 0 ? tableau->NewList() : new List<T>();
+    for (auto j = 0; j < 16; j++) {
+      list->Append(j, i + j);
+    }
+    tableau->AppendRow(i, list);
+  }
+  for (auto i = 0; i < 16; i++) {
+    EXPECT_EQ(tableau->Row(i)->Allocator(), tableau->Allocator());
+    for (auto j = 0; j < 16; j++) {
+      EXPECT_EQ(tableau->At(i, j), i + j);
+      EXPECT_EQ(tableau->Col(j)->At(i), i + j);
+    }
+  }
+  tableau->Add(tableau);
+  for (auto i = 0; i < 16; i++) {
+    for (auto j = 0; j < 16; j++) {
+      EXPECT_EQ(tableau->At(i, j), 2 * (i + j));
+    }
+  }
+  delete tableau;
+}
+
+TEST(Tableau, CsrAllocation) {
+  const tableau_size_t size = 64;
+  Tableau<T> *heap = new Tableau<T>(size, size);
+  Tableau<T> *csr =
+      new Tableau<T>(size, size, ROW_AND_COLUMN, CSR_ALLOCATION);
+  for (auto i = 0; i < size; i += 2) {
+    List<T> *row = new List<T>();
+    for (auto j = i % 3; j < size; j += 3) row->Append(j, i + j);
+    heap->AppendRow(i, new List<T>(row));
+    csr->AppendRow(i, row);
+  }
+  // Rows and columns outgrow their slots and move out, then get repacked.
+  List<T> u(0, SPARSE), v(0, SPARSE);
+  for (auto i = 1; i < size; i += 4) u.Append(i, 2);
+  for (auto j = 0; j < size; j += 5) v.Append(j, j + 1);
+  for (auto k = 0; k < 3; k++) {
+    heap->RankOneUpdate(&u, &v, 1);
+    csr->RankOneUpdate(&u, &v, 1);
+  }
+  heap->Add(heap);
+  csr->Add(csr);
+  List<T> *column = new List<T>();
+  for (auto i = 0; i < size; i += 7) column->Append(i, 1);
+  heap->AppendExtraCol(new List<T>(column));
+  csr->AppendExtraCol(column);
+  for (auto i = 0; i < size; i++) {
+    for (auto j = 0; j <= size; j++) {
+      EXPECT_EQ(csr->At(i, j), heap->At(i, j));
+      EXPECT_EQ(csr->Col(j)->At(i), heap->Col(j)->At(i));
+    }
+  }
+  List<T> x(size + 1, DENSE), scale(0, SPARSE);
+  for (auto j = 0; j <= size; j++) x.Set(j, j % 4);
+  for (auto i = 0; i < size; i += 3) scale.Append(i, i);
+  List<T> *heap_times = heap->Times(&x), *csr_times = csr->Times(&x);
+  List<T> *heap_sum = heap->SumScaledRows(&scale);
+  List<T> *csr_sum = csr->SumScaledRows(&scale);
+  for (auto i = 0; i < size; i++)
+    EXPECT_EQ(csr_times->At(i), heap_times->At(i));
+  for (auto j = 0; j <= size; j++) EXPECT_EQ(csr_sum->At(j), heap_sum->At(j));
+  // A view handed out by Row() keeps tracking the row.
+  List<T> *row = csr->Row(1);
+  csr->RankOneUpdate(&u, &v, -1);
+  heap->RankOneUpdate(&u, &v, -1);
+  for (auto j = 0; j <= size; j++) EXPECT_EQ(row->At(j), heap->At(1, j));
+  csr->RemoveExtraCol();
+  heap->RemoveExtraCol();
+  for (auto i = 0; i < size; i++)
+    EXPECT_EQ(csr->At(i, size - 1), heap->At(i, size - 1));
+  delete heap_times;
+  delete csr_times;
+  delete heap_sum;
+  delete csr_sum;
+  delete heap;
+  delete csr;
+}
+
+TEST(List, SparseCrossArena) {
+  List<T> list1, list2;
+  for (auto i = 0; i < 16; i += 1) {
+    list1.Append(i, i);
+    list2.Append(i, 1);
+  }
+  SparseTableau<T> *sparse_tableau =
+      list1.SparseCross(&list2, ROW_AND_COLUMN, ARENA_ALLOCATION);
+  for (auto i = 0; i < 16; i++) {
+    for (auto j = 0; j < 16; j++) {
+      EXPECT_EQ(sparse_tableau->Row(i)->At(j), i);
+      EXPECT_EQ(sparse_tableau->Col(j)->At(i), i);
+    }
+  }
+  delete sparse_tableau;
+}
+
+TEST(List, AddReusesSpareBuffers) {
+  ArenaAllocator arena;
+  List<T> list1(0, SPARSE, &arena), list2(0, SPARSE, &arena);
+  for (auto i = 0; i < 1024; i += 1) {
+    list1.Append(2 * i, 1);
+    list2.Append(2 * i + 1, 1);
+  }
+  // Both buffers settle at the capacity of the merged size bound.
+  for (auto i = 0; i < 4; i++) list1.Add(&list2);
+  int64_t allocations = arena.Allocations();
+  for (auto i = 0; i < 14; i++) list1.Add(&list2);
+  EXPECT_EQ(arena.Allocations(), allocations);
+  for (auto i = 0; i < 1024; i++) {
+    EXPECT_EQ(list1.At(2 * i), 1);
+    EXPECT_EQ(list1.At(2 * i + 1), 18);
+  }
+  list1.Mul(&list2);
+  EXPECT_EQ(arena.Allocations(), allocations);
+  EXPECT_EQ(list1.Size(), 1024);
+  EXPECT_EQ(list1.At(1), 18);
+}
+
+TEST(List, SparseIntersectSimdLevels) {
+  List<T> list1, list2;
+  std::mt19937 rng(42);
+  for (auto i = 0; i < 4096; i++) {
+    if (rng() % 3 != 0) list1.Append(i, i % 7 + 1);
+    if (rng() % 2 != 0) list2.Append(i, i % 5 + 1);
+  }
+  SimdLevel detected = GetSimdLevel();
+  SetSimdLevel(SIMD_SCALAR);
+  T expected_dot = list1.Dot(&list2);
+  List<T> expected_mul(&list1);
+  expected_mul.Mul(&list2);
+  for (auto level : {SIMD_AVX2, SIMD_AVX512}) {
+    SetSimdLevel(level);
+    EXPECT_EQ(list1.Dot(&list2), expected_dot);
+    List<T> mul(&list1);
+    mul.Mul(&list2);
+    ASSERT_EQ(mul.Size(), expected_mul.Size());
+    for (auto i = 0; i < 4096; i++) EXPECT_EQ(mul.At(i), expected_mul.At(i));
+  }
+  SetSimdLevel(detected);
+}
+
+TEST(List, GallopSkewedOperands) {
+  List<T> long_list, short_list;
+  std::mt19937 rng(7);
+  for (auto i = 0; i < 8192; i++)
+    if (rng() % 4 != 0) long_list.Append(i, i % 9 + 1);
+  for (auto i = 0; i < 8192; i += 97) short_list.Append(i, i % 3 + 1);
+  int64_t ratio = GetGallopRatio();
+  SetGallopRatio(0);
+  T expected_dot = long_list.Dot(&short_list);
+  List<T> expected_mul(&long_list), expected_add(&long_list);
+  expected_mul.Mul(&short_list);
+  expected_add.AddScaled(&short_list, -1, true);
+  SetGallopRatio(ratio);
+  ASSERT_TRUE(ShouldGallop(long_list.Size(), short_list.Size()));
+  EXPECT_EQ(long_list.Dot(&short_list), expected_dot);
+  EXPECT_EQ(short_list.Dot(&long_list), expected_dot);
+  List<T> mul(&long_list), add(&long_list);
+  mul.Mul(&short_list);
+  add.AddScaled(&short_list, -1, true);
+  ASSERT_EQ(mul.Size(), expected_mul.Size());
+  ASSERT_EQ(add.Size(), expected_add.Size());
+  for (auto i = 0; i < 8192; i++) {
+    EXPECT_EQ(mul.At(i), expected_mul.At(i));
+    EXPECT_EQ(add.At(i), expected_add.At(i));
+  }
+}
+
+template <typename U>
+void ExpectDenseKernels(int64_t n) {
+  SimdLevel detected = GetSimdLevel();
+  for (auto level : {SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512}) {
+    SetSimdLevel(level);
+    List<U> x(n, DENSE), y(n, DENSE);
+    U expected_dot = 0;
+    for (auto i = 0; i < n; i++) {
+      x.Append(i, U(i % 13) - 6);
+      y.Append(i, U(i % 7) + 1);
+      expected_dot += x.At(i) * y.At(i);
+    }
+    // Small integers, so every order of summation is exact.
+    if (n < 4096) {
+      EXPECT_EQ(x.Dot(&y), expected_dot);
+    }
+    y.AddScaled(&x, 2, true);
+    y.Add(&x);
+    y.Mul(&x);
+    y.Scale(-1);
+    for (auto i = 0; i < n; i++) {
+      U expected = -(U(i % 7) + 1 + 3 * (U(i % 13) - 6)) * (U(i % 13) - 6);
+      ASSERT_EQ(y.At(i), expected) << "level " << level << " at " << i;
+    }
+  }
+  SetSimdLevel(detected);
+}
+
+TEST(List, DenseKernels) {
+  ExpectDenseKernels<float>(1003);
+  ExpectDenseKernels<double>(1003);
+  ExpectDenseKernels<float>(5);
+}
+
+TEST(List, DenseKernelsStreamingStores) {
+  const int64_t n = kStreamingStoreBytes / sizeof(double) + 3;
+  // Lists accumulate in place, so they keep their outputs in the cache.
+  ExpectDenseKernels<double>(n);
+  SimdLevel detected = GetSimdLevel();
+  // Aligned, as the streaming stores need.
+  HeapAllocator *heap = HeapAllocator::Instance();
+  double *x = heap->AllocateArray<double>(n);
+  double *y = heap->AllocateArray<double>(n);
+  for (auto level : {SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512}) {
+    SetSimdLevel(level);
+    for (auto i = 0; i < n; i++) {
+      x[i] = i % 13 - 6.0;
+      y[i] = i % 7 + 1.0;
+    }
+    DenseAxpy(y, x, 2.0, n, true);
+    DenseMul(y, x, n, true);
+    DenseScale(y, -1.0, n, true);
+    for (auto i = 0; i < n; i++) {
+      double expected = -(i % 7 + 1 + 2 * (i % 13 - 6.0)) * (i % 13 - 6.0);
+      ASSERT_EQ(y[i], expected) << "level " << level << " at " << i;
+    }
+  }
+  heap->DeallocateArray(x, n);
+  heap->DeallocateArray(y, n);
+  SetSimdLevel(detected);
+}
+
+TEST(List, GatherScatterKernels) {
+  // Large enough for the kernels to prefetch.
+  int64_t dense_size = 2000003;
+  List<T> sparse, dense(dense_size, DENSE);
+  std::mt19937 rng(3);
+  for (auto i = 0; i < dense_size; i++) {
+    dense.Append(i, i % 11);
+    if (rng() % 97 == 0) sparse.Append(i, i % 5 + 1);
+  }
+  T expected_dot = 0;
+  for (auto i = 0; i < dense_size; i++)
+    expected_dot += sparse.At(i) * dense.At(i);
+  SimdLevel detected = GetSimdLevel();
+  int64_t distance = GetPrefetchDistance();
+  for (int64_t prefetch : {int64_t(0), distance}) {
+    SetPrefetchDistance(prefetch);
+    for (auto level : {SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512}) {
+      SetSimdLevel(level);
+      EXPECT_EQ(sparse.Dot(&dense), expected_dot);
+      EXPECT_EQ(dense.Dot(&sparse), expected_dot);
+      List<T> sum(&dense);
+      sum.AddScaled(&sparse, 2, true);
+      for (auto i = 0; i < dense_size; i++)
+        ASSERT_EQ(sum.At(i), dense.At(i) + 2 * sparse.At(i));
+    }
+  }
+  SetPrefetchDistance(distance);
+  SetSimdLevel(detected);
+}
+
+TEST(List, AutoFormat) {
+  ListFormatConversions &conversions = GetListFormatConversions();
+  int64_t to_dense = conversions.to_dense, to_sparse = conversions.to_sparse;
+  ListDensityThresholds thresholds = GetListDensityThresholds();
+  List<T> list(100, AUTO), other(100, AUTO);
+  EXPECT_TRUE(list.IsAdaptive());
+  for (auto i = 0; i < 100; i += 3) list.Append(i, 1);
+  EXPECT_EQ(list.StorageFormat(), SPARSE);
+  for (auto i = 1; i < 100; i += 3) other.Append(i, 2);
+  list.Add(&other);
+  // 67 of 100 stored, above to_dense.
+  EXPECT_EQ(list.StorageFormat(), DENSE);
+  EXPECT_EQ(conversions.to_dense, to_dense + 1);
+  EXPECT_EQ(list.Size(), 100);
+  for (auto i = 0; i < 100; i++)
+    EXPECT_EQ(list.At(i), i % 3 == 2 ? 0 : i % 3 + 1);
+  // Removing 34 leaves 33 percent, between the thresholds, so no change.
+  other.Scale(-1);
+  list.Add(&other);
+  EXPECT_EQ(list.StorageFormat(), DENSE);
+  SetListDensityThresholds(0.5, 0.4);
+  List<T> ones(100, DENSE);
+  ones.Append(0, 1);
+  list.Mul(&ones);
+  EXPECT_EQ(list.StorageFormat(), SPARSE);
+  EXPECT_EQ(conversions.to_sparse, to_sparse + 1);
+  EXPECT_EQ(list.Size(), 1);
+  EXPECT_EQ(list.At(0), 1);
+  SetListDensityThresholds(thresholds.to_dense, thresholds.to_sparse);
+}
+
+TEST(Tableau, AutoListFormat) {
+  Tableau<T> *tableau =
+      new Tableau<T>(16, 16, ROW_AND_COLUMN, HEAP_ALLOCATION, AUTO);
+  for (auto i = 0; i < 16; i++) {
+    List<T> *list = new List<T>();
+    for (auto j = 0; j < 16; j += 2) list->Append(j, i + j);
+    tableau->AppendRow(i, list);
+  }
+  for (auto j = 0; j < 16; j++)
+    EXPECT_EQ(tableau->Col(j)->StorageFormat(), j % 2 == 0 ? DENSE : SPARSE);
+  List<T> *extra = new List<T>();
+  for (auto i = 0; i < 16; i++) extra->Append(i, 1);
+  tableau->AppendExtraCol(extra);
+  tableau->AppendExtraCol(new List<T>());
+  EXPECT_EQ(tableau->Cols(), 18);
+  tableau->RemoveExtraCol();
+  List<T> *x = new List<T>(17, DENSE);
+  for (auto j = 0; j < 17; j++) x->Append(j, 1);
+  List<T> *result = tableau->Times(x);
+  for (auto i = 0; i < 16; i++) EXPECT_EQ(result->At(i), 8 * i + 56 + 1);
+  delete tableau;
+}
+
+TEST(List, BitmapFormat) {
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<T> value(1, 2);
+  List<T> sparse_a, sparse_b;
+  for (auto i = 0; i < 300; i++) {
+    if (rng() % 3 == 0) sparse_a.Append(i, value(rng));
+    if (rng() % 2 == 0) sparse_b.Append(i, value(rng));
+  }
+  List<T> a(&sparse_a), b(&sparse_b), dense_b(&sparse_b);
+  a.ConvertTo(BITMAP);
+  b.ConvertTo(BITMAP);
+  dense_b.ConvertTo(DENSE);
+  EXPECT_EQ(a.StorageFormat(), BITMAP);
+  EXPECT_EQ(a.Size(), sparse_a.Size());
+  for (auto i = 0; i < 310; i++) EXPECT_EQ(a.At(i), sparse_a.At(i));
+  tableau_index_t count = 0;
+  for (auto element : a) {
+    EXPECT_EQ(element.value, sparse_a.At(element.index));
+    count++;
+  }
+  EXPECT_EQ(count, a.Size());
+
+  T dot = sparse_a.Dot(&sparse_b);
+  EXPECT_NEAR(a.Dot(&b), dot, 1e-3);
+  EXPECT_NEAR(a.Dot(&sparse_b), dot, 1e-3);
+  EXPECT_NEAR(sparse_a.Dot(&b), dot, 1e-3);
+  EXPECT_NEAR(a.Dot(&dense_b), dot, 1e-3);
+
+  List<T> sum(&a), product(&a), expected_sum(&sparse_a),
+      expected_product(&sparse_a);
+  sum.AddScaled(&b, -1, true);
+  expected_sum.AddScaled(&sparse_b, -1, true);
+  product.Mul(&b);
+  expected_product.Mul(&sparse_b);
+  EXPECT_EQ(sum.StorageFormat(), BITMAP);
+  EXPECT_EQ(sum.Size(), expected_sum.Size());
+  EXPECT_EQ(product.Size(), expected_product.Size());
+  for (auto i = 0; i < 300; i++) {
+    EXPECT_NEAR(sum.At(i), expected_sum.At(i), 1e-5);
+    EXPECT_NEAR(product.At(i), expected_product.At(i), 1e-5);
+  }
+  // Adding the negation clears every bit.
+  sum.AddScaled(&a, -1, true);
+  sum.AddScaled(&b, 1, true);
+  EXPECT_EQ(sum.Size(), 0);
+
+  // Mixed formats go through SPARSE and keep the format of the target.
+  List<T> mixed(&a);
+  mixed.Add(&dense_b);
+  EXPECT_EQ(mixed.StorageFormat(), BITMAP);
+  mixed.Mul(&sparse_b);
+  dense_b.Mul(&b);
+  for (auto i = 0; i < 300; i++) {
+    EXPECT_NEAR(mixed.At(i), (sparse_a.At(i) + sparse_b.At(i)) * sparse_b.At(i),
+                1e-4);
+    EXPECT_NEAR(dense_b.At(i), sparse_b.At(i) * sparse_b.At(i), 1e-4);
+  }
+
+  // Appending past the end grows the bitmap, Pop drops the last element.
+  a.Append(1000, 3);
+  EXPECT_EQ(a.At(1000), 3);
+  EXPECT_EQ(a.Size(), sparse_a.Size() + 1);
+  a.Pop(1000);
+  EXPECT_EQ(a.At(1000), 0);
+  a.ConvertTo(SPARSE);
+  EXPECT_EQ(a.Size(), sparse_a.Size());
+  for (auto i = 0; i < 300; i++) EXPECT_EQ(a.At(i), sparse_a.At(i));
+  // Once the last element is dropped, appends below it are in order again.
+  product.Append(1000, 3);
+  product.Pop(1000);
+  product.Append(400, 2);
+  EXPECT_EQ(product.At(400), 2);
+  EXPECT_EQ(product.Size(), expected_product.Size() + 1);
+}
+
+TEST(Tableau, BitmapListFormat) {
+  Tableau<T> *tableau =
+      new Tableau<T>(16, 16, ROW_AND_COLUMN, HEAP_ALLOCATION, BITMAP);
+  for (auto i = 0; i < 16; i++) {
+    List<T> *list = new List<T>(16, BITMAP);
+    for (auto j = 0; j < 16; j += 2) list->Append(j, i + j);
+    tableau->AppendRow(i, list);
+  }
+  EXPECT_EQ(tableau->Col(2)->StorageFormat(), BITMAP);
+  EXPECT_EQ(tableau->At(3, 4), 7);
+  EXPECT_EQ(tableau->At(3, 5), 0);
+  List<T> *extra = new List<T>();
+  for (auto i = 0; i < 16; i++) extra->Append(i, 1);
+  tableau->AppendExtraCol(extra);
+  List<T> *x = new List<T>(17, DENSE);
+  for (auto j = 0; j < 17; j++) x->Append(j, 1);
+  List<T> *result = tableau->Times(x);
+  for (auto i = 0; i < 16; i++) EXPECT_EQ(result->At(i), 8 * i + 56 + 1);
+  List<T> *scale = new List<T>(16, BITMAP);
+  scale->Append(1, 1);
+  scale->Append(3, 2);
+  List<T> *sum = tableau->SumScaledRows(scale);
+  for (auto j = 0; j < 16; j += 2) EXPECT_EQ(sum->At(j), 3 * j + 7);
+  delete tableau;
+}
+
+TEST(List, Uint32Index) {
+  List<T> list1, list2, dense(5000, DENSE);
+  List<T, uint32_t> narrow1, narrow2, narrow_dense(5000, DENSE);
+  std::mt19937 rng(3);
+  for (auto i = 0; i < 5000; i++) {
+    if (rng() % 3 != 0) {
+      list1.Append(i, i % 7 + 1);
+      narrow1.Append(i, i % 7 + 1);
+    }
+    if (rng() % 2 != 0) {
+      list2.Append(i, i % 5 + 1);
+      narrow2.Append(i, i % 5 + 1);
+    }
+    dense.Append(i, i % 3);
+    narrow_dense.Append(i, i % 3);
+  }
+  SimdLevel detected = GetSimdLevel();
+  for (auto level : {SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512}) {
+    SetSimdLevel(level);
+    EXPECT_EQ(narrow1.Dot(&narrow2), list1.Dot(&list2));
+    EXPECT_EQ(narrow1.Dot(&narrow_dense), list1.Dot(&dense));
+    List<T> mul(&list1), sum(&dense);
+    List<T, uint32_t> narrow_mul(&narrow1), narrow_sum(&narrow_dense);
+    mul.Mul(&list2);
+    narrow_mul.Mul(&narrow2);
+    sum.AddScaled(&list1, 2, true);
+    narrow_sum.AddScaled(&narrow1, 2, true);
+    ASSERT_EQ(narrow_mul.Size(), mul.Size());
+    for (auto i = 0; i < 5000; i++) {
+      EXPECT_EQ(narrow_mul.At(i), mul.At(i));
+      EXPECT_EQ(narrow_sum.At(i), sum.At(i));
+    }
+  }
+  SetSimdLevel(detected);
+  narrow1.Add(&narrow2);
+  list1.Add(&list2);
+  ASSERT_EQ(narrow1.Size(), list1.Size());
+  for (auto i = 0; i < 5000; i++) EXPECT_EQ(narrow1.At(i), list1.At(i));
+}
+
+TEST(Tableau, Uint32Index) {
+  Tableau<T, uint32_t> *tableau = new Tableau<T, uint32_t>(16, 16);
+  for (auto i = 0; i < 16; i++) {
+    List<T, uint32_t> *list = new List<T, uint32_t>();
+    for (auto j = 0; j < 16; j += 2) list->Append(j, i + j);
+    tableau->AppendRow(i, list);
+  }
+  EXPECT_EQ(tableau->At(3, 4), 7);
+  List<T, uint32_t> *x = new List<T, uint32_t>(16, DENSE);
+  for (auto j = 0; j < 16; j++) x->Append(j, 1);
+  List<T, uint32_t> *result = tableau->Times(x);
+  for (auto i = 0; i < 16; i++) EXPECT_EQ(result->At(i), 8 * i + 56);
+  delete tableau;
+}
+
+TEST(CompressedList, MatchesList) {
+  List<T> list, dense(1 << 22, DENSE);
+  std::mt19937 rng(5);
+  // Runs of small gaps between a few gaps that need 2 and 4 bytes.
+  tableau_index_t index = 3;
+  for (auto i = 0; i < 1000; i++) {
+    list.Append(index, i % 9 + 1);
+    index += i % 300 == 0 ? 70000 : i % 100 == 0 ? 1000 : rng() % 20 + 1;
+  }
+  for (auto i = 0; i < dense.Size(); i++) dense.Append(i, i % 4);
+  CompressedList<T> compressed(&list);
+  EXPECT_EQ(compressed.Size(), list.Size());
+  // Less than two thirds of the 12 bytes per element of a SPARSE list.
+  EXPECT_LT(compressed.Bytes(), list.Size() * 8);
+  for (auto i = 0; i < index; i += 7) EXPECT_EQ(compressed.At(i), list.At(i));
+  tableau_index_t count = 0;
+  compressed.ForEach([&](tableau_index_t i, T value) {
+    EXPECT_EQ(value, list.At(i));
+    count++;
+  });
+  EXPECT_EQ(count, list.Size());
+  EXPECT_EQ(compressed.Dot(&dense), list.Dot(&dense));
+  List<T> expected(&dense);
+  expected.AddScaled(&list, 2, true);
+  compressed.AddScaledTo(&dense, T(2));
+  for (auto i = 0; i < index; i++) ASSERT_EQ(dense.At(i), expected.At(i));
+  List<T, uint32_t> *decompressed = compressed.Decompress<uint32_t>();
+  EXPECT_EQ(decompressed->Size(), list.Size());
+  for (auto i = 0; i < index; i += 7)
+    EXPECT_EQ(decompressed->At(i), list.At(i));
+  delete decompressed;
+}
+
+TEST(List, MoveAndCopy) {
+  List<T> list;
+  for (auto i = 0; i < 100; i += 2) list.Append(i, i + 1);
+  List<T> copy(list);
+  List<T> moved(std::move(list));
+  EXPECT_EQ(list.Size(), 0);
+  list.Append(3, 1);
+  EXPECT_EQ(list.At(3), 1);
+  copy.Append(100, 1);
+  EXPECT_EQ(moved.Size(), 50);
+  EXPECT_EQ(copy.Size(), 51);
+  copy = moved;
+  EXPECT_EQ(copy.Size(), 50);
+  list = std::move(copy);
+  for (auto i = 0; i < 100; i++) EXPECT_EQ(list.At(i), i % 2 ? 0 : i + 1);
+
+  Tableau<T> tableau(4, 4);
+  List<T> *row = new List<T>();
+  row->Append(2, 3);
+  tableau.AppendRow(1, row);
+  Tableau<T> moved_tableau(std::move(tableau));
+  EXPECT_EQ(moved_tableau.At(1, 2), 3);
+  EXPECT_EQ(moved_tableau.Col(2)->At(1), 3);
+  EXPECT_EQ(tableau.Rows(), 0);
+}
+
+TEST(List, SharedIndexCopyOnWrite) {
+  List<T> list, other;
+  for (auto i = 0; i < 64; i += 2) {
+    list.Append(i, 1);
+    other.Append(i + 1, 1);
+  }
+  List<T> *copy = new List<T>(&list, nullptr, SHARE_INDEX);
+  EXPECT_TRUE(list.SharesIndex());
+  EXPECT_TRUE(copy->SharesIndex());
+  copy->Scale(2);
+  EXPECT_EQ(list.At(2), 1);
+  EXPECT_EQ(copy->At(2), 2);
+  // Changing the index of either copies it first.
+  copy->Add(&other);
+  EXPECT_FALSE(list.SharesIndex());
+  EXPECT_EQ(copy->Size(), 64);
+  EXPECT_EQ(list.Size(), 32);
+  EXPECT_EQ(list.At(3), 0);
+  List<T> *copy2 = new List<T>(&list, nullptr, SHARE_INDEX);
+  list.Append(100, 1);
+  EXPECT_FALSE(copy2->SharesIndex());
+  EXPECT_EQ(copy2->At(100), 0);
+  EXPECT_EQ(copy2->At(62), 1);
+  delete copy;
+  delete copy2;
+
+  SparseTableau<T> *sparse_tableau = list.SparseCross(&other);
+  for (auto i = 0; i < sparse_tableau->Rows(); i++)
+    EXPECT_TRUE(sparse_tableau->Row(i)->SharesIndex());
+  EXPECT_EQ(sparse_tableau->Row(0)->At(1), 1);
+  sparse_tableau->Row(0)->Append(200, 1);
+  EXPECT_EQ(sparse_tableau->Row(1)->At(200), 0);
+  EXPECT_EQ(sparse_tableau->Row(1)->At(63), 1);
+  delete sparse_tableau;
+}
+
+/* B x for B given by its columns, as a dense vector. */
+static std::vector<double> DenseTimes(
+    const std::vector<std::vector<double>> &columns, const List<double> *x) {
+  std::vector<double> product(columns.size());
+  x->ForEach([&](tableau_index_t position, double value) {
+    for (size_t i = 0; i < columns.size(); i++)
+      product[i] += columns[position][i] * value;
+  });
+  return product;
+}
+
+TEST(LuFactor, FtranBtranAndUpdates) {
+  // Large enough for the unit vectors and the columns to be hypersparse.
+  const tableau_size_t size = 500;
+  std::mt19937 rng(11);
+  auto random_column = [&](tableau_index_t position) {
+    std::vector<double> column(size);
+    column[position] = 4 + rng() % 4;
+    for (auto k = 0; k < 3; k++) column[rng() % size] += 1 + rng() % 3;
+    return column;
+  };
+  std::vector<std::vector<double>> columns(size);
+  for (auto p = 0; p < size; p++) columns[p] = random_column((p * 7) % size);
+  LuFactor<double> factor(size);
+  auto read_column = [&](tableau_index_t p, auto visit) {
+    for (auto i = 0; i < size; i++)
+      if (columns[p][i] != 0) visit(i, columns[p][i]);
+  };
+  EXPECT_TRUE(factor.Factorize(read_column).empty());
+  for (auto update = 0; update <= 30; update++) {
+    // B x = a and B^T y = e, checked against the columns.
+    List<double> a, e;
+    for (auto i = 0; i < size; i += 1 + rng() % 5) a.Append(i, 1 + rng() % 9);
+    e.Append(rng() % size, 1);
+    List<double> *x = factor.Ftran(&a);
+    std::vector<double> product = DenseTimes(columns, x);
+    for (auto i = 0; i < size; i++) ASSERT_NEAR(product[i], a.At(i), 1e-9);
+    List<double> *y = factor.Btran(&e);
+    for (auto p = 0; p < size; p++) {
+      double dot = 0;
+      y->ForEach([&](tableau_index_t i, double value) {
+        dot += columns[p][i] * value;
+      });
+      ASSERT_NEAR(dot, e.At(p), 1e-9);
+    }
+    delete x;
+    delete y;
+    List<double> unit;
+    unit.Append(rng() % size, 1);
+    x = factor.Ftran(&unit);
+    product = DenseTimes(columns, x);
+    for (auto i = 0; i < size; i++) ASSERT_NEAR(product[i], unit.At(i), 1e-9);
+    delete x;
+    // Replaces a column by one with its pivot in the same row.
+    tableau_index_t position = rng() % size;
+    columns[position] = random_column((position * 7) % size);
+    List<double> column;
+    for (auto i = 0; i < size; i++)
+      if (columns[position][i] != 0) column.Append(i, columns[position][i]);
+    delete factor.Ftran(&column, true);
+    EXPECT_TRUE(factor.Update(position));
+  }
+  EXPECT_EQ(factor.Updates(), 31);
+
+  // A repeated column leaves one position without a pivot, which gets the
+  // unit column of the row that has none.
+  columns[5] = columns[9];
+  auto replaced = factor.Factorize(read_column);
+  EXPECT_EQ(factor.Updates(), 0);
+  ASSERT_EQ(replaced.size(), 1);
+  EXPECT_TRUE(replaced[0].first == 5 or replaced[0].first == 9);
+  columns[replaced[0].first].assign(size, 0);
+  columns[replaced[0].first][replaced[0].second] = 1;
+  List<double> a;
+  for (auto i = 0; i < size; i++) a.Append(i, i + 1);
+  List<double> *x = factor.Ftran(&a);
+  std::vector<double> product = DenseTimes(columns, x);
+  for (auto i = 0; i < size; i++)
+    EXPECT_NEAR(product[i], i + 1, 1e-9 * (i + 1));
+  delete x;
+}
+
+TEST(SparseTriangularSolver, MatchesDenseSweep) {
+  const tableau_size_t size = 300;
+  std::mt19937 rng(17);
+  // A lower triangular L with about three elements below each diagonal.
+  std::vector<std::vector<double>> lower(size, std::vector<double>(size));
+  for (auto j = 0; j < size; j++) {
+    lower[j][j] = 2 + rng() % 3;
+    for (auto k = 0; k < 3 and j + 1 < size; k++)
+      lower[j + 1 + rng() % (size - j - 1)][j] = 1 + rng() % 4;
+  }
+  Tableau<double> m(size, size, ROW_AND_COLUMN);
+  Tableau<double> csr(size, size, ROW_AND_COLUMN, CSR_ALLOCATION);
+  for (auto i = 0; i < size; i++) {
+    List<double> *row = new List<double>();
+    for (auto j = 0; j <= i; j++)
+      if (lower[i][j] != 0) row->Append(j, lower[i][j]);
+    csr.AppendRow(i, new List<double>(row));
+    m.AppendRow(i, row);
+  }
+  // A const CSR_ALLOCATION tableau is only read through ReadRow and ReadCol.
+  const Tableau<double> *reader = &csr;
+  EXPECT_THROW(reader->Row(0), std::runtime_error);
+  EXPECT_THROW(reader->Col(0), std::runtime_error);
+  SparseTriangularSolver<double> solver(size);
+  for (tableau_size_t nonzeros : {1, 2, 10, 50, 300}) {
+    List<double> b;
+    for (auto i = 0; i < size; i++)
+      if (tableau_size_t(rng() % size) < nonzeros) b.Append(i, 1 + rng() % 9);
+    // L x = b by columns, then L^T x = b by rows.
+    for (bool transpose : {false, true}) {
+      List<double> *x = solver.Solve(&m, &b, transpose);
+      List<double> *swept = solver.SolveDense(&m, &b, transpose, transpose);
+      List<double> *from_csr = solver.Solve(&csr, &b, transpose);
+      EXPECT_EQ(x->Size(), swept->Size());
+      EXPECT_EQ(x->Size(), from_csr->Size());
+      for (auto i = 0; i < size; i++) {
+        double product = 0;
+        x->ForEach([&](tableau_index_t j, double value) {
+          product += (transpose ? lower[j][i] : lower[i][j]) * value;
+        });
+        ASSERT_NEAR(product, b.At(i), 1e-9);
+        ASSERT_NEAR(x->At(i), swept->At(i), 1e-9);
+        ASSERT_EQ(x->At(i), from_csr->At(i));
+      }
+      delete x;
+      delete swept;
+      delete from_csr;
+    }
+  }
+}
+
+TEST(Pricing, ChoosesTheLargestScore) {
+  int threads = omp_get_max_threads();
+  SimdLevel detected = GetSimdLevel();
+  std::mt19937 rng(23);
+  // Around the block of the vector kernels, and above kParallelWork.
+  for (tableau_size_t size : {1, 63, 64, 65, 1000, 100003}) {
+    std::vector<double> d(size), sign(size), weight(size);
+    for (auto j = 0; j < size; j++) {
+      d[j] = (static_cast<int>(rng() % 2001) - 1000) / 100.0;
+      sign[j] = static_cast<int>(rng() % 3) - 1;
+      weight[j] = 1 + rng() % 50 / 10.0;
+    }
+    // A tie, which goes to the first index.
+    if (size > 10) {
+      d[size - 1] = d[size / 2] = -100;
+      sign[size - 1] = sign[size / 2] = -1;
+      weight[size - 1] = weight[size / 2] = 2;
+    }
+    const double tolerance = 0.5;
+    for (const double *w : {static_cast<double *>(nullptr), weight.data()}) {
+      tableau_index_t expected = -1;
+      double best = 0;
+      for (auto j = 0; j < size; j++) {
+        double gain = d[j] * sign[j];
+        if (gain <= tolerance) continue;
+        double score = gain * gain / (w == nullptr ? 1 : w[j]);
+        if (score > best) {
+          best = score;
+          expected = j;
+        }
+      }
+      for (int thread_count : {1, 4}) {
+        omp_set_num_threads(thread_count);
+        for (auto level : {SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512}) {
+          SetSimdLevel(level);
+          auto [index, score] =
+              DenseArgMaxScore(d.data(), sign.data(), w, tolerance, size);
+          ASSERT_EQ(index, expected);
+          ASSERT_EQ(score, best);
+          if (w != nullptr) continue;
+          Pricing<double> pricing(size);
+          ASSERT_EQ(pricing.Choose(d.data(), sign.data(), tolerance),
+                    expected);
+        }
+      }
+    }
+    // Partial pricing finds attractive variables until there are none.
+    Pricing<double> pricing(size);
+    pricing.SetPartial(size / 7 + 1, 3);
+    std::vector<char> chosen(size);
+    for (;;) {
+      tableau_index_t j = pricing.Choose(d.data(), sign.data(), tolerance);
+      if (j < 0) break;
+      ASSERT_GT(d[j] * sign[j], tolerance);
+      ASSERT_FALSE(chosen[j]);
+      chosen[j] = 1;
+      sign[j] = 0;
+    }
+    for (auto j = 0; j < size; j++) EXPECT_LE(d[j] * sign[j], tolerance);
+  }
+  SetSimdLevel(detected);
+  omp_set_num_threads(threads);
+}
+
+TEST(Pricing, WeightUpdates) {
+  // Variable 0 replaces the basic 1 with pivot 2; the pivot row has 1 at
+  // variable 2 and 4 at 3, and kappa is 0.5 and 0 there.
+  std::vector<double> sign = {-1, 0, -1, -1}, kappa = {0, 0, 0.5, 0};
+  auto row = [](auto visit) {
+    visit(2, 1);
+    visit(3, 4);
+  };
+  Pricing<double> devex(4, DEVEX), steepest_edge(4, STEEPEST_EDGE);
+  for (auto pricing : {&devex, &steepest_edge}) {
+    pricing->Reset(sign.data());
+    EXPECT_FALSE(pricing->InFramework(1));
+    List<double> alpha;
+    alpha.Append(0, 2);
+    EXPECT_EQ(pricing->ColumnWeight(0, &alpha, [](auto) { return 1; }), 1);
+    pricing->Update(0, 1, 2, 1, row, kappa.data());
+  }
+  // max(w_j, (alpha_rj / alpha_rq)^2 w_q), and max(w_q / alpha_rq^2, 1).
+  EXPECT_EQ(devex.Weight(1), 1);
+  EXPECT_EQ(devex.Weight(2), 1);
+  EXPECT_EQ(devex.Weight(3), 4);
+  // w_j - 2 ratio kappa_j + ratio^2 w_q, at least 1 + ratio^2 at both ends.
+  EXPECT_EQ(steepest_edge.Weight(1), 0.25);
+  EXPECT_EQ(steepest_edge.Weight(2), 1.25);
+  EXPECT_EQ(steepest_edge.Weight(3), 5);
+  // The largest gain^2 / w.
+  std::vector<double> d = {0, 0, 2, 5};
+  sign = {0, 0, 1, 1};
+  EXPECT_EQ(steepest_edge.Choose(d.data(), sign.data(), 0), 3);
+  d[2] = 3;
+  EXPECT_EQ(steepest_edge.Choose(d.data(), sign.data(), 0), 2);
+  // An updated Devex weight three times its exact value starts a new
+  // framework with unit weights at the next choice.
+  devex.Update(3, 2, 1, 1, row, nullptr);
+  EXPECT_EQ(devex.Weight(2), 1);
+  EXPECT_EQ(devex.Weight(1), 1);
+  EXPECT_EQ(devex.Choose(d.data(), sign.data(), 0), 3);
+  EXPECT_EQ(devex.Weight(3), 1);
+  EXPECT_FALSE(devex.InFramework(0));
+}
+
+TEST(RatioTest, HarrisAndLongStep) {
+  RatioTest<double> ratio_test(1e-9, 0.01);
+  std::vector<double> down = {4, 0, 0, 10}, up = {1, 8.01, 1, 1};
+  List<double> alpha;
+  alpha.Append(0, 2);
+  alpha.Append(1, -4);
+  alpha.Append(2, 1e-10);
+  alpha.Append(3, 1);
+  // Position 0 reaches its bound first, at 2, but position 1 is within the
+  // tolerance at 2.0025 and has the larger rate.
+  auto [position, step] =
+      ratio_test.Harris(&alpha, down.data(), up.data(), 3);
+  EXPECT_EQ(position, 1);
+  EXPECT_DOUBLE_EQ(step, 2.0025);
+  // The entering variable reaches its other bound first.
+  EXPECT_EQ(ratio_test.Harris(&alpha, down.data(), up.data(), 1.5).position,
+            -1);
+  std::vector<double> unbounded(4, RatioTest<double>::Infinity());
+  step = ratio_test
+             .Harris(&alpha, unbounded.data(), unbounded.data(),
+                     RatioTest<double>::Infinity())
+             .step;
+  EXPECT_EQ(step, RatioTest<double>::Infinity());
+
+  // Breakpoints at 1, 2 and 5 that cost 2, 10 and, unbounded, everything.
+  down = {1, 4, 5};
+  up = {1, 1, RatioTest<double>::Infinity()};
+  List<double> column;
+  column.Append(0, 1);
+  column.Append(1, 2);
+  column.Append(2, 1);
+  RatioTest<double> long_step(1e-9, 1e-9);
+  auto stop = long_step.LongStep(&column, down.data(), up.data(), 5);
+  EXPECT_EQ(stop.position, 1);
+  EXPECT_EQ(stop.step, 2);
+  EXPECT_THAT(long_step.Passed(), testing::ElementsAre(0));
+  stop = long_step.LongStep(&column, down.data(), up.data(), 20);
+  EXPECT_EQ(stop.position, 2);
+  EXPECT_EQ(stop.step, 5);
+  EXPECT_THAT(long_step.Passed(), testing::UnorderedElementsAre(0, 1));
+}
+
+TEST(RatioTest, HarrisMatchesScalar) {
+  int threads = omp_get_max_threads();
+  SimdLevel detected = GetSimdLevel();
+  std::mt19937 rng(29);
+  const double pivot_tolerance = 1e-9, harris_tolerance = 0.5;
+  RatioTest<double> ratio_test(pivot_tolerance, harris_tolerance);
+  // Around the block of the vector kernels, and above kParallelWork.
+  for (tableau_size_t size : {5, 64, 65, 1000, 100003}) {
+    std::vector<double> down(size), up(size);
+    List<double> dense(size, DENSE), sparse;
+    for (auto i = 0; i < size; i++) {
+      down[i] = rng() % 1000;
+      up[i] = rng() % 4 ? rng() % 1000 : RatioTest<double>::Infinity();
+      double rate = static_cast<int>(rng() % 41) - 20;
+      dense.Set(i, rate);
+      if (rng() % 3 == 0) sparse.Append(i, rate);
+    }
+    List<double> bitmap(sparse);
+    bitmap.ConvertTo(BITMAP);
+    for (const List<double> *alpha : {&dense, &sparse, &bitmap}) {
+      // Both passes, one element at a time.
+      double bound = RatioTest<double>::Infinity();
+      alpha->ForEach([&](tableau_index_t i, double value) {
+        if (value > 0) bound = std::min(bound, (down[i] + 0.5) / value);
+        if (value < 0) bound = std::min(bound, (up[i] + 0.5) / -value);
+      });
+      tableau_index_t expected = -1;
+      double best = 0, expected_step = 0;
+      alpha->ForEach([&](tableau_index_t i, double value) {
+        double room = value > 0 ? down[i] : up[i];
+        if (value == 0 or room > bound * std::abs(value)) return;
+        if (std::abs(value) > best) {
+          best = std::abs(value);
+          expected = i;
+          expected_step = room / best;
+        }
+      });
+      for (int thread_count : {1, 4}) {
+        omp_set_num_threads(thread_count);
+        for (auto level : {SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512}) {
+          SetSimdLevel(level);
+          auto [position, step] =
+              ratio_test.Harris(alpha, down.data(), up.data(), 1e9);
+          ASSERT_EQ(position, expected);
+          ASSERT_EQ(step, expected_step);
+        }
+      }
+    }
+  }
+  SetSimdLevel(detected);
+  omp_set_num_threads(threads);
+}
+
+/*
+ * min c^T x subject to A x <= b, x >= 0 with b >= 0, by a dense tableau and
+ * Bland's rule, or infinity if unbounded.
+ */
+static double DenseSimplex(const std::vector<std::vector<double>> &a,
+                           const std::vector<double> &b,
+                           const std::vector<double> &c) {
+  size_t m = a.size(), n = c.size(), width = n + m + 1;
+  std::vector<std::vector<double>> tableau(m + 1,
+                                           std::vector<double>(width));
+  std::vector<size_t> basis(m);
+  for (size_t i = 0; i < m; i++) {
+    for (size_t j = 0; j < n; j++) tableau[i][j] = a[i][j];
+    tableau[i][n + i] = 1;
+    tableau[i][width - 1] = b[i];
+    basis[i] = n + i;
+  }
+  for (size_t j = 0; j < n; j++) tableau[m][j] = c[j];
+  while (true) {
+    size_t entering = 0;
+    while (entering < n + m and tableau[m][entering] > -1e-9) entering++;
+    if (entering == n + m) return -tableau[m][width - 1];
+    size_t leaving = m;
+    for (size_t i = 0; i < m; i++) {
+      if (tableau[i][entering] <= 1e-9) continue;
+      if (leaving == m) {
+        leaving = i;
+        continue;
+      }
+      double ratio = tableau[i][width - 1] / tableau[i][entering];
+      double best = tableau[leaving][width - 1] / tableau[leaving][entering];
+      if (ratio < best - 1e-12 or
+          (ratio < best + 1e-12 and basis[i] < basis[leaving]))
+        leaving = i;
+    }
+    if (leaving == m) return std::numeric_limits<double>::infinity();
+    double pivot = tableau[leaving][entering];
+    for (auto &value : tableau[leaving]) value /= pivot;
+    for (size_t i = 0; i <= m; i++) {
+      double factor = tableau[i][entering];
+      if (i == leaving or factor == 0) continue;
+      for (size_t j = 0; j < width; j++)
+        tableau[i][j] -= factor * tableau[leaving][j];
+    }
+    basis[leaving] = entering;
+  }
+}
+
+TEST(RevisedSimplex, SmallProblems) {
+  // max 3x + 5y with x <= 4, 2y <= 12, 3x + 2y <= 18 is at (2, 6).
+  Tableau<double> a(3, 2);
+  List<double> *row = new List<double>();
+  row->Append(0, 1);
+  a.AppendRow(0, row);
+  row = new List<double>();
+  row->Append(1, 2);
+  a.AppendRow(1, row);
+  row = new List<double>();
+  row->Append(0, 3);
+  row->Append(1, 2);
+  a.AppendRow(2, row);
+  List<double> b, c;
+  b.Append(0, 4);
+  b.Append(1, 12);
+  b.Append(2, 18);
+  c.Append(0, -3);
+  c.Append(1, -5);
+  RevisedSimplex<double> simplex(&a, &b, &c);
+  EXPECT_EQ(simplex.Solve(), OPTIMAL);
+  EXPECT_NEAR(simplex.Objective(), -36, 1e-9);
+  List<double> *x = simplex.Primal();
+  EXPECT_NEAR(x->At(0), 2, 1e-9);
+  EXPECT_NEAR(x->At(1), 6, 1e-9);
+  delete x;
+  // With x <= 1 as a bound, x only ever flips to it.
+  simplex.SetBounds(0, 0, 1);
+  EXPECT_EQ(simplex.Solve(), OPTIMAL);
+  EXPECT_NEAR(simplex.Objective(), -33, 1e-9);
+  // Under x - 2y <= 1 alone, nothing stops y from growing.
+  Tableau<double> unbounded(1, 2);
+  row = new List<double>();
+  row->Append(0, 1);
+  row->Append(1, -2);
+  unbounded.AppendRow(0, row);
+  List<double> one;
+  one.Append(0, 1);
+  RevisedSimplex<double> ray(&unbounded, &one, &c);
+  EXPECT_EQ(ray.Solve(), UNBOUNDED);
+}
+
+TEST(RevisedSimplex, MatchesDenseTableau) {
+  std::mt19937 rng(5);
+  // The largest takes a few hundred iterations, with refactorizations.
+  for (auto [m, n] : {std::pair{8, 12}, {40, 60}, {120, 90}, {300, 200}}) {
+    std::vector<std::vector<double>> dense(m, std::vector<double>(n));
+    std::vector<double> b(m), c(n);
+    Tableau<double> a(m, n);
+    Tableau<double> csr(m, n, ROW_AND_COLUMN, CSR_ALLOCATION);
+    List<double> b_list, c_list;
+    for (auto i = 0; i < m; i++) {
+      List<double> *row = new List<double>();
+      for (auto j = 0; j < n; j++) {
+        if (rng() % 4 != 0 and j % m != i) continue;
+        dense[i][j] = 1 + rng() % 97 / 10.0;
+        row->Append(j, dense[i][j]);
+      }
+      csr.AppendRow(i, new List<double>(row));
+      a.AppendRow(i, row);
+      b[i] = 10 + rng() % 89;
+      b_list.Append(i, b[i]);
+    }
+    for (auto j = 0; j < n; j++) {
+      c[j] = -1.0 - rng() % 53 / 7.0;
+      c_list.Append(j, c[j]);
+    }
+    double expected = DenseSimplex(dense, b, c);
+    // Every rule, and partial pricing in blocks of a tenth of the variables.
+    for (auto rule : {DANTZIG, DEVEX, STEEPEST_EDGE}) {
+      for (tableau_size_t block : {0, (m + n) / 10 + 1}) {
+        RevisedSimplex<double> simplex(&a, &b_list, &c_list);
+        simplex.SetPricing(rule, block, block == 0 ? 1 : 4);
+        ASSERT_EQ(simplex.Solve(), OPTIMAL);
+        EXPECT_NEAR(simplex.Objective(), expected, 1e-7 * std::abs(expected));
+        // The solution is feasible.
+        List<double> *x = simplex.Primal();
+        for (auto i = 0; i < m; i++) {
+          double lhs = 0;
+          for (auto j = 0; j < n; j++) lhs += dense[i][j] * x->At(j);
+          EXPECT_LE(lhs, b[i] + 1e-7);
+        }
+        for (auto j = 0; j < n; j++) EXPECT_GE(x->At(j), -1e-9);
+        delete x;
+      }
+    }
+    // The columns of a CSR_ALLOCATION tableau are read in place.
+    RevisedSimplex<double> from_csr(&csr, &b_list, &c_list);
+    ASSERT_EQ(from_csr.Solve(), OPTIMAL);
+    EXPECT_NEAR(from_csr.Objective(), expected, 1e-7 * std::abs(expected));
+  }
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "tableau.h"
+
+/**
+ * Depth first search workspace for the symbolic step of Gilbert-Peierls
+ * solves: the nodes reachable from a set of starts in a DAG, in topological
+ * order. The marks are cleared through the result, so a search costs the
+ * nodes and edges it visits, however large the graph.
+ */
+template <typename I = tableau_index_t>
+class SparseReach {
+ public:
+  explicit SparseReach(tableau_size_t size) : marked_(size) {}
+
+  /**
+   * starts(visit) calls visit(node) for the starting nodes and
+   * neighbors(node, visit) for the heads of the edges out of node. Returns
+   * the reached nodes, each before all nodes it has an edge to; the vector
+   * is reused by the next call.
+   */
+  template <typename Starts, typename Neighbors>
+  const std::vector<I>& Reach(Starts starts, Neighbors neighbors) {
+    order_.clear();
+    starts([&](tableau_index_t start) {
+      if (marked_[start]) return;
+      // A node is pushed once to be expanded and once more, below its
+      // children, to be finished. Stale copies of an expanded node are
+      // skipped, in a DAG none is on the path.
+      stack_.push_back({static_cast<I>(start), false});
+      while (not stack_.empty()) {
+        auto [node, expanded] = stack_.back();
+        stack_.pop_back();
+        if (expanded) {
+          order_.push_back(node);
+          continue;
+        }
+        if (marked_[node]) continue;
+        marked_[node] = 1;
+        stack_.push_back({node, true});
+        neighbors(node, [&](tableau_index_t next) {
+          if (not marked_[next])
+            stack_.push_back({static_cast<I>(next), false});
+        });
+      }
+    });
+    std::reverse(order_.begin(), order_.end());
+    for (I node : order_) marked_[node] = 0;
+    return order_;
+  }
+
+ private:
+  std::vector<char> marked_;
+  std::vector<std::pair<I, bool>> stack_;
+  std::vector<I> order_;
+};
+
+/**
+ * Solves M x = b for a triangular M whose columns are the columns of a
+ * tableau, or its rows with transpose, for a sparse b. Solve is the
+ * Gilbert-Peierls method: the reach of b in the graph of M, with an edge
+ * j -> i for every off diagonal element M_ij, is the pattern of x in an order
+ * that the numeric sweep can follow, so a solve costs the flops it does and
+ * not the size of M. SolveDense sweeps every column instead, for
+ * comparison and for a b too dense to gain from the search.
+ *
+ * Every column of M has its diagonal element. Results are SPARSE lists.
+ */
+template <typename T, typename I = tableau_index_t>
+class SparseTriangularSolver {
+ public:
+  explicit SparseTriangularSolver(tableau_size_t size)
+      : reach_(size), x_(size) {}
+
+  List<T, I>* Solve(const Tableau<T, I>* m, const List<T, I>* b,
+                    bool transpose = false) {
+    b->ForEach([&](tableau_index_t i, T value) { x_[i] = value; });
+    const std::vector<I>& order = reach_.Reach(
+        [&](auto visit) {
+          b->ForEach([&](tableau_index_t i, T value) {
+            if (value != T(0)) visit(i);
+          });
+        },
+        [&](tableau_index_t j, auto visit) {
+          ReadLine(m, j, transpose, [&](const List<T, I>* line) {
+            line->ForEach([&](tableau_index_t i, T) {
+              if (i != j) visit(i);
+            });
+          });
+        });
+    for (I j : order) Eliminate(m, j, transpose);
+    pattern_.assign(order.begin(), order.end());
+    std::sort(pattern_.begin(), pattern_.end());
+    return Gather();
+  }
+
+  /* upper tells the direction of the sweep. */
+  List<T, I>* SolveDense(const Tableau<T, I>* m, const List<T, I>* b,
+                         bool upper, bool transpose = false) {
+    b->ForEach([&](tableau_index_t i, T value) { x_[i] = value; });
+    tableau_size_t size = x_.size();
+    pattern_.clear();
+    for (tableau_index_t k = 0; k < size; k++) {
+      tableau_index_t j = upper ? size - 1 - k : k;
+      if (x_[j] == T(0)) continue;
+      Eliminate(m, j, transpose);
+      pattern_.push_back(j);
+    }
+    if (upper) std::reverse(pattern_.begin(), pattern_.end());
+    return Gather();
+  }
+
+ private:
+  /* Lends line j, so a CSR_ALLOCATION m is read without creating views. */
+  template <typename Visitor>
+  static void ReadLine(const Tableau<T, I>* m, tableau_index_t j,
+                       bool transpose, Visitor visit) {
+    if (transpose)
+      m->ReadRow(j, visit);
+    else
+      m->ReadCol(j, visit);
+  }
+
+  /* x_j /= M_jj, then column j times x_j leaves the rest of x. */
+  void Eliminate(const Tableau<T, I>* m, tableau_index_t j, bool transpose) {
+    if (x_[j] == T(0)) return;
+    ReadLine(m, j, transpose, [&](const List<T, I>* line) {
+      T value = x_[j] / line->At(j);
+      x_[j] = value;
+      line->ForEach([&](tableau_index_t i, T element) {
+        if (i != j) x_[i] -= element * value;
+      });
+    });
+  }
+
+  /* The nonzeros of x_ at pattern_, which is sorted, leaving x_ zero. */
+  List<T, I>* Gather() {
+    List<T, I>* x = new List<T, I>(pattern_.size());
+    for (I i : pattern_) {
+      if (x_[i] != T(0)) x->Append(i, x_[i]);
+      x_[i] = 0;
+    }
+    return x;
+  }
+
+  SparseReach<I> reach_;
+  // Zero between calls.
+  std::vector<T> x_;
+  std::vector<I> pattern_;
+};